@@ -119,6 +119,15 @@ bool str_empty(const String s) {
     return !s || s->length == 0;
 }
 
+size_t str_capacity(const String s) {
+    if (!s) return 0;
+    size_t blocks = 0;
+    for (Block *curr = s->head; curr; curr = curr->next) {
+        blocks++;
+    }
+    return blocks * BLOCK_SIZE;
+}
+
 // ==================== 赋值和拷贝 ====================
 
 bool str_assign(String s, const char *cstr) {
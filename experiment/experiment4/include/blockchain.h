@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /**
  * @file string.h
@@ -17,6 +18,9 @@
 
 typedef struct String *String;
 
+/** Returned by position queries when no valid position exists */
+#define STR_NPOS ((size_t)-1)
+
 typedef enum
 {
     STR_OK = 0,        /**< 操作成功 */
@@ -237,6 +241,286 @@ bool str_insert_char(String s, size_t pos, char c);
  */
 bool str_delete(String s, size_t pos, size_t len);
 
+/* ========================================================================
+ * Batched Edits
+ * ======================================================================== */
+
+/**
+ * @brief A single edit applied by str_apply_edits()
+ *
+ * Removes delete_len characters starting at pos, then inserts insert_len
+ * characters of insert_text at that position. Positions always refer to the
+ * original string, before any edit of the batch is applied.
+ */
+typedef struct
+{
+    size_t pos;              /**< Start position in the original string */
+    size_t delete_len;       /**< Number of characters to remove */
+    const char *insert_text; /**< Text to insert, may be NULL if insert_len is 0 */
+    size_t insert_len;       /**< Number of characters to insert */
+} StrEdit;
+
+/**
+ * @brief Apply a list of edits to a string in a single sweep
+ *
+ * @param s String object, must not be NULL
+ * @param edits Array of n edits, positions relative to the original string
+ * @param n Number of edits
+ * @param new_pos Optional output array of n entries (may be NULL); new_pos[i]
+ *                receives the position of edits[i] in the resulting string,
+ *                i.e. where its inserted text begins
+ * @return STR_OK on success,
+ *         STR_OUT_OF_RANGE if an edit reaches past the end of s,
+ *         STR_INVALID_PARAM if edits overlap or an argument is invalid,
+ *         STR_ALLOC_FAILED on memory failure
+ *
+ * @note Edits may be given in any order, they are sorted by position first.
+ *       At one position, pure insertions are applied in array order and
+ *       before an edit that deletes from there, wherever it is in the array
+ * @note Two edits overlap when one starts inside the range deleted by the
+ *       other; a pure insertion at the start of a deletion does not overlap
+ *       it, two deletions from the same position do. On any error s is
+ *       left unchanged
+ * @note Time complexity: O(n + k log k + total inserted length) for k edits,
+ *       instead of O(k * n) for repeated str_delete()/str_insert() calls
+ *
+ * @code
+ * String s = str_create_from("Hello World");
+ * StrEdit edits[] = {
+ *     {6, 5, "Blocks", 6},  // replace "World"
+ *     {0, 0, ">> ", 3},     // prepend
+ * };
+ * size_t where[2];
+ * str_apply_edits(s, edits, 2, where);
+ * // s becomes ">> Hello Blocks", where = {9, 0}
+ * @endcode
+ */
+StrError str_apply_edits(String s, const StrEdit *edits, size_t n, size_t *new_pos);
+
+/* ========================================================================
+ * Cold Storage
+ * ======================================================================== */
+
+/**
+ * @brief Enable or disable automatic compression of cold blocks
+ *
+ * @param s String object, must not be NULL
+ * @param ops Number of operations after which an untouched block counts as
+ *            cold, 0 disables the mode
+ * @return true on success, false on failure
+ *
+ * @note Every ops operations on s, runs of at least 8 consecutive cold blocks
+ *       are compressed into one LZ4-style frame (up to 64 blocks per frame),
+ *       if that saves at least a quarter of their memory
+ * @note Frames are decompressed lazily when str_at(), a search or an edit
+ *       reaches them; the tail block is never compressed, so appends stay O(1)
+ * @note Bytes appended since the previous compaction count as touched, so a
+ *       growing log only compresses blocks written at least ops operations ago
+ * @note Disabling the mode keeps existing frames until they are accessed
+ *
+ * @code
+ * String cache = str_create_from(archived_text);
+ * str_set_cold_threshold(cache, 1000);
+ * @endcode
+ */
+bool str_set_cold_threshold(String s, size_t ops);
+
+/**
+ * @brief Compress all cold block runs now
+ *
+ * @param s String object
+ * @return Number of frames created
+ *
+ * @note Without cold mode every block except the tail counts as cold
+ * @note Time complexity: O(n)
+ *
+ * @code
+ * String s = str_create_from(large_text);
+ * str_compact(s);
+ * char c = str_at(s, 100);  // Decompresses only the frame holding index 100
+ * @endcode
+ */
+size_t str_compact(String s);
+
+/**
+ * @brief Get the number of bytes of heap memory held by the string
+ *
+ * @param s String object
+ * @return Bytes used by the string object, its blocks and compressed frames
+ *
+ * @note Time complexity: O(number of blocks)
+ */
+size_t str_memory_usage(const String s);
+
+/* ========================================================================
+ * Reserve and Builder
+ * ======================================================================== */
+
+/**
+ * @brief Reserve room so that the string can hold n characters
+ *
+ * @param s String object, must not be NULL
+ * @param n Total number of characters to make room for
+ * @return true on success, false on failure
+ *
+ * @note The missing blocks are allocated contiguously in one malloc() and
+ *       handed out by later appends and inserts, so building the string no
+ *       longer calls malloc() every 31 bytes. Freed blocks from the reserved
+ *       runs are kept for reuse until str_destroy().
+ *
+ * @code
+ * String s = str_create();
+ * str_reserve(s, 4096);  // one allocation for 133 blocks
+ * @endcode
+ */
+bool str_reserve(String s, size_t n);
+
+/**
+ * @brief Get the number of characters the string can hold without allocating
+ *
+ * @param s String object
+ * @return Length plus free room in the tail block and in reserved blocks
+ */
+size_t str_capacity(const String s);
+
+/**
+ * @brief Incremental builder that produces a String
+ *
+ * Appends write straight into the tail block of the string under
+ * construction. str_builder_finish() hands that string over without copying.
+ */
+typedef struct StrBuilder *StrBuilder;
+
+/**
+ * @brief Create a builder
+ *
+ * @param reserve Expected final length, passed to str_reserve() (0 for none)
+ * @return Builder on success, NULL on failure
+ */
+StrBuilder str_builder_create(size_t reserve);
+
+/**
+ * @brief Destroy a builder and the string under construction
+ *
+ * @param b Pointer to builder, *b is set to NULL
+ */
+void str_builder_destroy(StrBuilder *b);
+
+/**
+ * @brief Get the number of characters appended so far
+ */
+size_t str_builder_length(const StrBuilder b);
+
+/**
+ * @brief Append a character array
+ *
+ * @param b Builder
+ * @param data Characters to append
+ * @param len Number of characters
+ * @return true on success, false on failure
+ */
+bool str_builder_append(StrBuilder b, const char *data, size_t len);
+
+/**
+ * @brief Append one character
+ */
+bool str_builder_append_char(StrBuilder b, char c);
+
+/**
+ * @brief Append printf-style formatted text
+ *
+ * @param b Builder
+ * @param fmt printf() format string
+ * @return Number of characters appended, -1 on failure
+ *
+ * @note Output that fits in the tail block is formatted in place
+ *
+ * @code
+ * StrBuilder b = str_builder_create(0);
+ * str_builder_append_fmt(b, "HTTP/1.1 %d %s\r\n", 200, "OK");
+ * String response = str_builder_finish(&b);
+ * @endcode
+ */
+int str_builder_append_fmt(StrBuilder b, const char *fmt, ...);
+
+/**
+ * @brief Finish building and take the string
+ *
+ * @param b Pointer to builder, *b is freed and set to NULL
+ * @return The built string (caller destroys it), NULL if b is NULL
+ */
+String str_builder_finish(StrBuilder *b);
+
+/* ========================================================================
+ * Cursor
+ * ======================================================================== */
+
+/**
+ * @brief Forward read position inside a string
+ *
+ * Gives sequential access to the characters one block run at a time, so
+ * algorithms can scan a string without str_at() walks or flattening it.
+ * Any modification of the string invalidates its cursors.
+ */
+typedef struct
+{
+    String str;          /**< String being read */
+    struct Block *block; /**< Block holding the current position, NULL at end */
+    size_t offset;       /**< Offset of the current position inside block */
+    size_t pos;          /**< Current position in the string */
+} StrCursor;
+
+/**
+ * @brief Place a cursor at a position
+ *
+ * @param cur Cursor to initialize, must not be NULL
+ * @param s String object, must not be NULL
+ * @param pos Start position (0 <= pos <= length)
+ * @return true on success, false if pos is out of range
+ *
+ * @note Time complexity: O(n), O(log n) when the block index is valid
+ */
+bool str_cursor_init(StrCursor *cur, String s, size_t pos);
+
+/**
+ * @brief Get the current position of a cursor
+ */
+size_t str_cursor_pos(const StrCursor *cur);
+
+/**
+ * @brief Get the contiguous characters from the cursor to the end of its block
+ *
+ * @param cur Cursor
+ * @param len Receives the number of characters available
+ * @return Pointer to the characters, NULL at the end of the string
+ *
+ * @note Does not move the cursor; compressed blocks are decompressed here
+ *
+ * @code
+ * StrCursor cur;
+ * str_cursor_init(&cur, s, 0);
+ * size_t len;
+ * const char *p;
+ * while ((p = str_cursor_chunk(&cur, &len)) != NULL) {
+ *     fwrite(p, 1, len, stdout);
+ *     str_cursor_advance(&cur, len);
+ * }
+ * @endcode
+ */
+const char *str_cursor_chunk(StrCursor *cur, size_t *len);
+
+/**
+ * @brief Move a cursor forward by n characters, stopping at the end
+ */
+void str_cursor_advance(StrCursor *cur, size_t n);
+
+/**
+ * @brief Read the character under the cursor and move past it
+ *
+ * @return Character value (0-255), -1 at the end of the string
+ */
+int str_cursor_next(StrCursor *cur);
+
 /* ========================================================================
  * String Operations
  * ======================================================================== */
@@ -325,6 +609,8 @@ int *str_find_all(const String s, const String pattern, size_t start_pos);
  * @param start_pos Position to start searching from
  * @return Position index (>=0) if found, -1 if not found
  *
+ * @note Searches whole blocks with memchr()
+ *
  * @code
  * String s = str_create_from("Hello World");
  * int pos = str_find_char(s, 'W', 0);  // pos = 6
@@ -369,6 +655,719 @@ bool str_replace_first(String s, const String old_str, const String new_str);
  */
 int str_replace_all(String s, const String old_str, const String new_str);
 
+/* ========================================================================
+ * Split and Tokenize
+ * ======================================================================== */
+
+/**
+ * @brief Read-only view of a range inside a string
+ *
+ * A view points into the blocks of its string and may span several of them,
+ * so producing one allocates nothing. Any modification of the string
+ * invalidates its views.
+ */
+typedef struct
+{
+    const struct Block *block; /**< Block holding the first character, NULL if empty at end */
+    size_t offset;             /**< Offset of the first character inside block */
+    size_t length;             /**< Number of characters in the view */
+    size_t pos;                /**< Position of the first character in the string */
+} StrView;
+
+/**
+ * @brief Callback receiving each field, return false to stop early
+ */
+typedef bool (*StrViewCallback)(const StrView *view, void *ctx);
+
+/**
+ * @brief Split a string at every occurrence of a delimiter
+ *
+ * @param s Source string, must not be NULL
+ * @param delim Delimiter character
+ * @param cb Callback called once per field in order, must not be NULL
+ * @param ctx User pointer passed to cb
+ * @return Number of fields passed to cb
+ *
+ * @note Empty fields are kept, so k delimiters always give k+1 fields
+ * @note Delimiters are located with memchr() over whole blocks
+ *
+ * @code
+ * static bool print_field(const StrView *v, void *ctx)
+ * {
+ *     char buf[64];
+ *     str_view_copy(v, buf, sizeof(buf));
+ *     printf("[%s]", buf);
+ *     return true;
+ * }
+ * String line = str_create_from("id,,name");
+ * str_split(line, ',', print_field, NULL);  // Output: [id][][name]
+ * @endcode
+ */
+size_t str_split(String s, char delim, StrViewCallback cb, void *ctx);
+
+/**
+ * @brief Split a string into tokens separated by runs of delimiters
+ *
+ * @param s Source string, must not be NULL
+ * @param delims Delimiter characters (null-terminated), must not be NULL
+ * @param cb Callback called once per token in order, must not be NULL
+ * @param ctx User pointer passed to cb
+ * @return Number of tokens passed to cb
+ *
+ * @note Unlike str_split(), empty tokens are skipped
+ *
+ * @code
+ * String log = str_create_from("  GET /index.html\t200 ");
+ * str_tokenize(log, " \t", print_field, NULL);  // Output: [GET][/index.html][200]
+ * @endcode
+ */
+size_t str_tokenize(String s, const char *delims, StrViewCallback cb, void *ctx);
+
+/**
+ * @brief Copy the characters of a view into a C string
+ *
+ * @param view View to copy
+ * @param buf Destination buffer, always null-terminated when cap > 0
+ * @param cap Size of buf in bytes
+ * @return Number of characters copied (at most cap-1)
+ */
+size_t str_view_copy(const StrView *view, char *buf, size_t cap);
+
+/**
+ * @brief Compare a view with a character array
+ *
+ * @param view View to compare
+ * @param text Characters to compare with
+ * @param len Number of characters in text
+ * @return true if the view holds exactly those characters
+ */
+bool str_view_equals(const StrView *view, const char *text, size_t len);
+
+/* ========================================================================
+ * Transforms
+ * ======================================================================== */
+
+/**
+ * @brief Convert ASCII letters to upper case in place
+ *
+ * @param s String object, must not be NULL
+ * @return true on success, false on failure
+ *
+ * @note Works on whole blocks with SSE2 (SWAR without it); bytes outside
+ *       a-z, including UTF-8 sequences, are left unchanged
+ *
+ * @code
+ * String s = str_create_from("Content-Type");
+ * str_to_upper(s);  // s becomes "CONTENT-TYPE"
+ * @endcode
+ */
+bool str_to_upper(String s);
+
+/**
+ * @brief Convert ASCII letters to lower case in place
+ *
+ * @param s String object, must not be NULL
+ * @return true on success, false on failure
+ */
+bool str_to_lower(String s);
+
+/**
+ * @brief Remove leading and trailing ASCII whitespace
+ *
+ * @param s String object, must not be NULL
+ * @return true on success, false on failure
+ *
+ * @note Whitespace is ' ', '\t', '\n', '\v', '\f' and '\r'
+ *
+ * @code
+ * String s = str_create_from("  key = value\n");
+ * str_trim(s);  // s becomes "key = value"
+ * @endcode
+ */
+bool str_trim(String s);
+
+/**
+ * @brief Replace every byte c with table[c] in place
+ *
+ * @param s String object, must not be NULL
+ * @param table Mapping with 256 entries, must not be NULL
+ * @return true on success, false on failure
+ */
+bool str_translate(String s, const unsigned char *table);
+
+/**
+ * @brief Count occurrences of a character
+ *
+ * @param s String object
+ * @param c Character to count
+ * @return Number of occurrences, 0 if s is NULL
+ *
+ * @note Compressed blocks are counted without being decompressed in place;
+ *       counting '\n' is O(log n) when the block index is up to date
+ */
+size_t str_count_char(const String s, char c);
+
+/* ========================================================================
+ * Numbers
+ * ======================================================================== */
+
+/**
+ * @brief Parse a decimal integer starting at a position
+ *
+ * @param s Source string, must not be NULL
+ * @param pos Position to start from (leading ASCII whitespace is skipped)
+ * @param value Receives the parsed value, must not be NULL
+ * @param end Optional, receives the position after the last digit
+ * @return STR_OK, STR_INVALID_PARAM if there is no number,
+ *         STR_OUT_OF_RANGE if it does not fit (value is clamped)
+ *
+ * @note Digits may span blocks; runs of 8 digits inside a block are parsed
+ *       with one SWAR step
+ *
+ * @code
+ * String s = str_create_from("rows=1048576 cols=7");
+ * int64_t rows;
+ * size_t end;
+ * str_parse_i64(s, 5, &rows, &end);  // rows = 1048576, end = 12
+ * @endcode
+ */
+StrError str_parse_i64(const String s, size_t pos, int64_t *value, size_t *end);
+
+/**
+ * @brief Parse a decimal floating-point number starting at a position
+ *
+ * @param s Source string, must not be NULL
+ * @param pos Position to start from (leading ASCII whitespace is skipped)
+ * @param value Receives the parsed value, must not be NULL
+ * @param end Optional, receives the position after the number
+ * @return STR_OK, STR_INVALID_PARAM if there is no number,
+ *         STR_OUT_OF_RANGE on overflow (value is +-inf)
+ *
+ * @note Accepts [+-]digits[.digits][(e|E)[+-]digits], inf, infinity and nan.
+ *       Numbers whose digits fit in 53 bits with a power of ten within 1e+-22
+ *       are converted with one exact multiply or divide; the rest fall back
+ *       to strtod(). Results are correctly rounded either way.
+ */
+StrError str_parse_f64(const String s, size_t pos, double *value, size_t *end);
+
+/**
+ * @brief Append an integer in decimal
+ *
+ * @param s String object, must not be NULL
+ * @param value Value to append
+ * @return true on success, false on failure
+ */
+bool str_append_i64(String s, int64_t value);
+
+/**
+ * @brief Append a double with the fewest digits that read back exactly
+ *
+ * @param s String object, must not be NULL
+ * @param value Value to append
+ * @return true on success, false on failure
+ *
+ * @note Uses %g style, e.g. 0.1 -> "0.1", 1e21 -> "1e+21", NaN -> "nan"
+ *
+ * @code
+ * String s = str_create();
+ * str_append_f64(s, 0.1 + 0.2);  // s = "0.30000000000000004"
+ * @endcode
+ */
+bool str_append_f64(String s, double value);
+
+/* ========================================================================
+ * Diff
+ * ======================================================================== */
+
+/**
+ * @brief Compute an edit script that turns one string into another
+ *
+ * @param a Old version, must not be NULL
+ * @param b New version, must not be NULL
+ * @param edits Receives an array of count edits (caller frees with free()),
+ *              NULL when the strings are equal
+ * @param count Receives the number of edits, must not be NULL
+ * @return STR_OK on success, STR_INVALID_PARAM, STR_ALLOC_FAILED on memory failure
+ *
+ * @note The script has the fewest inserted plus deleted characters (Myers'
+ *       O(ND) algorithm with the linear-space middle-snake refinement). It is
+ *       sorted by position and can be passed to str_apply_edits() on a
+ *       directly; the insert texts live in the same allocation as the array
+ * @note The shared prefix and suffix are compared block by block in place,
+ *       only the differing middle is copied out. Time complexity:
+ *       O(n + (N + M) * D), space O(N + M), where N and M are the middle
+ *       lengths and D is the number of differences
+ *
+ * @code
+ * String v1 = str_create_from("port=80\nhost=a\n");
+ * String v2 = str_create_from("port=8080\nhost=a\n");
+ * StrEdit *delta;
+ * size_t n;
+ * str_diff(v1, v2, &delta, &n);         // n = 1, delta[0] = {7, 0, "80", 2}
+ * str_apply_edits(v1, delta, n, NULL);  // v1 now equals v2
+ * free(delta);
+ * @endcode
+ */
+StrError str_diff(const String a, const String b, StrEdit **edits, size_t *count);
+
+/* ========================================================================
+ * Rolling Hash
+ * ======================================================================== */
+
+/**
+ * @brief One occurrence reported by str_find_patterns()
+ */
+typedef struct
+{
+    size_t pos;     /**< Position of the occurrence */
+    size_t pattern; /**< Index of the matching pattern */
+} StrHit;
+
+/**
+ * @brief A k-gram fingerprint selected by str_fingerprints()
+ */
+typedef struct
+{
+    uint64_t hash; /**< Hash of the k-gram */
+    size_t pos;    /**< Position of the k-gram */
+} StrFingerprint;
+
+/**
+ * @brief Find all occurrences of several patterns of the same length
+ *
+ * @param s Source string, must not be NULL
+ * @param patterns Array of n patterns, all non-empty and of equal length
+ * @param n Number of patterns (>0)
+ * @param hits Receives an array of count hits (caller frees), sorted by
+ *             position, NULL if nothing was found
+ * @param count Receives the number of hits, must not be NULL
+ * @return STR_OK, STR_INVALID_PARAM if the patterns differ in length,
+ *         STR_ALLOC_FAILED on memory failure
+ *
+ * @note Rabin-Karp: one pass over the blocks with a rolling hash modulo
+ *       2^61-1, looked up in a table of pattern hashes; equal hashes are
+ *       confirmed byte by byte, so there are no false positives.
+ *       Overlapping occurrences are all reported.
+ *       Time complexity: O(n + p * m) expected for p patterns of length m
+ *
+ * @code
+ * String doc = str_create_from("GATTACAGATTACA");
+ * String pats[] = {str_create_from("TTA"), str_create_from("ACA")};
+ * StrHit *hits;
+ * size_t n;
+ * str_find_patterns(doc, pats, 2, &hits, &n);
+ * // n = 4: {2, 0}, {4, 1}, {9, 0}, {11, 1}
+ * free(hits);
+ * @endcode
+ */
+StrError str_find_patterns(const String s, const String *patterns, size_t n, StrHit **hits, size_t *count);
+
+/**
+ * @brief Find the longest substring that occurs at least twice
+ *
+ * @param s Source string, must not be NULL
+ * @param pos Receives the position of its first occurrence
+ * @param len Receives its length, 0 if no character repeats
+ * @return STR_OK, STR_INVALID_PARAM, STR_ALLOC_FAILED
+ *
+ * @note Occurrences may overlap ("banana" -> "ana"). Binary search on the
+ *       length with a rolling-hash pass per step.
+ *       Time complexity: O(n log n) expected, space O(n)
+ */
+StrError str_longest_repeated_substring(const String s, size_t *pos, size_t *len);
+
+/**
+ * @brief Select winnowing fingerprints of a string
+ *
+ * @param s Source string, must not be NULL
+ * @param k k-gram length (>0)
+ * @param window Number of consecutive k-grams per window (>0)
+ * @param prints Receives the fingerprints in position order (caller frees),
+ *               NULL if s is shorter than k
+ * @param count Receives the number of fingerprints, must not be NULL
+ * @return STR_OK, STR_INVALID_PARAM, STR_ALLOC_FAILED
+ *
+ * @note From every window of consecutive k-gram hashes the minimum (the
+ *       rightmost one on ties) is kept, so any shared substring of length
+ *       at least window + k - 1 yields a shared fingerprint. Comparing the
+ *       hash sets of two documents estimates their overlap.
+ *       Time complexity: O(n)
+ */
+StrError str_fingerprints(const String s, size_t k, size_t window, StrFingerprint **prints, size_t *count);
+
+/* ========================================================================
+ * Stream
+ * ======================================================================== */
+
+/**
+ * @brief Single-producer single-consumer byte stream made of blocks
+ *
+ * One producer thread appends blocks at the tail while one consumer thread
+ * reads and releases them at the head. The two sides only share the block
+ * links and a few counters, updated with atomic acquire/release operations;
+ * there is no lock, and consumed blocks are handed back to the producer
+ * through a small ring for reuse.
+ *
+ * Functions are either producer side (write, write_str, flush, close) or
+ * consumer side (peek, consume, read, eof); each side must stay on one
+ * thread. str_stream_buffered() may be called from either.
+ */
+typedef struct StrStream *StrStream;
+
+/**
+ * @brief Create an empty stream
+ *
+ * @return Stream on success, NULL on failure
+ */
+StrStream str_stream_create(void);
+
+/**
+ * @brief Destroy a stream and free its blocks
+ *
+ * @param st Pointer to stream, *st is set to NULL
+ *
+ * @note Both threads must have stopped using the stream
+ */
+void str_stream_destroy(StrStream *st);
+
+/**
+ * @brief Append bytes (producer)
+ *
+ * @param st Stream, must not be NULL
+ * @param data Bytes to append
+ * @param len Number of bytes
+ * @return true on success, false on failure or after close
+ *
+ * @note Full blocks become visible to the consumer at once, a partly filled
+ *       last block only on str_stream_flush() or str_stream_close()
+ */
+bool str_stream_write(StrStream st, const char *data, size_t len);
+
+/**
+ * @brief Move the contents of a string into the stream (producer)
+ *
+ * @param st Stream, must not be NULL
+ * @param s String to move, left empty on success
+ * @return true on success, false on failure (s is unchanged)
+ *
+ * @note The block chain of s is linked into the stream without copying.
+ *       Strings with reserved blocks (str_reserve) are copied instead
+ */
+bool str_stream_write_str(StrStream st, String s);
+
+/**
+ * @brief Make a partly filled last block visible to the consumer (producer)
+ *
+ * @param st Stream
+ */
+void str_stream_flush(StrStream st);
+
+/**
+ * @brief Flush and mark the end of the stream (producer)
+ *
+ * @param st Stream
+ */
+void str_stream_close(StrStream st);
+
+/**
+ * @brief Look at the next readable bytes without copying (consumer)
+ *
+ * @param st Stream
+ * @param len Receives the number of readable bytes, must not be NULL
+ * @return Pointer into the head block, NULL if nothing is available yet
+ *
+ * @note The pointer stays valid until the bytes are consumed
+ *
+ * @code
+ * size_t len;
+ * const char *p;
+ * while (!str_stream_eof(st))
+ * {
+ *     if ((p = str_stream_peek(st, &len)) != NULL)
+ *         str_stream_consume(st, fwrite(p, 1, len, out));
+ * }
+ * @endcode
+ */
+const char *str_stream_peek(StrStream st, size_t *len);
+
+/**
+ * @brief Drop bytes from the head (consumer)
+ *
+ * @param st Stream
+ * @param n Number of bytes to drop
+ * @return Number of bytes actually dropped (fewer if less is available)
+ */
+size_t str_stream_consume(StrStream st, size_t n);
+
+/**
+ * @brief Copy available bytes out and consume them (consumer)
+ *
+ * @param st Stream
+ * @param buf Destination buffer
+ * @param cap Buffer capacity
+ * @return Number of bytes read, 0 if nothing is available yet
+ */
+size_t str_stream_read(StrStream st, char *buf, size_t cap);
+
+/**
+ * @brief Check whether the stream is closed and fully read (consumer)
+ *
+ * @param st Stream
+ * @return true at end of stream, false otherwise
+ */
+bool str_stream_eof(StrStream st);
+
+/**
+ * @brief Number of published bytes not yet consumed
+ *
+ * @param st Stream
+ * @return Byte count; a snapshot when called while the other side runs
+ *
+ * @note Lets the producer throttle itself when the consumer falls behind
+ */
+size_t str_stream_buffered(const StrStream st);
+
+/* ========================================================================
+ * Serialization
+ * ======================================================================== */
+
+/**
+ * @brief Get the number of bytes str_serialize() will write
+ *
+ * @param s String object
+ * @return Serialized size in bytes, 0 if s is NULL
+ *
+ * @note Layout (little endian): 24-byte header (magic "BSTR", u16 version,
+ *       u16 block size, u64 length, u64 block count), one size byte per
+ *       block, then the characters as one contiguous payload
+ */
+size_t str_serialized_size(const String s);
+
+/**
+ * @brief Write the binary image of a string into a buffer
+ *
+ * @param s String object, must not be NULL
+ * @param buf Destination buffer, must not be NULL
+ * @param cap Capacity of buf, at least str_serialized_size(s)
+ * @return Number of bytes written, 0 on failure
+ *
+ * @note Compressed frames are expanded into the buffer, s itself stays cold
+ */
+size_t str_serialize(const String s, void *buf, size_t cap);
+
+/**
+ * @brief Rebuild a string from a binary image
+ *
+ * @param buf Image produced by str_serialize(), e.g. a memory-mapped file
+ * @param len Size of the image in bytes
+ * @return New string with the same block layout, NULL if the image is
+ *         malformed or allocation fails
+ *
+ * @note Copies one block per memcpy instead of replaying characters
+ *
+ * @code
+ * size_t size = str_serialized_size(s);
+ * void *buf = malloc(size);
+ * str_serialize(s, buf, size);
+ * String copy = str_deserialize(buf, size);
+ * @endcode
+ */
+String str_deserialize(const void *buf, size_t len);
+
+/**
+ * @brief Save a string to a binary file stream
+ *
+ * @param s String object
+ * @param fp File opened in binary write mode
+ * @return true on success, false on failure
+ */
+bool str_save(const String s, FILE *fp);
+
+/**
+ * @brief Load a string saved by str_save()
+ *
+ * @param fp File opened in binary read mode
+ * @return New string, NULL on failure
+ *
+ * @note Reads the header, then the block table and payload with one fread()
+ */
+String str_load(FILE *fp);
+
+/* ========================================================================
+ * UTF-8
+ * ======================================================================== */
+
+/*
+ * Code-point queries use a block index built on first use: an array of
+ * blocks with Fenwick trees over per-block byte and code-point counts.
+ * Appends, inserts and deletes keep it up to date (splitting or dropping a
+ * block re-links the index in O(blocks) without rereading text); other edits
+ * mark it stale and the next query rebuilds it in O(n). While the index is
+ * valid, str_at() is O(log n) too.
+ */
+
+/**
+ * @brief Append UTF-8 text after validating it
+ *
+ * @param s String object, must not be NULL
+ * @param data UTF-8 bytes
+ * @param len Number of bytes
+ * @return true on success, false if data is not complete, valid UTF-8
+ *         (overlong forms, surrogates and values above U+10FFFF are
+ *         rejected) or allocation fails; s is unchanged on invalid input
+ *
+ * @note ASCII runs are skipped 16 bytes at a time with SSE2 when available
+ *
+ * @code
+ * String s = str_create();
+ * str_append_utf8(s, "数据结构", 12);
+ * @endcode
+ */
+bool str_append_utf8(String s, const char *data, size_t len);
+
+/**
+ * @brief Get the number of code points in the string
+ *
+ * @param s String object
+ * @return Number of UTF-8 lead bytes, 0 if s is NULL
+ *
+ * @note Time complexity: O(log n) with a valid index
+ */
+size_t str_utf8_length(const String s);
+
+/**
+ * @brief Convert a code-point index to a byte position
+ *
+ * @param s String object
+ * @param cp_index Code-point index (0 <= cp_index <= str_utf8_length(s))
+ * @return Byte position, str_length(s) for cp_index == str_utf8_length(s),
+ *         STR_NPOS if out of range
+ *
+ * @note Time complexity: O(log n)
+ *
+ * @code
+ * String s = str_create_from("数据abc");
+ * size_t pos = str_utf8_offset(s, 2);  // pos = 6
+ * @endcode
+ */
+size_t str_utf8_offset(const String s, size_t cp_index);
+
+/**
+ * @brief Convert a byte position to a code-point index
+ *
+ * @param s String object
+ * @param byte_pos Byte position (0 <= byte_pos <= length)
+ * @return Index of the code point containing byte_pos, STR_NPOS if out of range
+ *
+ * @note Time complexity: O(log n)
+ */
+size_t str_utf8_index(const String s, size_t byte_pos);
+
+/**
+ * @brief Decode the code point at a code-point index
+ *
+ * @param s String object
+ * @param cp_index Code-point index
+ * @return Code point value, -1 if out of range or truncated
+ *
+ * @note Time complexity: O(log n)
+ */
+long str_utf8_at(const String s, size_t cp_index);
+
+/**
+ * @brief Insert UTF-8 text at a code-point index
+ *
+ * @param s String object, must not be NULL
+ * @param cp_index Insert position in code points
+ * @param data UTF-8 bytes, validated like str_append_utf8()
+ * @param len Number of bytes
+ * @return true on success, false on failure
+ */
+bool str_utf8_insert(String s, size_t cp_index, const char *data, size_t len);
+
+/**
+ * @brief Delete code points starting at a code-point index
+ *
+ * @param s String object, must not be NULL
+ * @param cp_index Start position in code points
+ * @param cp_count Number of code points to delete
+ * @return true on success, false if the range is out of bounds
+ */
+bool str_utf8_delete(String s, size_t cp_index, size_t cp_count);
+
+/**
+ * @brief Find a pattern, with positions in code points
+ *
+ * @param s Source string
+ * @param pattern Pattern string
+ * @param start_cp Code-point index to start searching from
+ * @return Code-point index of the first match, -1 if not found
+ *
+ * @code
+ * String s = str_create_from("区块链Blockchain。");
+ * String p = str_create_from("Block");
+ * int pos = str_utf8_find(s, p, 0);  // pos = 3
+ * @endcode
+ */
+int str_utf8_find(const String s, const String pattern, size_t start_cp);
+
+/* ========================================================================
+ * Line Index
+ * ======================================================================== */
+
+/**
+ * @brief Keep a table of line start positions for O(1) line lookup
+ *
+ * @param s String object, must not be NULL
+ * @param enable true to build and maintain the table, false to drop it
+ * @return true on success, false on failure
+ *
+ * @note Newline counts per block are always kept in the block index, so line
+ *       queries work without this table in O(log n). The table adds O(1)
+ *       str_line_start() and is kept up to date by str_push_back(),
+ *       str_append_str() and other appends. An insert or delete marks it
+ *       stale and line queries fall back to O(log n); call this function
+ *       again to rebuild it in O(n) before a run of lookups.
+ * @note Memory: one size_t per line
+ */
+bool str_track_lines(String s, bool enable);
+
+/**
+ * @brief Get the number of lines
+ *
+ * @param s String object
+ * @return Number of '\n' characters plus one, 0 if s is NULL
+ */
+size_t str_line_count(const String s);
+
+/**
+ * @brief Get the position of the first character of a line
+ *
+ * @param s String object
+ * @param line Line number, starting from 0
+ * @return Start position, STR_NPOS if line >= str_line_count(s)
+ *
+ * @note Time complexity: O(1) while the str_track_lines() table is up to
+ *       date, O(log n) otherwise
+ *
+ * @code
+ * String s = str_create_from("first\nsecond\nthird");
+ * size_t pos = str_line_start(s, 2);  // pos = 13
+ * @endcode
+ */
+size_t str_line_start(const String s, size_t line);
+
+/**
+ * @brief Get the line holding a position
+ *
+ * @param s String object
+ * @param pos Position (0 <= pos <= length)
+ * @return Line number starting from 0, STR_NPOS if pos is out of bounds
+ *
+ * @note Time complexity: O(log n)
+ */
+size_t str_line_of(const String s, size_t pos);
+
 /* ========================================================================
  * Output
  * ======================================================================== */
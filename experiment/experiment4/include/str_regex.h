@@ -0,0 +1,126 @@
+#ifndef STR_REGEX_H
+#define STR_REGEX_H
+
+#include "blockchain.h"
+
+/**
+ * @file str_regex.h
+ * @brief Regular expression search over block-linked strings
+ *
+ * Patterns are compiled to a Thompson NFA and run as a lazily built DFA
+ * with a bounded state cache, so a search takes time linear in the text
+ * length whatever the pattern is. The text is read block by block through
+ * a StrCursor and is never flattened.
+ *
+ * Supported syntax:
+ *   literals (UTF-8 allowed), .  [abc]  [^a-z]  [区块]  \d \w \s \D \W \S
+ *   \n \t \r \f \v \xHH  escaped punctuation  ( )  (?: )  |
+ *   * + ? {m} {m,} {m,n} and their lazy forms *? +? ?? {m,n}?
+ *   ^ $ (start and end of the whole string)
+ *
+ * Matching is byte oriented but code-point aware: '.' and classes match
+ * whole UTF-8 sequences. Like Perl and RE2, the leftmost match wins and
+ * alternatives are tried in order (leftmost-first semantics).
+ */
+
+typedef struct StrRegex *StrRegex;
+
+/**
+ * @brief A match as the half-open range [start, end)
+ */
+typedef struct
+{
+    size_t start; /**< Position of the first matched character */
+    size_t end;   /**< Position after the last matched character */
+} StrMatch;
+
+/**
+ * @brief Compile a regular expression
+ *
+ * @param pattern Pattern text (null-terminated), must not be NULL
+ * @param err Optional, receives STR_OK, STR_INVALID_PARAM on a syntax error
+ *            or a pattern that is too large, STR_ALLOC_FAILED on memory failure
+ * @return Compiled regex on success, NULL on failure
+ *
+ * @note Program size is capped (at most 20000 instructions, counted
+ *       repetition up to 1000, nesting up to 256 groups), so untrusted
+ *       patterns cannot exhaust memory or the stack; long patterns are
+ *       rejected with STR_INVALID_PARAM
+ *
+ * @code
+ * StrError err;
+ * StrRegex re = str_regex_compile("[0-9]+(\\.[0-9]+)?", &err);
+ * if (!re)
+ *     printf("Error: %s\n", str_error_message(err));
+ * @endcode
+ */
+StrRegex str_regex_compile(const char *pattern, StrError *err);
+
+/**
+ * @brief Destroy a compiled regex and free memory
+ *
+ * @param re Pointer to regex, *re is set to NULL
+ */
+void str_regex_destroy(StrRegex *re);
+
+/**
+ * @brief Find the first match at or after a position
+ *
+ * @param re Compiled regex
+ * @param s Source string
+ * @param start_pos Position to start searching from (0 <= start_pos <= length)
+ * @param match Receives the match range, may be NULL
+ * @return true if a match was found, false otherwise
+ *
+ * @note Time complexity: O(n) in the searched text; the DFA cache holds at
+ *       most 2048 states and is flushed when full
+ *
+ * @code
+ * String s = str_create_from("id=42, ver=3.14");
+ * StrMatch m;
+ * if (str_regex_find_first(re, s, 0, &m))
+ *     printf("[%zu, %zu)\n", m.start, m.end);  // Output: [3, 5)
+ * @endcode
+ */
+bool str_regex_find_first(StrRegex re, const String s, size_t start_pos, StrMatch *match);
+
+/**
+ * @brief Find all non-overlapping matches
+ *
+ * @param re Compiled regex
+ * @param s Source string
+ * @param start_pos Position to start searching from
+ * @param count Receives the number of matches, must not be NULL
+ * @return Array of count matches (caller frees), NULL if there is none or on failure
+ *
+ * @note After an empty match the search resumes one character later
+ * @note Time complexity: O(n + r), where r is the total read-ahead: to
+ *       settle a leftmost-first match the DFA keeps reading while a higher
+ *       priority alternative is still alive, and the next search rescans
+ *       that text. Usually r is small, but a pattern like [a-z]*X|a on a
+ *       long run of letters reads to the end on every match, O(n^2) overall
+ *       (RE2 has the same bound). Each search resumes from a cursor at the
+ *       previous match end, so the string is never walked from its head
+ */
+StrMatch *str_regex_find_all(StrRegex re, const String s, size_t start_pos, size_t *count);
+
+/**
+ * @brief Replace every match with a replacement string
+ *
+ * @param s Target string, must not be NULL
+ * @param re Compiled regex
+ * @param replacement Replacement text (inserted literally), must not be NULL
+ * @return Number of replacements made (>=0), -1 on failure
+ *
+ * @note All matches are applied in one sweep through str_apply_edits();
+ *       finding them costs as much as str_regex_find_all()
+ *
+ * @code
+ * String s = str_create_from("a1b22c333");
+ * String hash = str_create_from("#");
+ * str_regex_replace_all(s, re_digits, hash);  // s becomes "a#b#c#"
+ * @endcode
+ */
+int str_regex_replace_all(String s, StrRegex re, const String replacement);
+
+#endif // STR_REGEX_H
@@ -0,0 +1,102 @@
+#ifndef STR_TRACE_H
+#define STR_TRACE_H
+
+#include "blockchain.h"
+
+/**
+ * @file str_trace.h
+ * @brief Record String API calls to a trace file for offline replay
+ *
+ * Every str_trace_* function performs the corresponding str_* call and,
+ * while recording is on, writes one line describing it. Strings are named
+ * by small ids ("s1", "s2", ...); a string the trace has not seen yet is
+ * first written as a snapshot of its contents, so a trace started in the
+ * middle of a run is still self-contained.
+ *
+ * Defining STR_TRACE_WRAP before including this header routes the plain
+ * str_* names of that source file through the wrappers, so an application
+ * is instrumented without editing its calls:
+ *
+ * @code
+ * #define STR_TRACE_WRAP
+ * #include "str_trace.h"
+ *
+ * FILE *fp = fopen("edits.trace", "w");
+ * str_trace_start(fp);
+ * ...                    // str_insert(), str_find_first(), ... are recorded
+ * str_trace_stop();
+ * fclose(fp);
+ * @endcode
+ *
+ * Trace format, one call per line (str_replay reads it back):
+ *   strtrace 1
+ *   new <id>
+ *   from <id> <len>:<bytes>
+ *   free <id>
+ *   clear <id>
+ *   append <id> <src>
+ *   push <id> <byte>
+ *   insert <id> <pos> <src>
+ *   insert_char <id> <pos> <byte>
+ *   delete <id> <pos> <len>
+ *   substring <dst> <id> <pos> <len>
+ *   find <id> <pattern> <start> = <result>
+ *   find_char <id> <byte> <start> = <result>
+ *   replace_first <id> <old> <new>
+ *   replace_all <id> <old> <new> = <result>
+ *   at <id> <pos> = <result>
+ * Byte arguments are written as decimal numbers, a NULL string as s0.
+ *
+ * @note Recording is global state and must be driven from one thread.
+ *       Changes made through functions without a wrapper are not recorded,
+ *       so a replay can diverge after them
+ */
+
+/**
+ * @brief Start recording to a stream
+ *
+ * @param out Open stream, written to until str_trace_stop()
+ * @return true on success, false if out is NULL or recording is already on
+ */
+bool str_trace_start(FILE *out);
+
+/**
+ * @brief Stop recording and flush the stream (the stream is not closed)
+ */
+void str_trace_stop(void);
+
+String str_trace_create(void);
+String str_trace_create_from(const char *cstr);
+void str_trace_destroy(String *s);
+void str_trace_clear(String s);
+bool str_trace_append_str(String s, const String other);
+bool str_trace_push_back(String s, char c);
+bool str_trace_insert(String s, size_t pos, const String t);
+bool str_trace_insert_char(String s, size_t pos, char c);
+bool str_trace_delete(String s, size_t pos, size_t len);
+bool str_trace_substring(String sub, const String s, size_t pos, size_t len);
+int str_trace_find_first(const String s, const String pattern, size_t start_pos);
+int str_trace_find_char(const String s, char c, size_t start_pos);
+bool str_trace_replace_first(String s, const String old_str, const String new_str);
+int str_trace_replace_all(String s, const String old_str, const String new_str);
+char str_trace_at(const String s, size_t index);
+
+#ifdef STR_TRACE_WRAP
+#define str_create str_trace_create
+#define str_create_from str_trace_create_from
+#define str_destroy str_trace_destroy
+#define str_clear str_trace_clear
+#define str_append_str str_trace_append_str
+#define str_push_back str_trace_push_back
+#define str_insert str_trace_insert
+#define str_insert_char str_trace_insert_char
+#define str_delete str_trace_delete
+#define str_substring str_trace_substring
+#define str_find_first str_trace_find_first
+#define str_find_char str_trace_find_char
+#define str_replace_first str_trace_replace_first
+#define str_replace_all str_trace_replace_all
+#define str_at str_trace_at
+#endif
+
+#endif // STR_TRACE_H
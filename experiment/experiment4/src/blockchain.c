@@ -1,7 +1,17 @@
 #include "blockchain.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define BLOCK_SIZE 31
+#define BLOCK_FROZEN 0xFF   // size取该值时，块内存放的是压缩帧指针
+#define FRAME_MAX_BLOCKS 64 // 一个压缩帧最多合并的块数
+#define FRAME_MIN_BLOCKS 8  // 冷区间少于该块数时不压缩
+#define HOT_SLOTS 16        // 记录最近访问块的槽位数
 
 typedef struct Block
 {
@@ -10,16 +20,82 @@ typedef struct Block
     char data[BLOCK_SIZE];
 } Block;
 
+// 一段连续冷块压缩后的数据
+typedef struct
+{
+    size_t raw_len;
+    size_t comp_len;
+    unsigned char payload[];
+} Frame;
+
+// 冷压缩模式的状态，仅在开启后分配
+typedef struct
+{
+    size_t threshold;
+    size_t clock;
+    Block *hot[HOT_SLOTS];
+    size_t stamp[HOT_SLOTS];
+    size_t next_slot;
+    size_t appended; // 上次定时压缩后追加到末尾的字节数，这些块刚写过，不算冷块
+} ColdState;
+
+// 块索引中维护的计数种类
+enum
+{
+    IDX_BYTES,  // 块内字节数
+    IDX_POINTS, // 块内UTF-8码点数(按首字节计)
+    IDX_LINES,  // 块内换行符数
+    IDX_KINDS
+};
+
+// 块序号 -> 块指针，并用Fenwick树维护各种计数的前缀和，按需建立
+typedef struct
+{
+    Block **blocks;
+    size_t *tree[IDX_KINDS]; // 1-based
+    size_t count, capacity;
+    bool valid;
+    // 可选的行首位置表，只追加时保持有效，支持O(1)行号定位
+    bool track_lines;
+    bool lines_valid;
+    size_t *lines; // lines[k]为第k+1行的起始位置(第0行从0开始，不存)
+    size_t line_count, line_capacity;
+} BlockIndex;
+
+// str_reserve()预分配的整段块，空闲块串成链表，仅在预留后分配
+typedef struct
+{
+    Block *spare;      // 空闲块链表
+    size_t spare_count;
+    Block **runs;      // 各段起始地址，按地址升序
+    size_t *run_sizes; // 各段块数
+    size_t run_count, run_capacity;
+} BlockPool;
+
 struct String
 {
     Block *head;
     Block *tail;
     size_t length;
+    ColdState *cold;
+    BlockIndex *index;
+    BlockPool *pool;
 };
 
-static Block *block_create(void)
+// 分配一个空块，有预留时优先使用
+static Block *block_create(String s)
 {
-    Block *b = (Block *)malloc(sizeof(Block));
+    Block *b;
+    if (s->pool && s->pool->spare)
+    {
+        b = s->pool->spare;
+        s->pool->spare = b->next;
+        s->pool->spare_count--;
+    }
+    else
+    {
+        b = (Block *)malloc(sizeof(Block));
+    }
     if (b)
     {
         b->next = NULL;
@@ -28,285 +104,1005 @@ static Block *block_create(void)
     return b;
 }
 
-static void block_destroy_all(Block *head)
+// 块是否位于某段预分配内存中，O(log runs)
+static bool pool_owns(const BlockPool *pool, const Block *b)
+{
+    if (!pool)
+        return false;
+    size_t lo = 0, hi = pool->run_count;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (b < pool->runs[mid])
+            hi = mid;
+        else if (b >= pool->runs[mid] + pool->run_sizes[mid])
+            lo = mid + 1;
+        else
+            return true;
+    }
+    return false;
+}
+
+static Frame *block_frame(const Block *b)
+{
+    Frame *f;
+    memcpy(&f, b->data, sizeof(f));
+    return f;
+}
+
+// 块中逻辑字符数，压缩块返回解压后的长度
+static size_t block_span(const Block *b)
+{
+    return b->size == BLOCK_FROZEN ? block_frame(b)->raw_len : b->size;
+}
+
+// 释放一个块：预分配的块回到空闲链表，其余直接free
+static void block_release(String s, Block *b)
+{
+    if (b->size == BLOCK_FROZEN)
+        free(block_frame(b));
+    if (pool_owns(s->pool, b))
+    {
+        b->next = s->pool->spare;
+        s->pool->spare = b;
+        s->pool->spare_count++;
+    }
+    else
+    {
+        free(b);
+    }
+}
+
+static void block_destroy_all(String s, Block *head)
 {
     while (head)
     {
         Block *temp = head;
         head = head->next;
-        free(temp);
+        block_release(s, temp);
     }
 }
 
-//-----Lifecycle Management------
-
-String str_create(void)
+static void pool_free(BlockPool *pool)
 {
-    String str = (String)malloc(sizeof(struct String));
+    if (!pool)
+        return;
+    for (size_t i = 0; i < pool->run_count; i++)
+        free(pool->runs[i]);
+    free(pool->runs);
+    free(pool->run_sizes);
+    free(pool);
+}
 
-    if (!str)
-        return NULL;
+//-----Frame Compression-----
+/*
+LZ4风格的块格式：每个序列由token(高4位字面量长度，低4位匹配长度-4)、
+扩展长度(255累加)、字面量、2字节偏移和扩展匹配长度组成，最后一个序列只有字面量。
+*/
 
-    str->head = str->tail = NULL;
-    str->length = 0;
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define FRAME_RAW_MAX (FRAME_MAX_BLOCKS * BLOCK_SIZE)
+#define FRAME_BOUND (FRAME_RAW_MAX + FRAME_RAW_MAX / 255 + 16)
 
-    return str;
+static size_t lz_put_length(unsigned char *dst, size_t len)
+{
+    size_t op = 0;
+    while (len >= 255)
+    {
+        dst[op++] = 255;
+        len -= 255;
+    }
+    dst[op++] = (unsigned char)len;
+    return op;
 }
 
-String str_create_from(const char *cstr)
+// 输出一个序列，match_len为0表示末尾的纯字面量序列
+static size_t lz_emit(unsigned char *dst, const unsigned char *lit, size_t lit_len,
+                      size_t offset, size_t match_len)
 {
-    if (!cstr)
-        return NULL;
-    String s = str_create();
-    if (!s)
-        return NULL;
-    int i = 0;
-    while (cstr[i] != '\0')
+    size_t op = 1;
+    size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+    dst[0] = (unsigned char)(((lit_len >= 15 ? 15 : lit_len) << 4) | (ml >= 15 ? 15 : ml));
+    if (lit_len >= 15)
+        op += lz_put_length(dst + op, lit_len - 15);
+    memcpy(dst + op, lit, lit_len);
+    op += lit_len;
+    if (match_len)
+    {
+        dst[op++] = (unsigned char)(offset & 0xFF);
+        dst[op++] = (unsigned char)(offset >> 8);
+        if (ml >= 15)
+            op += lz_put_length(dst + op, ml - 15);
+    }
+    return op;
+}
+
+static size_t lz_compress(const unsigned char *src, size_t n, unsigned char *dst)
+{
+    /*
+    time complexity: O(n)
+    greedy matching with a 4-byte hash table, n must be below 65535
+    */
+    uint16_t table[1 << LZ_HASH_BITS] = {0}; // 存位置+1，0表示空
+    size_t ip = 0, anchor = 0, op = 0;
+    while (ip + LZ_MIN_MATCH <= n)
     {
-        if (!str_push_back(s, cstr[i++]))
+        uint32_t seq;
+        memcpy(&seq, src + ip, sizeof(seq));
+        uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t cand = table[h];
+        table[h] = (uint16_t)(ip + 1);
+        if (cand && memcmp(src + cand - 1, src + ip, LZ_MIN_MATCH) == 0)
         {
-            str_destroy(&s);
-            return NULL;
+            size_t ref = cand - 1;
+            size_t len = LZ_MIN_MATCH;
+            while (ip + len < n && src[ref + len] == src[ip + len])
+                len++;
+            op += lz_emit(dst + op, src + anchor, ip - anchor, ip - ref, len);
+            ip += len;
+            anchor = ip;
+        }
+        else
+        {
+            ip++;
         }
     }
+    op += lz_emit(dst + op, src + anchor, n - anchor, 0, 0);
+    return op;
+}
 
-    return s;
+static bool lz_get_length(const unsigned char *src, size_t n, size_t *ip, size_t *len)
+{
+    unsigned char c;
+    do
+    {
+        if (*ip >= n)
+            return false;
+        c = src[(*ip)++];
+        *len += c;
+    } while (c == 255);
+    return true;
 }
 
-void str_destroy(String *s)
+// 返回解压出的字节数，数据损坏时返回0
+static size_t lz_decompress(const unsigned char *src, size_t n, char *dst, size_t cap)
 {
-    if (!s || !*s)
-        return;
-    block_destroy_all((*s)->head);
-    free(*s);
+    size_t ip = 0, op = 0;
+    while (ip < n)
+    {
+        unsigned char token = src[ip++];
+        size_t lit = token >> 4;
+        if (lit == 15 && !lz_get_length(src, n, &ip, &lit))
+            return 0;
+        if (lit > n - ip || lit > cap - op)
+            return 0;
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == n)
+            break;
+
+        if (n - ip < 2)
+            return 0;
+        size_t offset = src[ip] | (size_t)src[ip + 1] << 8;
+        ip += 2;
+        size_t len = token & 15;
+        if (len == 15 && !lz_get_length(src, n, &ip, &len))
+            return 0;
+        len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || len > cap - op)
+            return 0;
+        for (size_t i = 0; i < len; i++, op++) // 偏移可能小于长度，需逐字节复制
+            dst[op] = dst[op - offset];
+    }
+    return op;
 }
 
-//-----Basic Properties-----
+//-----Block Index-----
 
-size_t str_length(const String s)
+// 统计一段字节的各种计数
+static void count_bytes(const char *data, size_t n, size_t counts[IDX_KINDS])
 {
-    return s ? s->length : 0;
+    counts[IDX_BYTES] = n;
+    counts[IDX_POINTS] = 0;
+    counts[IDX_LINES] = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        counts[IDX_POINTS] += ((unsigned char)data[i] & 0xC0) != 0x80;
+        counts[IDX_LINES] += data[i] == '\n';
+    }
 }
 
-bool str_empty(const String s)
+// 块的只读内容，压缩块解压到scratch中，不改变块链
+static const char *block_bytes(const Block *b, char *scratch)
 {
-    return str_length(s) ? false : true;
+    if (b->size != BLOCK_FROZEN)
+        return b->data;
+    Frame *f = block_frame(b);
+    if (lz_decompress(f->payload, f->comp_len, scratch, FRAME_RAW_MAX) != f->raw_len)
+        return NULL;
+    return scratch;
 }
 
-//-----Access-----
-
-char str_at(const String s, size_t index)
+static void fen_add(size_t *tree, size_t count, size_t i, size_t delta)
 {
-    if (!s || index >= s->length)
-    {
-        return '\0';
-    }
+    // delta可以是负数的补码，无符号回绕后结果正确
+    for (i++; i <= count; i += i & (~i + 1))
+        tree[i] += delta;
+}
 
-    Block *current = s->head;
-    size_t pos = 0;
+// 前i个块的计数之和
+static size_t fen_prefix(const size_t *tree, size_t i)
+{
+    size_t sum = 0;
+    for (; i > 0; i -= i & (~i + 1))
+        sum += tree[i];
+    return sum;
+}
 
-    while (current)
+// 返回前缀和首次超过target的块序号，before为该块之前的前缀和
+static size_t fen_search(const size_t *tree, size_t count, size_t target, size_t *before)
+{
+    size_t k = 0, sum = 0;
+    size_t step = 1;
+    while (step * 2 <= count)
+        step *= 2;
+    for (; step > 0; step /= 2)
     {
-        if (pos + current->size > index)
+        if (k + step <= count && sum + tree[k + step] <= target)
         {
-            return current->data[index - pos];
+            k += step;
+            sum += tree[k];
         }
-        pos += current->size;
-        current = current->next;
     }
-
-    return '\0';
+    *before = sum;
+    return k;
 }
 
-//-----Modification Operations-----
-
-void str_clear(String s)
+// tree[1..count]存放各块计数时，原地线性建树
+static void fen_build(size_t *tree, size_t count)
 {
-    if (!s)
-        return;
+    for (size_t i = 1; i <= count; i++)
+    {
+        size_t parent = i + (i & (~i + 1));
+        if (parent <= count)
+            tree[parent] += tree[i];
+    }
+}
 
-    block_destroy_all(s->head);
-    s->length = 0;
-    s->head = s->tail = NULL;
+// fen_build的逆过程，还原各块计数
+static void fen_unbuild(size_t *tree, size_t count)
+{
+    for (size_t i = count; i > 0; i--)
+    {
+        size_t parent = i + (i & (~i + 1));
+        if (parent <= count)
+            tree[parent] -= tree[i];
+    }
 }
 
-bool str_push_back(String s, char c)
+static bool index_reserve(BlockIndex *ix, size_t count)
 {
-    if (!s)
+    if (count <= ix->capacity)
+        return true;
+    size_t capacity = ix->capacity ? ix->capacity * 2 : 64;
+    while (capacity < count)
+        capacity *= 2;
+    Block **blocks = (Block **)realloc(ix->blocks, sizeof(Block *) * capacity);
+    if (!blocks)
         return false;
-
-    if (!s->tail || s->tail->size == BLOCK_SIZE)
+    ix->blocks = blocks;
+    for (int k = 0; k < IDX_KINDS; k++)
     {
-        Block *new_block = block_create();
-        if (new_block)
-        {
-            if (s->head)
-            {
-                s->tail->next = new_block;
-                s->tail = new_block;
-            }
-            else
-            {
-                s->head = s->tail = new_block;
-            }
-            // new_block->next = NULL;
-        }
-        else
-        {
+        size_t *tree = (size_t *)realloc(ix->tree[k], sizeof(size_t) * (capacity + 1));
+        if (!tree)
             return false;
-        }
+        ix->tree[k] = tree;
     }
-    s->tail->data[s->tail->size++] = c;
-    s->length++;
-    // s->tail->next = NULL;
+    ix->capacity = capacity;
     return true;
 }
 
-bool str_append_str(String s, const String other)
+static void index_free(BlockIndex *ix)
 {
-    if (!s || !other)
-        return false;
+    if (!ix)
+        return;
+    free(ix->blocks);
+    for (int k = 0; k < IDX_KINDS; k++)
+        free(ix->tree[k]);
+    free(ix->lines);
+    free(ix);
+}
 
-    Block *curr = other->head;
-    while (curr)
+// 记录data中的换行，data[0]位于pos处
+static void lines_record(BlockIndex *ix, const char *data, size_t n, size_t pos)
+{
+    const char *end = data + n;
+    const char *p = data;
+    while ((p = (const char *)memchr(p, '\n', (size_t)(end - p))) != NULL)
     {
-        for (size_t i = 0; i < curr->size; i++)
+        if (ix->line_count == ix->line_capacity)
         {
-            if (!str_push_back(s, curr->data[i]))
+            size_t capacity = ix->line_capacity ? ix->line_capacity * 2 : 64;
+            size_t *lines = (size_t *)realloc(ix->lines, sizeof(size_t) * capacity);
+            if (!lines)
             {
-                return false;
+                ix->lines_valid = false;
+                return;
             }
+            ix->lines = lines;
+            ix->line_capacity = capacity;
         }
-        curr = curr->next;
+        ix->lines[ix->line_count++] = pos + (size_t)(p - data) + 1;
+        p++;
     }
-    return true;
 }
 
-bool str_insert(String s, size_t pos, const String t)
+// 块链结构改变后调用，下次查询时重建
+static void index_invalidate(String s)
 {
-    if (!s || !t || pos > s->length)
-        return false;
-
-    String temp = str_create();
-    if (!temp)
-        return false;
+    if (s->index)
+        s->index->valid = false;
+}
 
-    // 复制前半部分
-    for (size_t i = 0; i < pos; i++)
+// 确保索引可用，O(n)重建
+static bool index_ensure(String s)
+{
+    /*
+    time complexity: O(n) when rebuilding, O(1) otherwise
+    */
+    if (!s->index)
     {
-        str_push_back(temp, str_at(s, i));
+        s->index = (BlockIndex *)calloc(1, sizeof(BlockIndex));
+        if (!s->index)
+            return false;
     }
+    BlockIndex *ix = s->index;
+    if (ix->valid)
+        return true;
 
-    // 插入t
-    str_append_str(temp, t);
-
-    // 复制后半部分
-    for (size_t i = pos; i < s->length; i++)
+    char scratch[FRAME_RAW_MAX];
+    size_t pos = 0;
+    ix->count = 0;
+    ix->line_count = 0;
+    ix->lines_valid = ix->track_lines;
+    for (Block *b = s->head; b; b = b->next)
     {
-        str_push_back(temp, str_at(s, i));
+        const char *data = block_bytes(b, scratch);
+        if (!data || !index_reserve(ix, ix->count + 1))
+            return false;
+        size_t counts[IDX_KINDS];
+        count_bytes(data, block_span(b), counts);
+        ix->blocks[ix->count++] = b;
+        for (int k = 0; k < IDX_KINDS; k++)
+            ix->tree[k][ix->count] = counts[k];
+        if (ix->lines_valid && counts[IDX_LINES] > 0)
+            lines_record(ix, data, counts[IDX_BYTES], pos);
+        pos += counts[IDX_BYTES];
     }
-
-    str_clear(s);
-    str_append_str(s, temp);
-    str_destroy(&temp);
-
+    for (int k = 0; k < IDX_KINDS; k++)
+        fen_build(ix->tree[k], ix->count);
+    ix->valid = true;
     return true;
 }
 
-bool str_insert_char(String s, size_t pos, char c)
+// 向block_start处的块追加计数(data为新增或删除的字节，sign为1或-1)
+static void index_adjust(String s, size_t block_start, const char *data, size_t n, int sign)
 {
-    if (!s || pos > s->length)
+    BlockIndex *ix = s->index;
+    if (!ix || !ix->valid)
+        return;
+    size_t before;
+    size_t k = fen_search(ix->tree[IDX_BYTES], ix->count, block_start, &before);
+    if (k >= ix->count || before != block_start)
     {
-        return false;
+        ix->valid = false;
+        return;
     }
+    size_t counts[IDX_KINDS];
+    count_bytes(data, n, counts);
+    for (int i = 0; i < IDX_KINDS; i++)
+        fen_add(ix->tree[i], ix->count, k, sign > 0 ? counts[i] : 0 - counts[i]);
+    ix->lines_valid = false; // 行首表只支持追加，下次按行查询时重建
+}
 
-    if (pos == s->length)
+// 尾部追加了n个字节，new_block表示这些字节写入了新的尾块
+static void index_append(String s, bool new_block, const char *data, size_t n)
+{
+    BlockIndex *ix = s->index;
+    if (!ix || !ix->valid)
+        return;
+    if (new_block)
     {
-        return str_push_back(s, c);
+        if (!index_reserve(ix, ix->count + 1))
+        {
+            ix->valid = false;
+            return;
+        }
+        // Fenwick树追加：新结点覆盖区间中除自身外的部分由已有前缀和求得
+        size_t i = ix->count + 1;
+        for (int k = 0; k < IDX_KINDS; k++)
+            ix->tree[k][i] = fen_prefix(ix->tree[k], i - 1) - fen_prefix(ix->tree[k], i - (i & (~i + 1)));
+        ix->blocks[ix->count++] = s->tail;
     }
+    size_t counts[IDX_KINDS];
+    count_bytes(data, n, counts);
+    for (int k = 0; k < IDX_KINDS; k++)
+        fen_add(ix->tree[k], ix->count, ix->count - 1, counts[k]);
+    if (ix->lines_valid && counts[IDX_LINES] > 0)
+        lines_record(ix, data, n, s->length - n);
+}
 
-    // 定位到目标块
-    Block *current = s->head;
-    Block *prev = NULL;
-    size_t block_start = 0;
-
-    while (current && block_start + current->size <= pos)
+// 块链中从block_start处起的removed个块已换成从first起的added个块，原地拼接索引；
+// 只重新统计新块，其余块的计数由树还原，O(块数)且不读块内数据
+static void index_splice(String s, size_t block_start, size_t removed, Block *first, size_t added)
+{
+    BlockIndex *ix = s->index;
+    if (!ix || !ix->valid)
+        return;
+    size_t before;
+    size_t k = fen_search(ix->tree[IDX_BYTES], ix->count, block_start, &before);
+    if (k >= ix->count || before != block_start || removed > ix->count - k ||
+        !index_reserve(ix, ix->count - removed + added))
     {
-        block_start += current->size;
-        prev = current;
-        current = current->next;
+        ix->valid = false;
+        return;
     }
+    size_t rest = ix->count - k - removed;
+    for (int t = 0; t < IDX_KINDS; t++)
+    {
+        fen_unbuild(ix->tree[t], ix->count);
+        memmove(ix->tree[t] + 1 + k + added, ix->tree[t] + 1 + k + removed, sizeof(size_t) * rest);
+    }
+    memmove(ix->blocks + k + added, ix->blocks + k + removed, sizeof(Block *) * rest);
+    ix->count = ix->count - removed + added;
 
-    if (!current)
-        return false;
-
-    size_t block_pos = pos - block_start;
-
-    // 如果当前块有空间，直接在块内插入
-    if (current->size < BLOCK_SIZE)
+    char scratch[FRAME_RAW_MAX];
+    Block *b = first;
+    for (size_t i = 0; i < added; i++, b = b->next)
     {
-        // 块内后移字符
-        for (size_t i = current->size; i > block_pos; i--)
+        const char *data = block_bytes(b, scratch);
+        if (!data)
         {
-            current->data[i] = current->data[i - 1];
+            ix->valid = false;
+            return;
         }
-        current->data[block_pos] = c;
-        current->size++;
-        s->length++;
-        return true;
+        size_t counts[IDX_KINDS];
+        count_bytes(data, block_span(b), counts);
+        ix->blocks[k + i] = b;
+        for (int t = 0; t < IDX_KINDS; t++)
+            ix->tree[t][k + 1 + i] = counts[t];
     }
-    // 块满了，需要分裂或创建新块
-    else
+    for (int t = 0; t < IDX_KINDS; t++)
+        fen_build(ix->tree[t], ix->count);
+    ix->lines_valid = false; // 其后各行的行首都已移动
+}
+
+//-----Cold Storage-----
+
+// 将first起的count个块压缩为一个帧，first本身改为帧块；不划算时返回false
+static bool freeze_run(String s, Block *first, size_t count)
+{
+    unsigned char raw[FRAME_RAW_MAX];
+    unsigned char packed[FRAME_BOUND];
+    size_t raw_len = 0;
+    Block *b = first;
+    for (size_t i = 0; i < count; i++, b = b->next)
     {
-        // 折半分裂
-        unsigned char old_size = current->size;
-        Block *new_block = block_create();
-        current->size /= 2;
-        new_block->size = old_size - current->size;
-        new_block->next = current->next;
-        current->next = new_block;
+        memcpy(raw + raw_len, b->data, b->size);
+        raw_len += b->size;
+    }
+    Block *after = b;
+    if (raw_len == 0)
+        return false;
 
-        // 复制旧块后半块给新块
-        for (int i = 0; i < new_block->size; i++)
-            new_block->data[i] = current->data[current->size + i];
+    size_t comp_len = lz_compress(raw, raw_len, packed);
+    size_t before = count * sizeof(Block);
+    if (sizeof(Block) + sizeof(Frame) + comp_len + before / 4 > before)
+        return false; // 至少节省1/4内存才压缩
 
-        // 插入字符c，递归调用以在分裂后的块中插入
-        if (str_insert_char(s, pos, c))
-            return true; // 简单实现
-        else
-            return false;
+    Frame *f = (Frame *)malloc(sizeof(Frame) + comp_len);
+    if (!f)
+        return false;
+    f->raw_len = raw_len;
+    f->comp_len = comp_len;
+    memcpy(f->payload, packed, comp_len);
+
+    b = first->next;
+    while (b != after)
+    {
+        Block *temp = b;
+        b = b->next;
+        block_release(s, temp);
     }
+    first->next = after;
+    first->size = BLOCK_FROZEN;
+    memcpy(first->data, &f, sizeof(f));
+    return true;
 }
 
-// Deletes 'len' characters from position 'pos' in the string 's'.
-// Returns true if deletion is successful, false otherwise.
-bool str_delete(String s, size_t pos, size_t len)
+// 解压帧块：b复用为第一个块，其余内容放入新块并接在b之后
+static bool block_thaw(String s, Block *b)
 {
-    if (!s || pos + len > s->length)
+    Frame *f = block_frame(b);
+    char raw[FRAME_RAW_MAX];
+    if (lz_decompress(f->payload, f->comp_len, raw, sizeof(raw)) != f->raw_len)
         return false;
 
-    Block *current = s->head;
-    Block *prev = NULL;
-    size_t block_start = 0;
-    // 定位到目标块
-    while (current && block_start + current->size <= pos)
+    Block *first_extra = NULL, *last = b;
+    for (size_t off = BLOCK_SIZE; off < f->raw_len; off += BLOCK_SIZE)
     {
-        block_start += current->size;
-        prev = current;
-        current = current->next;
+        Block *extra = block_create(s);
+        if (!extra)
+        {
+            block_destroy_all(s, first_extra);
+            return false;
+        }
+        extra->size = (unsigned char)(f->raw_len - off < BLOCK_SIZE ? f->raw_len - off : BLOCK_SIZE);
+        memcpy(extra->data, raw + off, extra->size);
+        if (last == b)
+            first_extra = extra;
+        else
+            last->next = extra;
+        last = extra;
     }
 
-    if (!current)
+    if (last != b)
+        last->next = b->next;
+    else
+        first_extra = b->next;
+    b->next = first_extra;
+    b->size = (unsigned char)(f->raw_len < BLOCK_SIZE ? f->raw_len : BLOCK_SIZE);
+    memcpy(b->data, raw, b->size);
+    if (s->tail == b)
+        s->tail = last;
+    free(f);
+    if (last != b)
+        index_invalidate(s);
+    return true;
+}
+
+// 读写块数据前调用，压缩块先解压
+static bool block_ready(String s, Block *b)
+{
+    return b->size != BLOCK_FROZEN || block_thaw(s, b);
+}
+
+static bool block_is_hot(const String s, const Block *b)
+{
+    const ColdState *c = s->cold;
+    if (!c)
         return false;
+    for (size_t i = 0; i < HOT_SLOTS; i++)
+    {
+        if (c->hot[i] == b && c->clock - c->stamp[i] < c->threshold)
+            return true;
+    }
+    return false;
+}
 
-    size_t to_delete = len;
-    size_t block_pos = pos - block_start;
-    while (current && to_delete > 0)
+static void cold_touch(String s, Block *b)
+{
+    ColdState *c = s->cold;
+    if (!c)
+        return;
+    for (size_t i = 0; i < HOT_SLOTS; i++)
     {
-        size_t can_delete = current->size - block_pos;
-        // 块内删除
-        if (can_delete > to_delete)
+        if (c->hot[i] == b)
         {
+            c->stamp[i] = c->clock;
+            return;
+        }
+    }
+    c->hot[c->next_slot] = b;
+    c->stamp[c->next_slot] = c->clock;
+    c->next_slot = (c->next_slot + 1) % HOT_SLOTS;
+}
+
+static size_t cold_compact(String s)
+{
+    size_t frames = 0;
+    // 最近一个周期内追加的块从fresh处开始，尾块也在其中
+    size_t fresh = s->length;
+    if (s->cold)
+        fresh = s->cold->appended < s->length ? s->length - s->cold->appended : 0;
+    size_t pos = 0;
+    Block *b = s->head;
+    while (b)
+    {
+        // 收集一段连续的冷块，尾块始终保持解压状态以便追加
+        Block *run = b;
+        size_t count = 0;
+        while (b && b != s->tail && b->size != BLOCK_FROZEN && !block_is_hot(s, b) &&
+               pos + b->size <= fresh && count < FRAME_MAX_BLOCKS)
+        {
+            pos += b->size;
+            count++;
+            b = b->next;
+        }
+        if (count >= FRAME_MIN_BLOCKS && freeze_run(s, run, count))
+        {
+            index_invalidate(s);
+            frames++;
+        }
+        if (count == 0)
+        {
+            pos += block_span(b);
+            b = b->next;
+        }
+    }
+    return frames;
+}
+
+// 每个公开操作开始时调用，满N次操作压缩一次冷区间
+static void cold_tick(String s)
+{
+    ColdState *c = s->cold;
+    if (c && ++c->clock % c->threshold == 0)
+    {
+        cold_compact(s);
+        c->appended = 0;
+    }
+}
+
+// 定位pos所在的块(必要时解压)，block_start返回块起始位置，prev可为NULL
+static Block *locate(String s, size_t pos, size_t *block_start, Block **prev)
+{
+    Block *current = s->head;
+    Block *before = NULL;
+    size_t start = 0;
+    BlockIndex *ix = s->index;
+    if (ix && ix->valid && ix->count > 0)
+    {
+        // 有索引时O(log n)定位
+        size_t k = fen_search(ix->tree[IDX_BYTES], ix->count, pos, &start);
+        if (k >= ix->count)
+        {
+            k = ix->count - 1;
+            start = fen_prefix(ix->tree[IDX_BYTES], k);
+        }
+        current = ix->blocks[k];
+        before = k > 0 ? ix->blocks[k - 1] : NULL;
+    }
+    while (current)
+    {
+        if (start + block_span(current) > pos)
+        {
+            if (current->size == BLOCK_FROZEN)
+            {
+                if (!block_thaw(s, current))
+                    return NULL;
+                continue; // 解压后重新判断目标是否在第一个块中
+            }
+            break;
+        }
+        start += block_span(current);
+        before = current;
+        current = current->next;
+    }
+    if (current)
+        cold_touch(s, current);
+    *block_start = start;
+    if (prev)
+        *prev = before;
+    return current;
+}
+
+// 将len个字节追加到尾块，尾块写满后再分配新块
+static bool append_bytes(String s, const char *data, size_t len)
+{
+    if (len > 0 && s->tail && !block_ready(s, s->tail))
+        return false;
+    while (len > 0)
+    {
+        bool new_block = false;
+        if (!s->tail || s->tail->size == BLOCK_SIZE)
+        {
+            Block *b = block_create(s);
+            if (!b)
+                return false;
+            if (s->tail)
+                s->tail->next = b;
+            else
+                s->head = b;
+            s->tail = b;
+            new_block = true;
+        }
+        size_t room = BLOCK_SIZE - s->tail->size;
+        size_t n = len < room ? len : room;
+        memcpy(s->tail->data + s->tail->size, data, n);
+        s->tail->size += n;
+        s->length += n;
+        index_append(s, new_block, data, n);
+        if (s->cold)
+            s->cold->appended += n;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+//-----Lifecycle Management------
+
+String str_create(void)
+{
+    String str = (String)malloc(sizeof(struct String));
+
+    if (!str)
+        return NULL;
+
+    str->head = str->tail = NULL;
+    str->length = 0;
+    str->cold = NULL;
+    str->index = NULL;
+    str->pool = NULL;
+
+    return str;
+}
+
+String str_create_from(const char *cstr)
+{
+    if (!cstr)
+        return NULL;
+    String s = str_create();
+    if (!s)
+        return NULL;
+    if (!append_bytes(s, cstr, strlen(cstr)))
+    {
+        str_destroy(&s);
+        return NULL;
+    }
+
+    return s;
+}
+
+void str_destroy(String *s)
+{
+    if (!s || !*s)
+        return;
+    block_destroy_all(*s, (*s)->head);
+    free((*s)->cold);
+    index_free((*s)->index);
+    pool_free((*s)->pool);
+    free(*s);
+    *s = NULL;
+}
+
+//-----Basic Properties-----
+
+size_t str_length(const String s)
+{
+    return s ? s->length : 0;
+}
+
+bool str_empty(const String s)
+{
+    return str_length(s) ? false : true;
+}
+
+//-----Access-----
+
+char str_at(const String s, size_t index)
+{
+    if (!s || index >= s->length)
+    {
+        return '\0';
+    }
+
+    cold_tick(s);
+    size_t block_start;
+    Block *current = locate(s, index, &block_start, NULL);
+    return current ? current->data[index - block_start] : '\0';
+}
+
+//-----Modification Operations-----
+
+void str_clear(String s)
+{
+    if (!s)
+        return;
+
+    block_destroy_all(s, s->head);
+    s->length = 0;
+    s->head = s->tail = NULL;
+    index_invalidate(s);
+}
+
+bool str_push_back(String s, char c)
+{
+    if (!s)
+        return false;
+
+    cold_tick(s);
+    if (s->tail && !block_ready(s, s->tail))
+        return false;
+    bool grew = false;
+    if (!s->tail || s->tail->size == BLOCK_SIZE)
+    {
+        Block *new_block = block_create(s);
+        if (new_block)
+        {
+            grew = true;
+            if (s->head)
+            {
+                s->tail->next = new_block;
+                s->tail = new_block;
+            }
+            else
+            {
+                s->head = s->tail = new_block;
+            }
+            // new_block->next = NULL;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    s->tail->data[s->tail->size++] = c;
+    s->length++;
+    index_append(s, grew, &c, 1);
+    if (s->cold)
+        s->cold->appended++;
+    // s->tail->next = NULL;
+    return true;
+}
+
+bool str_append_str(String s, const String other)
+{
+    if (!s || !other)
+        return false;
+
+    cold_tick(s);
+    size_t remaining = other->length; // 自身追加时只复制原有内容
+    for (Block *curr = other->head; curr && remaining > 0; curr = curr->next)
+    {
+        if (!block_ready(other, curr))
+            return false;
+        size_t n = curr->size < remaining ? curr->size : remaining;
+        if (!append_bytes(s, curr->data, n))
+            return false;
+        remaining -= n;
+    }
+    return true;
+}
+
+bool str_insert(String s, size_t pos, const String t)
+{
+    if (!s || !t || pos > s->length)
+        return false;
+
+    String temp = str_create();
+    if (!temp)
+        return false;
+
+    // 复制前半部分
+    for (size_t i = 0; i < pos; i++)
+    {
+        str_push_back(temp, str_at(s, i));
+    }
+
+    // 插入t
+    str_append_str(temp, t);
+
+    // 复制后半部分
+    for (size_t i = pos; i < s->length; i++)
+    {
+        str_push_back(temp, str_at(s, i));
+    }
+
+    str_clear(s);
+    str_append_str(s, temp);
+    str_destroy(&temp);
+
+    return true;
+}
+
+bool str_insert_char(String s, size_t pos, char c)
+{
+    if (!s || pos > s->length)
+    {
+        return false;
+    }
+
+    if (pos == s->length)
+    {
+        return str_push_back(s, c);
+    }
+
+    cold_tick(s);
+    // 定位到目标块
+    size_t block_start;
+    Block *current = locate(s, pos, &block_start, NULL);
+    if (!current)
+        return false;
+
+    size_t block_pos = pos - block_start;
+
+    // 块满了，先折半分裂，分裂点不落在UTF-8多字节序列中间
+    if (current->size == BLOCK_SIZE)
+    {
+        unsigned char old_size = current->size;
+        unsigned char split = old_size / 2;
+        while (split > 1 && ((unsigned char)current->data[split] & 0xC0) == 0x80)
+            split--;
+        while (split < old_size - 1 && ((unsigned char)current->data[split] & 0xC0) == 0x80)
+            split++;
+        Block *new_block = block_create(s);
+        if (!new_block)
+            return false;
+        current->size = split;
+        new_block->size = old_size - current->size;
+        new_block->next = current->next;
+        current->next = new_block;
+        if (s->tail == current)
+            s->tail = new_block;
+
+        // 复制旧块后半块给新块
+        for (int i = 0; i < new_block->size; i++)
+            new_block->data[i] = current->data[current->size + i];
+        index_splice(s, block_start, 1, current, 2);
+
+        // 在分裂后的某一半中插入
+        if (block_pos > current->size)
+        {
+            block_pos -= current->size;
+            block_start += current->size;
+            current = new_block;
+        }
+    }
+
+    // 块内后移字符
+    for (size_t i = current->size; i > block_pos; i--)
+    {
+        current->data[i] = current->data[i - 1];
+    }
+    current->data[block_pos] = c;
+    current->size++;
+    s->length++;
+    index_adjust(s, block_start, &c, 1, 1);
+    return true;
+}
+
+// Deletes 'len' characters from position 'pos' in the string 's'.
+// Returns true if deletion is successful, false otherwise.
+bool str_delete(String s, size_t pos, size_t len)
+{
+    if (!s || pos + len > s->length)
+        return false;
+
+    cold_tick(s);
+    Block *prev;
+    size_t block_start;
+    // 定位到目标块
+    Block *current = locate(s, pos, &block_start, &prev);
+    if (!current)
+        return false;
+
+    size_t to_delete = len;
+    size_t block_pos = pos - block_start;
+    Block *before_run = prev;
+    size_t visited = 0, kept = 0; // 经过的块数和其中保留下来的块数，用于拼接索引
+    bool adjusted = false;
+    while (current && to_delete > 0)
+    {
+        if (!block_ready(s, current))
+        {
+            index_invalidate(s);
+            return false;
+        }
+        size_t can_delete = current->size - block_pos;
+        visited++;
+        // 块内删除
+        if (can_delete > to_delete)
+        {
+            if (to_delete == len)
+            {
+                index_adjust(s, block_start, current->data + block_pos, to_delete, -1); // 块链结构未变
+                adjusted = true;
+            }
+            kept++;
             for (size_t i = block_pos; i < current->size - to_delete; i++)
             {
                 current->data[i] = current->data[i + to_delete];
@@ -331,7 +1127,7 @@ bool str_delete(String s, size_t pos, size_t len)
                 {
                     s->head = current;
                 }
-                free(temp);
+                block_release(s, temp);
             }
             // 删除当前块中，pos后全部字符
             else
@@ -340,186 +1136,2623 @@ bool str_delete(String s, size_t pos, size_t len)
                 prev = current;
                 current = current->next;
                 block_pos = 0;
+                kept++;
             }
             s->length -= can_delete;
             to_delete -= can_delete;
         }
     }
+    if (visited > 0 && !adjusted)
+        index_splice(s, block_start, visited, before_run ? before_run->next : s->head, kept);
+
+    // 删到了末尾时，最后保留的块成为尾块
+    if (!current)
+    {
+        s->tail = prev;
+        if (s->tail)
+            block_ready(s, s->tail); // 尾块需保持解压状态
+    }
+
+    return true;
+}
+
+//-----Batched Edits-----
+
+typedef struct
+{
+    size_t pos;
+    bool deletes;
+    size_t index;
+} EditOrder;
+
+// 按位置排序；同一位置上纯插入排在删除之前，其余保持数组顺序
+static int compare_edit_order(const void *a, const void *b)
+{
+    const EditOrder *e1 = (const EditOrder *)a;
+    const EditOrder *e2 = (const EditOrder *)b;
+    if (e1->pos != e2->pos)
+        return e1->pos < e2->pos ? -1 : 1;
+    if (e1->deletes != e2->deletes)
+        return e1->deletes ? 1 : -1;
+    return e1->index < e2->index ? -1 : (e1->index > e2->index);
+}
+
+// 从s的(*block, *offset)处拷贝count个字符到out，并前移游标
+static bool copy_run(String s, String out, Block **block, size_t *offset, size_t count)
+{
+    while (count > 0)
+    {
+        if (!block_ready(s, *block))
+            return false;
+        size_t avail = (*block)->size - *offset;
+        size_t n = count < avail ? count : avail;
+        if (!append_bytes(out, (*block)->data + *offset, n))
+            return false;
+        *offset += n;
+        count -= n;
+        if (*offset == (*block)->size)
+        {
+            *block = (*block)->next;
+            *offset = 0;
+        }
+    }
+    return true;
+}
+
+// 跳过count个字符，整段跳过的压缩块无需解压
+static bool skip_run(String s, Block **block, size_t *offset, size_t count)
+{
+    while (count > 0)
+    {
+        if (*offset == 0 && block_span(*block) <= count)
+        {
+            count -= block_span(*block);
+            *block = (*block)->next;
+            continue;
+        }
+        if (!block_ready(s, *block))
+            return false;
+        size_t avail = (*block)->size - *offset;
+        size_t n = count < avail ? count : avail;
+        *offset += n;
+        count -= n;
+        if (*offset == (*block)->size)
+        {
+            *block = (*block)->next;
+            *offset = 0;
+        }
+    }
+    return true;
+}
+
+static bool build_edited_chain(String s, const StrEdit *edits, const EditOrder *order,
+                               size_t n, size_t *new_pos, String out)
+{
+    Block *block = s->head;
+    size_t offset = 0;
+    size_t read_pos = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const StrEdit *e = &edits[order[i].index];
+        if (!copy_run(s, out, &block, &offset, e->pos - read_pos))
+            return false;
+        if (new_pos)
+            new_pos[order[i].index] = out->length;
+        if (!append_bytes(out, e->insert_text, e->insert_len))
+            return false;
+        if (!skip_run(s, &block, &offset, e->delete_len))
+            return false;
+        read_pos = e->pos + e->delete_len;
+    }
+    return copy_run(s, out, &block, &offset, s->length - read_pos);
+}
+
+StrError str_apply_edits(String s, const StrEdit *edits, size_t n, size_t *new_pos)
+{
+    /*
+    time complexity: O(n + k log k + m), m = total inserted length
+    space complexity: O(k) besides the rebuilt block chain
+    */
+    if (!s || (n > 0 && !edits))
+        return STR_INVALID_PARAM;
+    if (n == 0)
+        return STR_OK;
+
+    cold_tick(s);
+    for (size_t i = 0; i < n; i++)
+    {
+        if (edits[i].pos > s->length || edits[i].delete_len > s->length - edits[i].pos)
+            return STR_OUT_OF_RANGE;
+        if (edits[i].insert_len > 0 && !edits[i].insert_text)
+            return STR_INVALID_PARAM;
+    }
+
+    EditOrder *order = (EditOrder *)malloc(sizeof(EditOrder) * n);
+    if (!order)
+        return STR_ALLOC_FAILED;
+    for (size_t i = 0; i < n; i++)
+    {
+        order[i].pos = edits[i].pos;
+        order[i].deletes = edits[i].delete_len > 0;
+        order[i].index = i;
+    }
+    qsort(order, n, sizeof(EditOrder), compare_edit_order);
+
+    // 相邻编辑不得重叠：前一个删除区间必须在后一个起点之前结束
+    for (size_t i = 1; i < n; i++)
+    {
+        const StrEdit *prev = &edits[order[i - 1].index];
+        if (prev->pos + prev->delete_len > order[i].pos)
+        {
+            free(order);
+            return STR_INVALID_PARAM;
+        }
+    }
+
+    // 单次遍历原块链，构建新块链
+    struct String out = {0};
+    out.pool = s->pool; // 新块链优先使用预留块
+    bool ok = build_edited_chain(s, edits, order, n, new_pos, &out);
+    free(order);
+    if (!ok)
+    {
+        block_destroy_all(&out, out.head);
+        out.pool = NULL;
+        return STR_ALLOC_FAILED;
+    }
+
+    out.pool = NULL;
+    block_destroy_all(s, s->head);
+    s->head = out.head;
+    s->tail = out.tail;
+    s->length = out.length;
+    index_invalidate(s);
+    return STR_OK;
+}
+
+//-----Cold Storage-----
+
+bool str_set_cold_threshold(String s, size_t ops)
+{
+    if (!s)
+        return false;
+    if (ops == 0)
+    {
+        free(s->cold);
+        s->cold = NULL;
+        return true;
+    }
+    if (!s->cold)
+    {
+        s->cold = (ColdState *)calloc(1, sizeof(ColdState));
+        if (!s->cold)
+            return false;
+    }
+    s->cold->threshold = ops;
+    return true;
+}
+
+size_t str_compact(String s)
+{
+    return s ? cold_compact(s) : 0;
+}
+
+size_t str_memory_usage(const String s)
+{
+    if (!s)
+        return 0;
+    size_t bytes = sizeof(struct String) + (s->cold ? sizeof(ColdState) : 0);
+    for (Block *b = s->head; b; b = b->next)
+    {
+        if (!pool_owns(s->pool, b))
+            bytes += sizeof(Block); // 预分配的块在下面整段计入
+        if (b->size == BLOCK_FROZEN)
+            bytes += sizeof(Frame) + block_frame(b)->comp_len;
+    }
+    if (s->pool)
+    {
+        bytes += sizeof(BlockPool);
+        for (size_t i = 0; i < s->pool->run_count; i++)
+            bytes += s->pool->run_sizes[i] * sizeof(Block);
+    }
+    return bytes;
+}
+
+//-----Reserve and Builder-----
+
+bool str_reserve(String s, size_t n)
+{
+    /*
+    time complexity: O(runs) besides the allocation
+    */
+    if (!s)
+        return false;
+    size_t capacity = str_capacity(s);
+    if (n <= capacity)
+        return true;
+    size_t count = (n - capacity + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    if (!s->pool)
+    {
+        s->pool = (BlockPool *)calloc(1, sizeof(BlockPool));
+        if (!s->pool)
+            return false;
+    }
+    BlockPool *pool = s->pool;
+    if (pool->run_count == pool->run_capacity)
+    {
+        size_t cap = pool->run_capacity ? pool->run_capacity * 2 : 4;
+        Block **runs = (Block **)realloc(pool->runs, sizeof(Block *) * cap);
+        if (!runs)
+            return false;
+        pool->runs = runs;
+        size_t *sizes = (size_t *)realloc(pool->run_sizes, sizeof(size_t) * cap);
+        if (!sizes)
+            return false;
+        pool->run_sizes = sizes;
+        pool->run_capacity = cap;
+    }
+    // 整段一次分配
+    Block *run = (Block *)malloc(sizeof(Block) * count);
+    if (!run)
+        return false;
+
+    // 按地址有序插入，供pool_owns二分查找
+    size_t at = pool->run_count;
+    while (at > 0 && pool->runs[at - 1] > run)
+    {
+        pool->runs[at] = pool->runs[at - 1];
+        pool->run_sizes[at] = pool->run_sizes[at - 1];
+        at--;
+    }
+    pool->runs[at] = run;
+    pool->run_sizes[at] = count;
+    pool->run_count++;
+
+    // 逆序压入，使块按地址顺序取出
+    for (size_t i = count; i > 0; i--)
+    {
+        run[i - 1].next = pool->spare;
+        pool->spare = &run[i - 1];
+    }
+    pool->spare_count += count;
+    return true;
+}
+
+size_t str_capacity(const String s)
+{
+    if (!s)
+        return 0;
+    size_t room = s->tail && s->tail->size != BLOCK_FROZEN ? BLOCK_SIZE - s->tail->size : 0;
+    size_t spare = s->pool ? s->pool->spare_count : 0;
+    return s->length + room + spare * BLOCK_SIZE;
+}
+
+struct StrBuilder
+{
+    String str;
+};
+
+StrBuilder str_builder_create(size_t reserve)
+{
+    StrBuilder b = (StrBuilder)malloc(sizeof(struct StrBuilder));
+    if (!b)
+        return NULL;
+    b->str = str_create();
+    if (!b->str || !str_reserve(b->str, reserve))
+    {
+        str_destroy(&b->str);
+        free(b);
+        return NULL;
+    }
+    return b;
+}
+
+void str_builder_destroy(StrBuilder *b)
+{
+    if (!b || !*b)
+        return;
+    str_destroy(&(*b)->str);
+    free(*b);
+    *b = NULL;
+}
+
+size_t str_builder_length(const StrBuilder b)
+{
+    return b ? b->str->length : 0;
+}
+
+bool str_builder_append(StrBuilder b, const char *data, size_t len)
+{
+    if (!b || (!data && len > 0))
+        return false;
+    return append_bytes(b->str, data, len);
+}
+
+bool str_builder_append_char(StrBuilder b, char c)
+{
+    return b && append_bytes(b->str, &c, 1);
+}
+
+int str_builder_append_fmt(StrBuilder b, const char *fmt, ...)
+{
+    if (!b || !fmt)
+        return -1;
+    String s = b->str;
+    if (s->tail && !block_ready(s, s->tail))
+        return -1;
+
+    // 先尝试直接写入尾块剩余空间(需多留1字节给结尾的'\0')
+    char *dst = NULL;
+    size_t room = 0;
+    if (s->tail && s->tail->size < BLOCK_SIZE)
+    {
+        dst = s->tail->data + s->tail->size;
+        room = BLOCK_SIZE - s->tail->size;
+    }
+    char small[256];
+    if (!dst)
+    {
+        dst = small;
+        room = sizeof(small);
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(dst, room, fmt, args);
+    va_end(args);
+    if (n < 0)
+        return -1;
+    if ((size_t)n < room && dst != small)
+    {
+        // 写入成功，只需登记长度
+        s->tail->size += (unsigned char)n;
+        s->length += (size_t)n;
+        index_append(s, false, dst, (size_t)n);
+        return n;
+    }
+
+    // 放不下时格式化到临时缓冲区再追加
+    char *buf = (size_t)n < sizeof(small) ? small : (char *)malloc((size_t)n + 1);
+    if (!buf)
+        return -1;
+    if (buf != dst)
+    {
+        va_start(args, fmt);
+        vsnprintf(buf, (size_t)n + 1, fmt, args);
+        va_end(args);
+    }
+    bool ok = append_bytes(s, buf, (size_t)n);
+    if (buf != small)
+        free(buf);
+    return ok ? n : -1;
+}
+
+String str_builder_finish(StrBuilder *b)
+{
+    if (!b || !*b)
+        return NULL;
+    String s = (*b)->str;
+    free(*b);
+    *b = NULL;
+    return s;
+}
+
+//-----Cursor-----
+
+bool str_cursor_init(StrCursor *cur, String s, size_t pos)
+{
+    if (!cur || !s || pos > s->length)
+        return false;
+    cur->str = s;
+    cur->pos = pos;
+    cur->block = NULL;
+    cur->offset = 0;
+    if (pos == s->length)
+        return true;
+    size_t block_start;
+    cur->block = locate(s, pos, &block_start, NULL);
+    cur->offset = pos - block_start;
+    return cur->block != NULL;
+}
+
+size_t str_cursor_pos(const StrCursor *cur)
+{
+    return cur ? cur->pos : 0;
+}
+
+const char *str_cursor_chunk(StrCursor *cur, size_t *len)
+{
+    *len = 0;
+    if (!cur)
+        return NULL;
+    while (cur->block)
+    {
+        if (!block_ready(cur->str, cur->block))
+        {
+            cur->block = NULL;
+            return NULL;
+        }
+        if (cur->offset < cur->block->size)
+        {
+            *len = cur->block->size - cur->offset;
+            return cur->block->data + cur->offset;
+        }
+        cur->block = cur->block->next;
+        cur->offset = 0;
+    }
+    return NULL;
+}
+
+void str_cursor_advance(StrCursor *cur, size_t n)
+{
+    size_t len;
+    while (n > 0 && str_cursor_chunk(cur, &len))
+    {
+        size_t step = n < len ? n : len;
+        cur->offset += step;
+        cur->pos += step;
+        n -= step;
+    }
+}
+
+int str_cursor_next(StrCursor *cur)
+{
+    size_t len;
+    const char *p = str_cursor_chunk(cur, &len);
+    if (!p)
+        return -1;
+    cur->offset++;
+    cur->pos++;
+    return (unsigned char)*p;
+}
+
+//-----String Operations-----
+bool str_concat(String result, const String s1, const String s2)
+{
+    if (!result || !s1 || !s2)
+        return false;
+
+    str_clear(result);
+    if (!str_append_str(result, s1))
+        return false;
+    if (!str_append_str(result, s2))
+        return false;
+
+    return true;
+}
+
+bool str_substring(String sub, const String s, size_t pos, size_t len)
+{
+    if (!sub || !s || pos >= s->length)
+        return false;
+
+    if (pos + len > s->length)
+    {
+        len = s->length - pos; // 自动调整
+    }
+
+    str_clear(sub);
+    for (size_t i = 0; i < len; i++)
+    {
+        str_push_back(sub, str_at(s, pos + i));
+    }
+    return true;
+}
+
+static int *prefix_function(const String pattern)
+{
+    /*
+    time complexity: O(m)
+    space complexity: O(m)
+    */
+    int m = str_length(pattern);
+    int *next = (int *)malloc(sizeof(int) * m);
+    if (!next)
+        return NULL;
+    next[0] = 0;
+    for (int i = 1; i < m; i++)
+    {
+        int j = next[i - 1];
+        while (j > 0 && str_at(pattern, i) != str_at(pattern, j))
+            j = next[j - 1];
+        if (str_at(pattern, i) == str_at(pattern, j))
+            j++;
+        next[i] = j;
+    }
+    return next;
+}
+
+int *str_find_all(const String s, const String pattern, size_t start_pos)
+{
+    /*
+    time complexity: O(n+m+k)
+    space complexity: O(n+m+k)
+    */
+    if (!s || !pattern || start_pos >= str_length(s))
+        return NULL;
+
+    String cur = str_create();
+    if (!cur)
+        return NULL;
+
+    size_t n = str_length(s);
+    size_t m = str_length(pattern);
+    str_append_str(cur, pattern);      // O(m)
+    str_push_back(cur, '#');           // O(1)
+    str_append_str(cur, s);            // O(n)
+    str_delete(cur, m + 1, start_pos); // 删除前start_pos个字符 O(n)
+    int *next = prefix_function(cur);  // O(n+m)
+    if (!next)
+        return NULL;
+    int *positions = (int *)malloc(sizeof(int) * (n + 1)); // 最多n个匹配位置
+    if (!positions)
+    {
+        free(next);
+        return NULL;
+    }
+    int count = 1;
+    for (size_t i = m + 1; i < str_length(cur); i++)
+    { // O(n)
+        if ((size_t)next[i] == m)
+        {
+            positions[count++] = i - 2 * m + start_pos;
+        }
+    }
+    positions[0] = count - 1; // 记录匹配数量
+    free(next);
+    str_destroy(&cur);
+    return positions;
+}
+
+int str_find_first(const String s, const String pattern, size_t start_pos)
+{
+    if (!s || !pattern || start_pos >= str_length(s))
+        return -1;
+    int *positions = str_find_all(s, pattern, start_pos);
+    if (!positions)
+        return -1;
+    int count = positions[0];
+    if (count == 0)
+    {
+        free(positions);
+        return -1;
+    }
+    int first_pos = positions[1];
+    free(positions);
+    return first_pos;
+}
+
+int str_find_char(const String s, char c, size_t start_pos)
+{
+    if (!s || start_pos >= str_length(s))
+        return -1;
+    StrCursor cur;
+    str_cursor_init(&cur, s, start_pos);
+    const char *p;
+    size_t len;
+    while ((p = str_cursor_chunk(&cur, &len)) != NULL)
+    {
+        const char *hit = (const char *)memchr(p, c, len);
+        if (hit)
+            return (int)(cur.pos + (size_t)(hit - p));
+        str_cursor_advance(&cur, len);
+    }
+    return -1;
+}
+
+bool str_replace_first(String s, const String old_str, const String new_str)
+{
+    if (!s || !old_str || !new_str)
+        return false;
+    int pos = str_find_first(s, old_str, 0);
+    if (pos == -1)
+        return false;
+    size_t old_len = str_length(old_str);
+    str_delete(s, pos, old_len);
+    str_insert(s, pos, new_str);
+    return true;
+}
+
+int str_replace_all(String s, const String old_str, const String new_str)
+{
+    if (!s || !old_str || !new_str)
+        return -1;
+    int *pos = str_find_all(s, old_str, 0);
+    if (!pos || pos[0] == 0)
+    {
+        free(pos);
+        return -1;
+    }
+    size_t old_len = str_length(old_str);
+    size_t new_len = str_length(new_str);
+    char *text = (char *)malloc(new_len + 1);
+    StrEdit *edits = (StrEdit *)malloc(sizeof(StrEdit) * pos[0]);
+    if (!text || !edits)
+    {
+        free(text);
+        free(edits);
+        free(pos);
+        return -1;
+    }
+    size_t copied = 0;
+    for (Block *b = new_str->head; b && block_ready(new_str, b); b = b->next)
+    {
+        memcpy(text + copied, b->data, b->size);
+        copied += b->size;
+    }
+    if (copied != new_len)
+    {
+        // 解压失败，不做替换
+        free(text);
+        free(edits);
+        free(pos);
+        return -1;
+    }
+
+    // 匹配位置可能重叠，从左到右只保留互不重叠的匹配
+    int count = 0;
+    size_t next_free = 0;
+    for (int i = 1; i <= pos[0]; i++)
+    {
+        if ((size_t)pos[i] < next_free)
+            continue;
+        edits[count].pos = pos[i];
+        edits[count].delete_len = old_len;
+        edits[count].insert_text = text;
+        edits[count].insert_len = new_len;
+        count++;
+        next_free = pos[i] + old_len;
+    }
+
+    StrError err = str_apply_edits(s, edits, count, NULL);
+    free(text);
+    free(edits);
+    free(pos);
+    return err == STR_OK ? count : -1;
+}
+
+//-----Split and Tokenize-----
+// 在[p, p+n)中找第一个分隔符，table为NULL时只有delim一个分隔符
+static const char *find_delim(const char *p, size_t n, char delim, const bool *table)
+{
+    if (!table)
+        return (const char *)memchr(p, delim, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        if (table[(unsigned char)p[i]])
+            return p + i;
+    }
+    return NULL;
+}
+
+static size_t split_views(String s, char delim, const bool *table, bool skip_empty, StrViewCallback cb, void *ctx)
+{
+    /*
+    time complexity: O(n)
+    space complexity: O(1)
+    */
+    size_t count = 0;
+    size_t pos = 0;
+    bool open = false; // 当前字段是否已开始
+    StrView view = {NULL, 0, 0, 0};
+    for (Block *b = s->head; b; b = b->next)
+    {
+        if (!block_ready(s, b))
+            return count;
+        size_t off = 0;
+        while (off < b->size)
+        {
+            if (!open)
+            {
+                view.block = b;
+                view.offset = off;
+                view.length = 0;
+                view.pos = pos + off;
+                open = true;
+            }
+            const char *hit = find_delim(b->data + off, b->size - off, delim, table);
+            size_t stop = hit ? (size_t)(hit - b->data) : b->size;
+            view.length += stop - off;
+            off = stop;
+            if (hit)
+            {
+                off++;
+                open = false;
+                if (skip_empty && view.length == 0)
+                    continue;
+                count++;
+                if (!cb(&view, ctx))
+                    return count;
+            }
+        }
+        pos += b->size;
+    }
+    // 最后一个字段(分隔符结尾时为空)
+    if (!open)
+    {
+        view.block = NULL;
+        view.offset = 0;
+        view.length = 0;
+        view.pos = s->length;
+    }
+    if (!skip_empty || view.length > 0)
+    {
+        count++;
+        cb(&view, ctx);
+    }
+    return count;
+}
+
+size_t str_split(String s, char delim, StrViewCallback cb, void *ctx)
+{
+    if (!s || !cb)
+        return 0;
+    return split_views(s, delim, NULL, false, cb, ctx);
+}
+
+size_t str_tokenize(String s, const char *delims, StrViewCallback cb, void *ctx)
+{
+    if (!s || !delims || !cb)
+        return 0;
+    if (delims[0] != '\0' && delims[1] == '\0')
+        return split_views(s, delims[0], NULL, true, cb, ctx); // 单个分隔符走memchr
+    bool table[256] = {false};
+    for (const char *d = delims; *d; d++)
+        table[(unsigned char)*d] = true;
+    return split_views(s, '\0', table, true, cb, ctx);
+}
+
+size_t str_view_copy(const StrView *view, char *buf, size_t cap)
+{
+    if (!view || !buf || cap == 0)
+        return 0;
+    size_t want = view->length < cap - 1 ? view->length : cap - 1;
+    size_t done = 0;
+    const Block *b = view->block;
+    size_t off = view->offset;
+    while (b && done < want)
+    {
+        size_t step = b->size - off;
+        if (step > want - done)
+            step = want - done;
+        memcpy(buf + done, b->data + off, step);
+        done += step;
+        b = b->next;
+        off = 0;
+    }
+    buf[done] = '\0';
+    return done;
+}
+
+bool str_view_equals(const StrView *view, const char *text, size_t len)
+{
+    if (!view || !text || view->length != len)
+        return false;
+    size_t done = 0;
+    const Block *b = view->block;
+    size_t off = view->offset;
+    while (b && done < len)
+    {
+        size_t step = b->size - off;
+        if (step > len - done)
+            step = len - done;
+        if (memcmp(text + done, b->data + off, step) != 0)
+            return false;
+        done += step;
+        b = b->next;
+        off = 0;
+    }
+    return done == len;
+}
+
+//-----Transforms-----
+
+// 把[p, p+n)中落在[lo, lo+26)的ASCII字母翻转大小写，其余字节不变
+static void ascii_flip_case(char *p, size_t n, char lo)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    if (n >= 16)
+    {
+        const __m128i below = _mm_set1_epi8((char)(lo - 1));
+        const __m128i above = _mm_set1_epi8((char)(lo + 26));
+        const __m128i flip = _mm_set1_epi8(0x20);
+        for (;; i += 16)
+        {
+            // 最后一组与前一组重叠：已转换的字母不在范围内，重复处理无影响
+            if (i + 16 > n)
+                i = n - 16;
+            __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+            __m128i hit = _mm_and_si128(_mm_cmpgt_epi8(v, below), _mm_cmplt_epi8(v, above));
+            _mm_storeu_si128((__m128i *)(p + i), _mm_xor_si128(v, _mm_and_si128(hit, flip)));
+            if (i + 16 == n)
+                return;
+        }
+    }
+#else
+    // SWAR：每字节低7位加偏移，最高位给出比较结果
+    const uint64_t ones = 0x0101010101010101ull;
+    const uint64_t high = 0x8080808080808080ull;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, p + i, 8);
+        uint64_t low7 = word & ~high;
+        uint64_t ge_first = low7 + (uint64_t)(0x80 - lo) * ones;
+        uint64_t ge_after = low7 + (uint64_t)(0x80 - lo - 26) * ones;
+        word ^= (ge_first & ~ge_after & ~word & high) >> 2;
+        memcpy(p + i, &word, 8);
+    }
+#endif
+    for (; i < n; i++)
+    {
+        if ((unsigned char)(p[i] - lo) < 26)
+            p[i] ^= 0x20;
+    }
+}
+
+static bool str_flip_case(String s, char lo)
+{
+    if (!s)
+        return false;
+    cold_tick(s);
+    for (Block *b = s->head; b; b = b->next)
+    {
+        if (!block_ready(s, b))
+            return false;
+        ascii_flip_case(b->data, b->size, lo); // 只改ASCII字母，索引计数不变
+    }
+    return true;
+}
+
+bool str_to_upper(String s)
+{
+    return str_flip_case(s, 'a');
+}
+
+bool str_to_lower(String s)
+{
+    return str_flip_case(s, 'A');
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+bool str_trim(String s)
+{
+    if (!s)
+        return false;
+    size_t begin = STR_NPOS, end = 0;
+    StrCursor cur;
+    str_cursor_init(&cur, s, 0);
+    const char *p;
+    size_t len;
+    while ((p = str_cursor_chunk(&cur, &len)) != NULL)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            if (!is_space(p[i]))
+            {
+                if (begin == STR_NPOS)
+                    begin = cur.pos + i;
+                end = cur.pos + i + 1;
+            }
+        }
+        str_cursor_advance(&cur, len);
+    }
+    if (begin == STR_NPOS)
+    {
+        str_clear(s);
+        return true;
+    }
+    // 先删尾部，头部删除不影响尾部位置；长度为0的一侧不删
+    if (end < s->length && !str_delete(s, end, s->length - end))
+        return false;
+    return begin == 0 || str_delete(s, 0, begin);
+}
+
+bool str_translate(String s, const unsigned char *table)
+{
+    /*
+    time complexity: O(n)
+    */
+    if (!s || !table)
+        return false;
+    cold_tick(s);
+    for (Block *b = s->head; b; b = b->next)
+    {
+        if (!block_ready(s, b))
+            return false;
+        unsigned char *p = (unsigned char *)b->data;
+        for (size_t i = 0; i < b->size; i++)
+            p[i] = table[p[i]];
+    }
+    // 映射改变了换行符或UTF-8首字节时索引计数失效
+    for (int c = 0; c < 256; c++)
+    {
+        if ((c == '\n') != (table[c] == '\n') || ((c & 0xC0) == 0x80) != ((table[c] & 0xC0) == 0x80))
+        {
+            index_invalidate(s);
+            break;
+        }
+    }
+    return true;
+}
+
+// [p, p+n)中字节c的个数
+static size_t count_in(const char *p, size_t n, char c)
+{
+    size_t count = 0, i = 0;
+#ifdef __SSE2__
+    const __m128i needle = _mm_set1_epi8(c);
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        count += (size_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)));
+    }
+#endif
+    for (; i < n; i++)
+        count += p[i] == c;
+    return count;
+}
+
+size_t str_count_char(const String s, char c)
+{
+    if (!s)
+        return 0;
+    if (c == '\n' && s->index && s->index->valid)
+        return fen_prefix(s->index->tree[IDX_LINES], s->index->count);
+    // 压缩块解压到临时缓冲区计数，不改变冷热状态
+    char scratch[FRAME_RAW_MAX];
+    size_t count = 0;
+    for (const Block *b = s->head; b; b = b->next)
+    {
+        const char *data = block_bytes(b, scratch);
+        if (data)
+            count += count_in(data, block_span(b), c);
+    }
+    return count;
+}
+
+//-----Numbers-----
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SWAR_DIGITS 1 // 8位数字一次解析依赖小端字节序
+#endif
+
+#ifdef SWAR_DIGITS
+static bool is_eight_digits(const char *p)
+{
+    uint64_t word;
+    memcpy(&word, p, 8);
+    // 每字节高4位为3，且加6后不进位到高4位，即'0'~'9'
+    return ((word & 0xF0F0F0F0F0F0F0F0ull) |
+            (((word + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull;
+}
+
+static uint32_t parse_eight_digits(const char *p)
+{
+    uint64_t word;
+    memcpy(&word, p, 8);
+    word -= 0x3030303030303030ull;
+    word = (word * 10) + (word >> 8); // 相邻两位合成0~99
+    word = (((word & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+            (((word >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+    return (uint32_t)word;
+}
+#endif
+
+static int cursor_peek(StrCursor *cur)
+{
+    size_t len;
+    const char *p = str_cursor_chunk(cur, &len);
+    return p ? (unsigned char)*p : -1;
+}
+
+static void skip_spaces(StrCursor *cur)
+{
+    const char *p;
+    size_t len;
+    while ((p = str_cursor_chunk(cur, &len)) != NULL)
+    {
+        size_t i = 0;
+        while (i < len && is_space(p[i]))
+            i++;
+        str_cursor_advance(cur, i);
+        if (i < len)
+            return;
+    }
+}
+
+// 读取连续数字累加到*value，返回位数；超出uint64_t时置*overflow并停止累加
+static size_t read_digits(StrCursor *cur, uint64_t *value, bool *overflow)
+{
+    size_t count = 0;
+    const char *p;
+    size_t len;
+    while ((p = str_cursor_chunk(cur, &len)) != NULL)
+    {
+        size_t i = 0;
+#ifdef SWAR_DIGITS
+        // value < 1e11时再接8位不会溢出
+        while (i + 8 <= len && *value < 100000000000ull && is_eight_digits(p + i))
+        {
+            *value = *value * 100000000u + parse_eight_digits(p + i);
+            i += 8;
+        }
+#endif
+        for (; i < len && p[i] >= '0' && p[i] <= '9'; i++)
+        {
+            unsigned d = (unsigned)(p[i] - '0');
+            if (*value > (UINT64_MAX - d) / 10)
+                *overflow = true;
+            else if (!*overflow)
+                *value = *value * 10 + d;
+        }
+        count += i;
+        str_cursor_advance(cur, i);
+        if (i < len)
+            break;
+    }
+    return count;
+}
+
+StrError str_parse_i64(const String s, size_t pos, int64_t *value, size_t *end)
+{
+    /*
+    time complexity: O(k), k = number of characters parsed
+    */
+    if (!s || !value || pos > s->length)
+        return STR_INVALID_PARAM;
+    StrCursor cur;
+    str_cursor_init(&cur, s, pos);
+    skip_spaces(&cur);
+    int c = cursor_peek(&cur);
+    bool negative = c == '-';
+    if (c == '-' || c == '+')
+        str_cursor_advance(&cur, 1);
+
+    uint64_t magnitude = 0;
+    bool overflow = false;
+    if (read_digits(&cur, &magnitude, &overflow) == 0)
+        return STR_INVALID_PARAM;
+    if (end)
+        *end = cur.pos;
+    if (overflow || magnitude > (uint64_t)INT64_MAX + negative)
+    {
+        *value = negative ? INT64_MIN : INT64_MAX;
+        return STR_OUT_OF_RANGE;
+    }
+    *value = negative ? -(int64_t)(magnitude - 1) - 1 : (int64_t)magnitude;
+    return STR_OK;
+}
+
+// 从pos起拷贝n个字符到buf并补'\0'，返回实际拷贝的字符数
+static size_t copy_out(String s, size_t pos, size_t n, char *buf)
+{
+    StrCursor cur;
+    str_cursor_init(&cur, s, pos);
+    size_t done = 0, len;
+    const char *p;
+    while (done < n && (p = str_cursor_chunk(&cur, &len)) != NULL)
+    {
+        size_t step = len < n - done ? len : n - done;
+        memcpy(buf + done, p, step);
+        done += step;
+        str_cursor_advance(&cur, step);
+    }
+    buf[done] = '\0';
+    return done;
+}
+
+// 读取inf/infinity/nan(不区分大小写)
+static bool read_special(StrCursor *cur, double *value)
+{
+    char word[9];
+    size_t n = 0;
+    int c;
+    while (n < 8 && (c = cursor_peek(cur)) >= 0 && ((c | 0x20) >= 'a' && (c | 0x20) <= 'z'))
+    {
+        word[n++] = (char)(c | 0x20);
+        str_cursor_advance(cur, 1);
+    }
+    word[n] = '\0';
+    if (strcmp(word, "inf") == 0 || strcmp(word, "infinity") == 0)
+        *value = INFINITY;
+    else if (strcmp(word, "nan") == 0)
+        *value = NAN;
+    else
+        return false;
+    return true;
+}
+
+StrError str_parse_f64(const String s, size_t pos, double *value, size_t *end)
+{
+    /*
+    time complexity: O(k), k = number of characters parsed
+    */
+    static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    if (!s || !value || pos > s->length)
+        return STR_INVALID_PARAM;
+    StrCursor cur;
+    str_cursor_init(&cur, s, pos);
+    skip_spaces(&cur);
+    size_t start = cur.pos;
+    int c = cursor_peek(&cur);
+    bool negative = c == '-';
+    if (c == '-' || c == '+')
+        str_cursor_advance(&cur, 1);
+
+    uint64_t mantissa = 0;
+    bool overflow = false;
+    size_t digits = read_digits(&cur, &mantissa, &overflow);
+    long exp10 = 0;
+    if (cursor_peek(&cur) == '.')
+    {
+        str_cursor_advance(&cur, 1);
+        size_t frac = read_digits(&cur, &mantissa, &overflow);
+        digits += frac;
+        exp10 -= (long)frac;
+    }
+    if (digits == 0)
+    {
+        double special;
+        if (!read_special(&cur, &special))
+            return STR_INVALID_PARAM;
+        if (end)
+            *end = cur.pos;
+        *value = negative ? -special : special;
+        return STR_OK;
+    }
+
+    c = cursor_peek(&cur);
+    if (c == 'e' || c == 'E')
+    {
+        StrCursor mark = cur;
+        str_cursor_advance(&cur, 1);
+        c = cursor_peek(&cur);
+        bool exp_negative = c == '-';
+        if (c == '-' || c == '+')
+            str_cursor_advance(&cur, 1);
+        uint64_t e = 0;
+        bool e_overflow = false;
+        if (read_digits(&cur, &e, &e_overflow) == 0)
+            cur = mark; // "1e"只解析到1
+        else
+            exp10 += exp_negative ? -(long)(e < 100000 ? e : 100000) : (long)(e < 100000 ? e : 100000);
+    }
+    if (end)
+        *end = cur.pos;
+
+    // Clinger快速路径：尾数和10的幂都能精确表示为double时，一次乘除即是正确舍入
+    if (!overflow && mantissa <= (1ull << 53) && exp10 >= -22 && exp10 <= 22)
+    {
+        double d = (double)mantissa;
+        d = exp10 < 0 ? d / pow10[-exp10] : d * pow10[exp10];
+        *value = negative ? -d : d;
+        return STR_OK;
+    }
+
+    // 其余情况交给strtod保证正确舍入
+    size_t n = cur.pos - start;
+    char small[128];
+    char *buf = n < sizeof(small) ? small : (char *)malloc(n + 1);
+    if (!buf)
+        return STR_ALLOC_FAILED;
+    copy_out(s, start, n, buf);
+    double d = strtod(buf, NULL);
+    if (buf != small)
+        free(buf);
+    *value = d;
+    return isinf(d) ? STR_OUT_OF_RANGE : STR_OK;
+}
+
+bool str_append_i64(String s, int64_t value)
+{
+    static const char pairs[] = "00010203040506070809101112131415161718192021222324"
+                                "25262728293031323334353637383940414243444546474849"
+                                "50515253545556575859606162636465666768697071727374"
+                                "75767778798081828384858687888990919293949596979899";
+    if (!s)
+        return false;
+    char buf[24];
+    char *p = buf + sizeof(buf);
+    uint64_t v = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    // 每次输出两位
+    while (v >= 100)
+    {
+        unsigned k = (unsigned)(v % 100) * 2;
+        v /= 100;
+        *--p = pairs[k + 1];
+        *--p = pairs[k];
+    }
+    if (v >= 10)
+    {
+        *--p = pairs[v * 2 + 1];
+        *--p = pairs[v * 2];
+    }
+    else
+    {
+        *--p = (char)('0' + v);
+    }
+    if (value < 0)
+        *--p = '-';
+    cold_tick(s);
+    return append_bytes(s, p, (size_t)(buf + sizeof(buf) - p));
+}
+
+bool str_append_f64(String s, double value)
+{
+    if (!s)
+        return false;
+    char buf[32];
+    int n;
+    if (isnan(value))
+        n = snprintf(buf, sizeof(buf), "nan");
+    else if (isinf(value))
+        n = snprintf(buf, sizeof(buf), value < 0 ? "-inf" : "inf");
+    else
+    {
+        // 取能精确读回的最短精度，17位总能读回
+        for (int precision = 15;; precision++)
+        {
+            n = snprintf(buf, sizeof(buf), "%.*g", precision, value);
+            if (precision == 17 || strtod(buf, NULL) == value)
+                break;
+        }
+    }
+    cold_tick(s);
+    return append_bytes(s, buf, (size_t)n);
+}
+
+//-----Diff-----
+
+typedef struct
+{
+    const char *a;     // a中间段的副本
+    const char *b;     // b中间段的副本
+    ptrdiff_t *vf;     // 正向搜索：每条对角线上到达的最远x
+    ptrdiff_t *vb;     // 反向搜索：同上，坐标从末尾算起
+    size_t base;       // 中间段在原串中的起点
+    StrEdit *edits;
+    size_t count;
+    size_t capacity;
+} DiffState;
+
+// 记录一次编辑，与上一次首尾相接时合并
+static bool diff_record(DiffState *st, size_t x, size_t del, size_t y, size_t ins)
+{
+    const char *text = st->b + y;
+    if (st->count > 0)
+    {
+        StrEdit *last = &st->edits[st->count - 1];
+        if (last->pos + last->delete_len == st->base + x && last->insert_text + last->insert_len == text)
+        {
+            last->delete_len += del;
+            last->insert_len += ins;
+            return true;
+        }
+    }
+    if (st->count == st->capacity)
+    {
+        size_t cap = st->capacity ? st->capacity * 2 : 16;
+        StrEdit *grown = (StrEdit *)realloc(st->edits, sizeof(StrEdit) * cap);
+        if (!grown)
+            return false;
+        st->edits = grown;
+        st->capacity = cap;
+    }
+    st->edits[st->count++] = (StrEdit){st->base + x, del, text, ins};
+    return true;
+}
+
+// 找a[x0,x1)与b[y0,y1)最短编辑路径的中间蛇形，返回其终点；无公共字符时返回false
+static bool diff_bisect(DiffState *st, size_t x0, size_t x1, size_t y0, size_t y1, size_t *sx, size_t *sy)
+{
+    const char *a = st->a + x0;
+    const char *b = st->b + y0;
+    ptrdiff_t n = (ptrdiff_t)(x1 - x0);
+    ptrdiff_t m = (ptrdiff_t)(y1 - y0);
+    ptrdiff_t max_d = (n + m + 1) / 2;
+    ptrdiff_t off = max_d;
+    ptrdiff_t *vf = st->vf;
+    ptrdiff_t *vb = st->vb;
+    for (ptrdiff_t i = 0; i < 2 * max_d + 2; i++)
+        vf[i] = vb[i] = -1;
+    vf[off + 1] = 0;
+    vb[off + 1] = 0;
+
+    ptrdiff_t delta = n - m;
+    bool odd = (delta & 1) != 0; // 奇数时正向搜索先相遇
+    // 越出网格的对角线不再扩展
+    ptrdiff_t f_lo = 0, f_hi = 0, b_lo = 0, b_hi = 0;
+    for (ptrdiff_t d = 0; d < max_d; d++)
+    {
+        for (ptrdiff_t k = -d + f_lo; k <= d - f_hi; k += 2)
+        {
+            ptrdiff_t x = (k == -d || (k != d && vf[off + k - 1] < vf[off + k + 1])) ? vf[off + k + 1]
+                                                                                  : vf[off + k - 1] + 1;
+            ptrdiff_t y = x - k;
+            while (x < n && y < m && a[x] == b[y])
+            {
+                x++;
+                y++;
+            }
+            vf[off + k] = x;
+            if (x > n)
+                f_hi += 2;
+            else if (y > m)
+                f_lo += 2;
+            else if (odd)
+            {
+                ptrdiff_t kb = off + delta - k;
+                if (kb >= 0 && kb < 2 * max_d && vb[kb] != -1 && x >= n - vb[kb])
+                {
+                    *sx = x0 + (size_t)x;
+                    *sy = y0 + (size_t)y;
+                    return true;
+                }
+            }
+        }
+        for (ptrdiff_t k = -d + b_lo; k <= d - b_hi; k += 2)
+        {
+            ptrdiff_t x = (k == -d || (k != d && vb[off + k - 1] < vb[off + k + 1])) ? vb[off + k + 1]
+                                                                                  : vb[off + k - 1] + 1;
+            ptrdiff_t y = x - k;
+            while (x < n && y < m && a[n - x - 1] == b[m - y - 1])
+            {
+                x++;
+                y++;
+            }
+            vb[off + k] = x;
+            if (x > n)
+                b_hi += 2;
+            else if (y > m)
+                b_lo += 2;
+            else if (!odd)
+            {
+                ptrdiff_t kf = off + delta - k;
+                if (kf >= 0 && kf < 2 * max_d && vf[kf] != -1 && vf[kf] >= n - x)
+                {
+                    *sx = x0 + (size_t)vf[kf];
+                    *sy = y0 + (size_t)(vf[kf] - (kf - off));
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+static bool diff_range(DiffState *st, size_t x0, size_t x1, size_t y0, size_t y1)
+{
+    // 剥去两端相同的部分
+    while (x0 < x1 && y0 < y1 && st->a[x0] == st->b[y0])
+    {
+        x0++;
+        y0++;
+    }
+    while (x0 < x1 && y0 < y1 && st->a[x1 - 1] == st->b[y1 - 1])
+    {
+        x1--;
+        y1--;
+    }
+    if (x0 == x1 && y0 == y1)
+        return true;
+    size_t sx, sy;
+    if (x0 == x1 || y0 == y1 || !diff_bisect(st, x0, x1, y0, y1, &sx, &sy))
+        return diff_record(st, x0, x1 - x0, y0, y1 - y0);
+    // 递归深度O(log D)：每一半的编辑距离至多为原来的一半
+    return diff_range(st, x0, sx, y0, sy) && diff_range(st, sx, x1, sy, y1);
+}
+
+// 逐块比较公共前缀的长度
+static size_t common_prefix(String a, String b)
+{
+    StrCursor ca, cb;
+    str_cursor_init(&ca, a, 0);
+    str_cursor_init(&cb, b, 0);
+    const char *pa, *pb;
+    size_t na, nb;
+    while ((pa = str_cursor_chunk(&ca, &na)) != NULL && (pb = str_cursor_chunk(&cb, &nb)) != NULL)
+    {
+        size_t n = na < nb ? na : nb;
+        if (memcmp(pa, pb, n) != 0)
+        {
+            size_t i = 0;
+            while (pa[i] == pb[i])
+                i++;
+            return ca.pos + i;
+        }
+        str_cursor_advance(&ca, n);
+        str_cursor_advance(&cb, n);
+    }
+    return ca.pos;
+}
+
+// 借助块索引从末尾逐块向前比较，*ea/*eb收缩到公共后缀之前，不越过lower
+static bool common_suffix(String a, String b, size_t lower, size_t *ea, size_t *eb)
+{
+    if (!index_ensure(a) || !index_ensure(b))
+        return false;
+    while (*ea > lower && *eb > lower)
+    {
+        size_t sa, sb;
+        Block *ba = locate(a, *ea - 1, &sa, NULL);
+        Block *bb = locate(b, *eb - 1, &sb, NULL);
+        if (!ba || !bb)
+            return false;
+        size_t na = *ea - sa;
+        size_t nb = *eb - sb;
+        size_t n = na < nb ? na : nb;
+        if (n > *ea - lower)
+            n = *ea - lower;
+        if (n > *eb - lower)
+            n = *eb - lower;
+        for (size_t i = 1; i <= n; i++)
+        {
+            if (ba->data[na - i] != bb->data[nb - i])
+            {
+                *ea -= i - 1;
+                *eb -= i - 1;
+                return true;
+            }
+        }
+        *ea -= n;
+        *eb -= n;
+    }
+    return true;
+}
+
+StrError str_diff(const String a, const String b, StrEdit **edits, size_t *count)
+{
+    /*
+    time complexity: O(n + (N + M) * D), N and M = lengths of the differing middle parts,
+                     D = number of inserted and deleted characters
+    space complexity: O(N + M)
+    */
+    if (!a || !b || !edits || !count)
+        return STR_INVALID_PARAM;
+    *edits = NULL;
+    *count = 0;
+    if (a == b)
+        return STR_OK;
+    cold_tick(a);
+    cold_tick(b);
+
+    size_t prefix = common_prefix(a, b);
+    size_t ea = a->length, eb = b->length;
+    if (!common_suffix(a, b, prefix, &ea, &eb))
+        return STR_ALLOC_FAILED;
+    if (ea == prefix && eb == prefix)
+        return STR_OK;
+
+    // 只把不同的中间段拷出来，Myers算法需要双向随机访问
+    size_t n = ea - prefix, m = eb - prefix;
+    char *text = (char *)malloc(n + m + 1);
+    ptrdiff_t *v = (ptrdiff_t *)malloc(sizeof(ptrdiff_t) * 2 * (n + m + 3));
+    if (!text || !v || copy_out(a, prefix, n, text) != n || copy_out(b, prefix, m, text + n) != m)
+    {
+        free(text);
+        free(v);
+        return STR_ALLOC_FAILED;
+    }
+    DiffState st = {text, text + n, v, v + n + m + 3, prefix, NULL, 0, 0};
+    bool ok = diff_range(&st, 0, n, 0, m);
+    free(v);
+
+    // 编辑数组与插入文本放在同一块内存里，调用者一次free
+    StrEdit *out = NULL;
+    if (ok)
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < st.count; i++)
+            total += st.edits[i].insert_len;
+        out = (StrEdit *)malloc(sizeof(StrEdit) * st.count + total);
+        ok = out != NULL;
+    }
+    if (ok)
+    {
+        char *dst = (char *)(out + st.count);
+        for (size_t i = 0; i < st.count; i++)
+        {
+            out[i] = st.edits[i];
+            memcpy(dst, st.edits[i].insert_text, st.edits[i].insert_len);
+            out[i].insert_text = st.edits[i].insert_len ? dst : NULL;
+            dst += st.edits[i].insert_len;
+        }
+        *edits = out;
+        *count = st.count;
+    }
+    free(st.edits);
+    free(text);
+    return ok ? STR_OK : STR_ALLOC_FAILED;
+}
+
+//-----Rolling Hash-----
+
+#define RK_MOD 0x1FFFFFFFFFFFFFFFull // 梅森素数2^61-1
+#define RK_BASE 0x100000001B3ull
+
+static uint64_t rk_reduce(uint64_t x)
+{
+    x = (x & RK_MOD) + (x >> 61);
+    return x >= RK_MOD ? x - RK_MOD : x;
+}
+
+// a*b mod 2^61-1，拆成32位乘法避免依赖128位整数
+static uint64_t rk_mul(uint64_t a, uint64_t b)
+{
+    uint64_t a_hi = a >> 32, a_lo = (uint32_t)a;
+    uint64_t b_hi = b >> 32, b_lo = (uint32_t)b;
+    uint64_t lo = a_lo * b_lo;
+    uint64_t mid = a_hi * b_lo + a_lo * b_hi;
+    uint64_t hi = a_hi * b_hi;
+    // 2^64≡2^3, mid*2^32 = (mid>>29)*2^61 + (mid低29位)*2^32
+    return rk_reduce((hi << 3) + (mid >> 29) + ((mid & 0x1FFFFFFFull) << 32) + (lo >> 61) + (lo & RK_MOD));
+}
+
+// 在块链上滑动长度为m的窗口，环形缓冲保存窗口内容
+typedef struct
+{
+    StrCursor cur;
+    const char *chunk;
+    size_t left;
+    unsigned char *ring; // ring[head]是窗口最早的字符
+    size_t m;
+    size_t head;
+    size_t pos;        // 当前窗口起点
+    uint64_t hash;
+    uint64_t out_pow;  // BASE^(m-1)，移出字符的权重
+} Roller;
+
+static bool roller_byte(Roller *r, unsigned char *c)
+{
+    if (r->left == 0)
+    {
+        r->chunk = str_cursor_chunk(&r->cur, &r->left);
+        if (!r->chunk)
+            return false;
+        str_cursor_advance(&r->cur, r->left);
+    }
+    *c = (unsigned char)*r->chunk++;
+    r->left--;
+    return true;
+}
+
+// 读入前m个字符，得到第一个窗口
+static bool roller_init(Roller *r, String s, size_t m, unsigned char *ring)
+{
+    if (m == 0 || m > s->length)
+        return false;
+    str_cursor_init(&r->cur, s, 0);
+    r->chunk = NULL;
+    r->left = 0;
+    r->ring = ring;
+    r->m = m;
+    r->head = 0;
+    r->pos = 0;
+    r->hash = 0;
+    r->out_pow = 1;
+    for (size_t i = 0; i < m; i++)
+    {
+        if (!roller_byte(r, &ring[i]))
+            return false;
+        r->hash = rk_reduce(rk_mul(r->hash, RK_BASE) + ring[i]);
+        if (i > 0)
+            r->out_pow = rk_mul(r->out_pow, RK_BASE);
+    }
+    return true;
+}
+
+// 窗口右移一位，O(1)
+static bool roller_next(Roller *r)
+{
+    unsigned char in;
+    if (!roller_byte(r, &in))
+        return false;
+    unsigned char out = r->ring[r->head];
+    uint64_t h = r->hash + RK_MOD - rk_mul(out, r->out_pow);
+    r->hash = rk_reduce(rk_mul(rk_reduce(h), RK_BASE) + in);
+    r->ring[r->head] = in;
+    r->head = r->head + 1 == r->m ? 0 : r->head + 1;
+    r->pos++;
+    return true;
+}
+
+static bool roller_matches(const Roller *r, const char *text)
+{
+    size_t tail = r->m - r->head;
+    return memcmp(r->ring + r->head, text, tail) == 0 && memcmp(r->ring, text + tail, r->head) == 0;
+}
+
+static uint64_t hash_string(String s)
+{
+    uint64_t h = 0;
+    StrCursor cur;
+    str_cursor_init(&cur, s, 0);
+    int c;
+    while ((c = str_cursor_next(&cur)) >= 0)
+        h = rk_reduce(rk_mul(h, RK_BASE) + (unsigned)c);
+    return h;
+}
+
+static size_t table_size_for(size_t n)
+{
+    size_t size = 16;
+    while (size < n + n / 2)
+        size *= 2;
+    return size;
+}
+
+static bool push_hit(StrHit **hits, size_t *count, size_t *capacity, size_t pos, size_t pattern)
+{
+    if (*count == *capacity)
+    {
+        size_t cap = *capacity ? *capacity * 2 : 16;
+        StrHit *grown = (StrHit *)realloc(*hits, sizeof(StrHit) * cap);
+        if (!grown)
+            return false;
+        *hits = grown;
+        *capacity = cap;
+    }
+    (*hits)[(*count)++] = (StrHit){pos, pattern};
+    return true;
+}
+
+StrError str_find_patterns(const String s, const String *patterns, size_t n, StrHit **hits, size_t *count)
+{
+    /*
+    time complexity: O(n + k * m) expected, k = number of hits
+    space complexity: O(p * m) for p patterns of length m
+    */
+    if (!s || !patterns || n == 0 || !hits || !count)
+        return STR_INVALID_PARAM;
+    *hits = NULL;
+    *count = 0;
+    size_t m = patterns[0] ? patterns[0]->length : 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (!patterns[i] || patterns[i]->length != m || m == 0)
+            return STR_INVALID_PARAM;
+    }
+    if (m > s->length)
+        return STR_OK;
+
+    // 模式哈希表：开放定址，slot存模式下标+1；同哈希的模式用next串起来
+    size_t size = table_size_for(n);
+    size_t *slots = (size_t *)calloc(size, sizeof(size_t));
+    size_t *next = (size_t *)malloc(sizeof(size_t) * n);
+    uint64_t *hashes = (uint64_t *)malloc(sizeof(uint64_t) * n);
+    char *text = (char *)malloc(n * m + 1);
+    unsigned char *ring = (unsigned char *)malloc(m);
+    StrError err = STR_ALLOC_FAILED;
+    if (!slots || !next || !hashes || !text || !ring)
+        goto done;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (copy_out(patterns[i], 0, m, text + i * m) != m)
+            goto done;
+        hashes[i] = hash_string(patterns[i]);
+        next[i] = 0;
+        size_t j = (size_t)hashes[i] & (size - 1);
+        while (slots[j] && hashes[slots[j] - 1] != hashes[i])
+            j = (j + 1) & (size - 1);
+        if (slots[j])
+        {
+            size_t last = slots[j] - 1;
+            while (next[last])
+                last = next[last] - 1;
+            next[last] = i + 1;
+        }
+        else
+        {
+            slots[j] = i + 1;
+        }
+    }
+
+    cold_tick(s);
+    Roller r;
+    size_t capacity = 0;
+    bool more = roller_init(&r, s, m, ring);
+    while (more)
+    {
+        size_t j = (size_t)r.hash & (size - 1);
+        while (slots[j] && hashes[slots[j] - 1] != r.hash)
+            j = (j + 1) & (size - 1);
+        // 哈希相同再逐字节确认
+        for (size_t k = slots[j]; k; k = next[k - 1])
+        {
+            if (roller_matches(&r, text + (k - 1) * m) && !push_hit(hits, count, &capacity, r.pos, k - 1))
+            {
+                free(*hits);
+                *hits = NULL;
+                *count = 0;
+                goto done;
+            }
+        }
+        more = r.pos + m < s->length && roller_next(&r);
+    }
+    err = STR_OK;
+
+done:
+    free(slots);
+    free(next);
+    free(hashes);
+    free(text);
+    free(ring);
+    return err;
+}
+
+// 比较s中[p, p+len)与[q, q+len)
+static bool ranges_equal(String s, size_t p, size_t q, size_t len)
+{
+    StrCursor a, b;
+    if (!str_cursor_init(&a, s, p) || !str_cursor_init(&b, s, q))
+        return false;
+    while (len > 0)
+    {
+        size_t na, nb;
+        const char *pa = str_cursor_chunk(&a, &na);
+        const char *pb = str_cursor_chunk(&b, &nb);
+        if (!pa || !pb)
+            return false;
+        size_t n = na < nb ? na : nb;
+        if (n > len)
+            n = len;
+        if (memcmp(pa, pb, n) != 0)
+            return false;
+        str_cursor_advance(&a, n);
+        str_cursor_advance(&b, n);
+        len -= n;
+    }
+    return true;
+}
+
+typedef struct
+{
+    uint64_t hash;
+    size_t pos;
+} HashSlot;
+
+// 找长度为len且出现至少两次的子串，*found返回首次出现的位置
+static StrError find_repeat(String s, size_t len, HashSlot *table, size_t size, unsigned char *ring, size_t *found)
+{
+    for (size_t i = 0; i < size; i++)
+        table[i].pos = SIZE_MAX;
+    Roller r;
+    bool more = roller_init(&r, s, len, ring);
+    while (more)
+    {
+        size_t j = (size_t)r.hash & (size - 1);
+        for (; table[j].pos != SIZE_MAX; j = (j + 1) & (size - 1))
+        {
+            if (table[j].hash == r.hash && ranges_equal(s, table[j].pos, r.pos, len))
+            {
+                *found = table[j].pos;
+                return STR_OK;
+            }
+        }
+        table[j].hash = r.hash;
+        table[j].pos = r.pos;
+        more = r.pos + len < s->length && roller_next(&r);
+    }
+    return STR_NOT_FOUND;
+}
+
+StrError str_longest_repeated_substring(const String s, size_t *pos, size_t *len)
+{
+    /*
+    time complexity: O(n log n) expected
+    space complexity: O(n)
+    */
+    if (!s || !pos || !len)
+        return STR_INVALID_PARAM;
+    *pos = 0;
+    *len = 0;
+    if (s->length < 2)
+        return STR_OK;
+
+    size_t size = table_size_for(s->length);
+    HashSlot *table = (HashSlot *)malloc(sizeof(HashSlot) * size);
+    unsigned char *ring = (unsigned char *)malloc(s->length);
+    if (!table || !ring)
+    {
+        free(table);
+        free(ring);
+        return STR_ALLOC_FAILED;
+    }
+    index_ensure(s); // 确认候选时按位置定位
+    cold_tick(s);
+
+    // 长度L有重复则L-1也有，二分最大的L
+    size_t lo = 1, hi = s->length - 1;
+    while (lo <= hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        size_t found;
+        if (find_repeat(s, mid, table, size, ring, &found) == STR_OK)
+        {
+            *pos = found;
+            *len = mid;
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+    free(table);
+    free(ring);
+    return STR_OK;
+}
+
+StrError str_fingerprints(const String s, size_t k, size_t window, StrFingerprint **prints, size_t *count)
+{
+    /*
+    time complexity: O(n)
+    space complexity: O(k + w) besides the output
+    */
+    if (!s || k == 0 || window == 0 || !prints || !count)
+        return STR_INVALID_PARAM;
+    *prints = NULL;
+    *count = 0;
+    if (k > s->length)
+        return STR_OK;
+
+    // 单调队列：哈希从队首到队尾严格递增，队首即窗口内最右的最小值
+    StrFingerprint *deque = (StrFingerprint *)malloc(sizeof(StrFingerprint) * window);
+    unsigned char *ring = (unsigned char *)malloc(k);
+    // 相邻两个指纹至少相隔一位，总数不超过k-gram数
+    StrFingerprint *out = (StrFingerprint *)malloc(sizeof(StrFingerprint) * (s->length - k + 1));
+    if (!deque || !ring || !out)
+    {
+        free(deque);
+        free(ring);
+        free(out);
+        return STR_ALLOC_FAILED;
+    }
+    cold_tick(s);
+
+    size_t front = 0, size = 0, n = 0;
+    Roller r;
+    bool more = roller_init(&r, s, k, ring);
+    while (more)
+    {
+        while (size > 0 && deque[(front + size - 1) % window].hash >= r.hash)
+            size--;
+        if (size > 0 && deque[front].pos + window <= r.pos)
+        {
+            front = (front + 1) % window;
+            size--;
+        }
+        deque[(front + size) % window] = (StrFingerprint){r.hash, r.pos};
+        size++;
+        // 凑满第一个窗口后，每次窗口最小值换位置就记录一次
+        if (r.pos + 1 >= window && (n == 0 || out[n - 1].pos != deque[front].pos))
+            out[n++] = deque[front];
+        more = r.pos + k < s->length && roller_next(&r);
+    }
+    // k-gram数不足一个窗口时取全局最小值
+    if (n == 0 && size > 0)
+        out[n++] = deque[front];
+    free(deque);
+    free(ring);
+    *prints = out;
+    *count = n;
+    return STR_OK;
+}
+
+//-----Stream-----
+
+#define STREAM_RECYCLE 64 // 回收环容量(块)
+#define CACHE_LINE 64
+
+// 生产者和消费者各自的字段放在不同缓存行，避免伪共享
+struct StrStream
+{
+    // 消费者独占
+    _Alignas(CACHE_LINE) Block *head; // 已读完的哨兵块，数据从head->next开始
+    size_t offset;                    // head->next中已读的字节数
+    size_t consumed;                  // 已读字节数(原子)
+    size_t recycle_tail;              // 回收环写位置(原子)
+
+    // 生产者独占
+    _Alignas(CACHE_LINE) Block *tail; // 最后一个已发布的块
+    Block *pending;                   // 正在填充、尚未发布的块
+    size_t published;                 // 已发布字节数(原子)
+    size_t recycle_head;              // 回收环读位置(原子)
+    bool closed;                      // 生产者已结束(原子)
+
+    // 消费者归还、生产者取用的空块
+    _Alignas(CACHE_LINE) Block *recycle[STREAM_RECYCLE];
+};
+
+StrStream str_stream_create(void)
+{
+    StrStream st = (StrStream)aligned_alloc(CACHE_LINE, sizeof(struct StrStream));
+    if (!st)
+        return NULL;
+    memset(st, 0, sizeof(struct StrStream));
+    st->head = (Block *)calloc(1, sizeof(Block));
+    if (!st->head)
+    {
+        free(st);
+        return NULL;
+    }
+    st->tail = st->head;
+    return st;
+}
+
+void str_stream_destroy(StrStream *st)
+{
+    if (!st || !*st)
+        return;
+    StrStream p = *st;
+    Block *b = p->head;
+    while (b)
+    {
+        Block *next = b->next;
+        free(b);
+        b = next;
+    }
+    free(p->pending);
+    for (size_t i = p->recycle_head; i != p->recycle_tail; i++)
+        free(p->recycle[i % STREAM_RECYCLE]);
+    free(p);
+    *st = NULL;
+}
+
+// 生产者取空块：优先从回收环取，否则malloc
+static Block *stream_block(StrStream st)
+{
+    Block *b;
+    size_t h = st->recycle_head;
+    if (h != __atomic_load_n(&st->recycle_tail, __ATOMIC_ACQUIRE))
+    {
+        b = st->recycle[h % STREAM_RECYCLE];
+        __atomic_store_n(&st->recycle_head, h + 1, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        b = (Block *)malloc(sizeof(Block));
+        if (!b)
+            return NULL;
+    }
+    b->next = NULL;
+    b->size = 0;
+    return b;
+}
+
+// 消费者归还读完的块，环满时直接free
+static void stream_recycle(StrStream st, Block *b)
+{
+    size_t t = st->recycle_tail;
+    if (t - __atomic_load_n(&st->recycle_head, __ATOMIC_ACQUIRE) < STREAM_RECYCLE)
+    {
+        st->recycle[t % STREAM_RECYCLE] = b;
+        __atomic_store_n(&st->recycle_tail, t + 1, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        free(b);
+    }
+}
+
+// 把first..last这一段链到队尾；release保证消费者看到next时块内容已写好。
+// published先于链接增加，消费者计入consumed的字节一定已计入published
+static void stream_link(StrStream st, Block *first, Block *last, size_t bytes)
+{
+    last->next = NULL;
+    __atomic_fetch_add(&st->published, bytes, __ATOMIC_RELEASE);
+    __atomic_store_n(&st->tail->next, first, __ATOMIC_RELEASE);
+    st->tail = last;
+}
+
+static void stream_publish(StrStream st)
+{
+    Block *b = st->pending;
+    if (!b || b->size == 0)
+        return;
+    st->pending = NULL;
+    stream_link(st, b, b, b->size);
+}
+
+bool str_stream_write(StrStream st, const char *data, size_t len)
+{
+    if (!st || (len > 0 && !data) || st->closed)
+        return false;
+    while (len > 0)
+    {
+        if (!st->pending && !(st->pending = stream_block(st)))
+            return false;
+        Block *b = st->pending;
+        size_t n = BLOCK_SIZE - b->size;
+        if (n > len)
+            n = len;
+        memcpy(b->data + b->size, data, n);
+        b->size += (unsigned char)n;
+        data += n;
+        len -= n;
+        if (b->size == BLOCK_SIZE)
+            stream_publish(st);
+    }
+    return true;
+}
 
-    // 修正tail指针
-    Block *tail_finder = s->head;
-    if (!tail_finder)
+bool str_stream_write_str(StrStream st, String s)
+{
+    if (!st || !s || st->closed)
+        return false;
+    for (Block *b = s->head; b; b = b->next)
     {
-        s->tail = NULL;
+        if (!block_ready(s, b))
+            return false;
     }
-    else
+    if (s->pool)
     {
-        while (tail_finder->next)
+        // 预分配块属于整段内存，不能单独交给消费者释放，只能拷贝
+        for (Block *b = s->head; b; b = b->next)
         {
-            tail_finder = tail_finder->next;
+            if (!str_stream_write(st, b->data, b->size))
+                return false;
         }
-        s->tail = tail_finder;
     }
-
+    else
+    {
+        stream_publish(st);
+        if (s->head)
+            stream_link(st, s->head, s->tail, s->length);
+        s->head = s->tail = NULL;
+    }
+    str_clear(s);
     return true;
 }
 
-//-----String Operations-----
-bool str_concat(String result, const String s1, const String s2)
+void str_stream_flush(StrStream st)
 {
-    if (!result || !s1 || !s2)
-        return false;
-
-    str_clear(result);
-    if (!str_append_str(result, s1))
-        return false;
-    if (!str_append_str(result, s2))
-        return false;
+    if (st)
+        stream_publish(st);
+}
 
-    return true;
+void str_stream_close(StrStream st)
+{
+    if (!st)
+        return;
+    stream_publish(st);
+    __atomic_store_n(&st->closed, true, __ATOMIC_RELEASE);
 }
 
-bool str_substring(String sub, const String s, size_t pos, size_t len)
+const char *str_stream_peek(StrStream st, size_t *len)
 {
-    if (!sub || !s || pos >= s->length)
-        return false;
+    *len = 0;
+    if (!st)
+        return NULL;
+    for (;;)
+    {
+        Block *cur = __atomic_load_n(&st->head->next, __ATOMIC_ACQUIRE);
+        if (!cur)
+            return NULL;
+        if (st->offset < cur->size)
+        {
+            *len = cur->size - st->offset;
+            return cur->data + st->offset;
+        }
+        // cur读完后成为新的哨兵；旧哨兵不可能是生产者的tail
+        stream_recycle(st, st->head);
+        st->head = cur;
+        st->offset = 0;
+    }
+}
 
-    if (pos + len > s->length)
+size_t str_stream_consume(StrStream st, size_t n)
+{
+    size_t done = 0, len;
+    while (done < n && str_stream_peek(st, &len))
     {
-        len = s->length - pos; // 自动调整
+        size_t step = n - done < len ? n - done : len;
+        st->offset += step;
+        done += step;
     }
+    if (done > 0)
+        __atomic_fetch_add(&st->consumed, done, __ATOMIC_RELEASE);
+    return done;
+}
 
-    str_clear(sub);
-    for (size_t i = 0; i < len; i++)
+size_t str_stream_read(StrStream st, char *buf, size_t cap)
+{
+    size_t done = 0, len;
+    const char *p;
+    while (done < cap && (p = str_stream_peek(st, &len)) != NULL)
     {
-        str_push_back(sub, str_at(s, pos + i));
+        size_t step = cap - done < len ? cap - done : len;
+        memcpy(buf + done, p, step);
+        st->offset += step;
+        done += step;
     }
-    return true;
+    if (done > 0)
+        __atomic_fetch_add(&st->consumed, done, __ATOMIC_RELEASE);
+    return done;
 }
 
-static int *prefix_function(const String pattern)
+bool str_stream_eof(StrStream st)
+{
+    if (!st)
+        return true;
+    // 先确认已关闭，再看是否还有数据：关闭前发布的块此时一定可见
+    if (!__atomic_load_n(&st->closed, __ATOMIC_ACQUIRE))
+        return false;
+    size_t len;
+    return str_stream_peek(st, &len) == NULL;
+}
+
+size_t str_stream_buffered(const StrStream st)
+{
+    if (!st)
+        return 0;
+    // 先读consumed：acquire与消费者的release配对，随后读到的published不会更小
+    size_t consumed = __atomic_load_n(&st->consumed, __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&st->published, __ATOMIC_ACQUIRE) - consumed;
+}
+
+//-----Serialization-----
+/*
+layout (little endian):
+    [0]  magic "BSTR"
+    [4]  u16 version
+    [6]  u16 block size
+    [8]  u64 length
+    [16] u64 block count
+    [24] block-size table, one byte per block
+         payload, length bytes
+*/
+
+#define SER_MAGIC "BSTR"
+#define SER_VERSION 1
+#define SER_HEADER_SIZE 24
+
+static void put_u16(unsigned char *p, uint16_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u64(unsigned char *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint16_t get_u16(const unsigned char *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+        v = v << 8 | p[i];
+    return v;
+}
+
+// 压缩帧按满块计数，序列化时不解压原字符串
+static size_t serialized_blocks(const String s)
+{
+    size_t count = 0;
+    for (Block *b = s->head; b; b = b->next)
+        count += b->size == BLOCK_FROZEN ? (block_span(b) + BLOCK_SIZE - 1) / BLOCK_SIZE : 1;
+    return count;
+}
+
+size_t str_serialized_size(const String s)
+{
+    if (!s)
+        return 0;
+    return SER_HEADER_SIZE + serialized_blocks(s) + s->length;
+}
+
+size_t str_serialize(const String s, void *buf, size_t cap)
 {
     /*
-    time complexity: O(m)
-    space complexity: O(m)
+    time complexity: O(n)
     */
-    int m = str_length(pattern);
-    int *next = (int *)malloc(sizeof(int) * m);
-    if (!next)
-        return NULL;
-    next[0] = 0;
-    for (int i = 1; i < m; i++)
+    if (!s || !buf || cap < str_serialized_size(s))
+        return 0;
+
+    unsigned char *out = (unsigned char *)buf;
+    size_t count = serialized_blocks(s);
+    memcpy(out, SER_MAGIC, 4);
+    put_u16(out + 4, SER_VERSION);
+    put_u16(out + 6, BLOCK_SIZE);
+    put_u64(out + 8, s->length);
+    put_u64(out + 16, count);
+
+    unsigned char *table = out + SER_HEADER_SIZE;
+    char *payload = (char *)table + count;
+    for (Block *b = s->head; b; b = b->next)
     {
-        int j = next[i - 1];
-        while (j > 0 && str_at(pattern, i) != str_at(pattern, j))
-            j = next[j - 1];
-        if (str_at(pattern, i) == str_at(pattern, j))
-            j++;
-        next[i] = j;
+        if (b->size != BLOCK_FROZEN)
+        {
+            *table++ = b->size;
+            memcpy(payload, b->data, b->size);
+            payload += b->size;
+            continue;
+        }
+        Frame *f = block_frame(b);
+        if (lz_decompress(f->payload, f->comp_len, payload, f->raw_len) != f->raw_len)
+            return 0;
+        for (size_t left = f->raw_len; left > 0; left -= *table++)
+            *table = (unsigned char)(left < BLOCK_SIZE ? left : BLOCK_SIZE);
+        payload += f->raw_len;
     }
-    return next;
+    return (unsigned char *)payload - out;
 }
 
-int *str_find_all(const String s, const String pattern, size_t start_pos)
+String str_deserialize(const void *buf, size_t len)
 {
     /*
-    time complexity: O(n+m+k)
-    space complexity: O(n+m+k)
+    time complexity: O(n), one memcpy per block
     */
-    if (!s || !pattern || start_pos >= str_length(s))
+    const unsigned char *in = (const unsigned char *)buf;
+    if (!in || len < SER_HEADER_SIZE || memcmp(in, SER_MAGIC, 4) != 0 ||
+        get_u16(in + 4) != SER_VERSION || get_u16(in + 6) > BLOCK_SIZE)
         return NULL;
-
-    String cur = str_create();
-    if (!cur)
+    uint64_t length = get_u64(in + 8);
+    uint64_t count = get_u64(in + 16);
+    if (count > len - SER_HEADER_SIZE || length != len - SER_HEADER_SIZE - count)
         return NULL;
 
-    size_t n = str_length(s);
-    size_t m = str_length(pattern);
-    str_append_str(cur, pattern);      // O(m)
-    str_push_back(cur, '#');           // O(1)
-    str_append_str(cur, s);            // O(n)
-    str_delete(cur, m + 1, start_pos); // 删除前start_pos个字符 O(n)
-    int *next = prefix_function(cur);  // O(n+m)
-    if (!next)
+    String s = str_create();
+    if (!s)
         return NULL;
-    int *positions = (int *)malloc(sizeof(int) * (n + 1)); // 最多n个匹配位置
-    if (!positions)
+    const unsigned char *table = in + SER_HEADER_SIZE;
+    const char *payload = (const char *)table + count;
+    size_t used = 0;
+    for (uint64_t i = 0; i < count; i++)
     {
-        free(next);
+        Block *b = block_create(s);
+        if (!b || table[i] > BLOCK_SIZE || table[i] > length - used)
+        {
+            free(b);
+            str_destroy(&s);
+            return NULL;
+        }
+        b->size = table[i];
+        memcpy(b->data, payload + used, b->size);
+        used += b->size;
+        if (s->tail)
+            s->tail->next = b;
+        else
+            s->head = b;
+        s->tail = b;
+    }
+    if (used != length)
+    {
+        str_destroy(&s);
         return NULL;
     }
-    int count = 1;
-    for (size_t i = m + 1; i < str_length(cur); i++)
-    { // O(n)
-        if ((size_t)next[i] == m)
+    s->length = length;
+    return s;
+}
+
+bool str_save(const String s, FILE *fp)
+{
+    if (!s || !fp)
+        return false;
+    size_t size = str_serialized_size(s);
+    void *buf = malloc(size);
+    if (!buf)
+        return false;
+    bool ok = str_serialize(s, buf, size) == size && fwrite(buf, 1, size, fp) == size;
+    free(buf);
+    return ok;
+}
+
+String str_load(FILE *fp)
+{
+    if (!fp)
+        return NULL;
+    unsigned char header[SER_HEADER_SIZE];
+    if (fread(header, 1, SER_HEADER_SIZE, fp) != SER_HEADER_SIZE || memcmp(header, SER_MAGIC, 4) != 0)
+        return NULL;
+    uint64_t body = get_u64(header + 8) + get_u64(header + 16);
+    if (body < get_u64(header + 8) || body > SIZE_MAX - SER_HEADER_SIZE)
+        return NULL;
+
+    // 块表和内容一次读入
+    unsigned char *buf = (unsigned char *)malloc(SER_HEADER_SIZE + body);
+    if (!buf)
+        return NULL;
+    memcpy(buf, header, SER_HEADER_SIZE);
+    String s = NULL;
+    if (fread(buf + SER_HEADER_SIZE, 1, body, fp) == body)
+        s = str_deserialize(buf, SER_HEADER_SIZE + body);
+    free(buf);
+    return s;
+}
+
+//-----UTF-8-----
+
+// 检查data是否为完整合法的UTF-8序列，ASCII段用SIMD/SWAR批量跳过
+static bool utf8_valid(const unsigned char *p, size_t n)
+{
+    size_t i = 0;
+    while (i < n)
+    {
+#ifdef __SSE2__
+        while (i + 16 <= n && _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(p + i))) == 0)
+            i += 16;
+#else
+        uint64_t word;
+        while (i + 8 <= n && (memcpy(&word, p + i, 8), (word & 0x8080808080808080ull) == 0))
+            i += 8;
+#endif
+        if (i >= n)
+            break;
+        unsigned char c = p[i];
+        if (c < 0x80)
         {
-            positions[count++] = i - 2 * m + start_pos;
+            i++;
+            continue;
+        }
+
+        size_t len;
+        uint32_t cp, min;
+        if ((c & 0xE0) == 0xC0)
+            len = 2, cp = c & 0x1F, min = 0x80;
+        else if ((c & 0xF0) == 0xE0)
+            len = 3, cp = c & 0x0F, min = 0x800;
+        else if ((c & 0xF8) == 0xF0)
+            len = 4, cp = c & 0x07, min = 0x10000;
+        else
+            return false;
+        if (n - i < len)
+            return false;
+        for (size_t k = 1; k < len; k++)
+        {
+            if ((p[i + k] & 0xC0) != 0x80)
+                return false;
+            cp = cp << 6 | (p[i + k] & 0x3F);
         }
+        // 拒绝超长编码、代理区和超出Unicode范围的码点
+        if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+            return false;
+        i += len;
     }
-    positions[0] = count - 1; // 记录匹配数量
-    free(next);
-    str_destroy(&cur);
-    return positions;
+    return true;
 }
 
-int str_find_first(const String s, const String pattern, size_t start_pos)
+bool str_append_utf8(String s, const char *data, size_t len)
 {
-    if (!s || !pattern || start_pos >= str_length(s))
-        return -1;
-    int *positions = str_find_all(s, pattern, start_pos);
-    if (!positions)
-        return -1;
-    int count = positions[0];
-    if (count == 0)
+    if (!s || (!data && len > 0) || !utf8_valid((const unsigned char *)data, len))
+        return false;
+    cold_tick(s);
+    return append_bytes(s, data, len);
+}
+
+size_t str_utf8_length(const String s)
+{
+    if (!s || !index_ensure(s))
+        return 0;
+    return fen_prefix(s->index->tree[IDX_POINTS], s->index->count);
+}
+
+size_t str_utf8_offset(const String s, size_t cp_index)
+{
+    /*
+    time complexity: O(log n)
+    */
+    if (!s || !index_ensure(s))
+        return STR_NPOS;
+    BlockIndex *ix = s->index;
+    size_t total = fen_prefix(ix->tree[IDX_POINTS], ix->count);
+    if (cp_index >= total)
+        return cp_index == total ? s->length : STR_NPOS;
+
+    size_t before;
+    size_t k = fen_search(ix->tree[IDX_POINTS], ix->count, cp_index, &before);
+    char scratch[FRAME_RAW_MAX];
+    const Block *b = ix->blocks[k];
+    const char *data = block_bytes(b, scratch);
+    if (!data)
+        return STR_NPOS;
+    // 在块内找到第(cp_index - before)个首字节
+    size_t want = cp_index - before;
+    for (size_t i = 0; i < block_span(b); i++)
     {
-        free(positions);
-        return -1;
+        if (((unsigned char)data[i] & 0xC0) != 0x80 && want-- == 0)
+            return fen_prefix(ix->tree[IDX_BYTES], k) + i;
     }
-    int first_pos = positions[1];
-    free(positions);
-    return first_pos;
+    return STR_NPOS;
 }
 
-int str_find_char(const String s, char c, size_t start_pos)
+size_t str_utf8_index(const String s, size_t byte_pos)
 {
-    if (!s || start_pos >= str_length(s))
+    /*
+    time complexity: O(log n)
+    */
+    if (!s || byte_pos > s->length || !index_ensure(s))
+        return STR_NPOS;
+    BlockIndex *ix = s->index;
+    if (byte_pos == s->length)
+        return fen_prefix(ix->tree[IDX_POINTS], ix->count);
+
+    size_t block_start;
+    size_t k = fen_search(ix->tree[IDX_BYTES], ix->count, byte_pos, &block_start);
+    char scratch[FRAME_RAW_MAX];
+    const char *data = block_bytes(ix->blocks[k], scratch);
+    if (!data)
+        return STR_NPOS;
+    size_t counts[IDX_KINDS];
+    count_bytes(data, byte_pos - block_start, counts);
+    return fen_prefix(ix->tree[IDX_POINTS], k) + counts[IDX_POINTS];
+}
+
+long str_utf8_at(const String s, size_t cp_index)
+{
+    size_t pos = str_utf8_offset(s, cp_index);
+    if (pos == STR_NPOS || pos >= s->length)
         return -1;
-    for (size_t i = start_pos; i < str_length(s); i++)
+
+    unsigned char c = (unsigned char)str_at(s, pos);
+    size_t len = c < 0x80 ? 1 : (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : 4;
+    long cp = len == 1 ? c : c & (0x7F >> len);
+    for (size_t k = 1; k < len; k++)
     {
-        if (str_at(s, i) == c)
-            return i;
+        if (pos + k >= s->length)
+            return -1;
+        cp = cp << 6 | ((unsigned char)str_at(s, pos + k) & 0x3F);
     }
-    return -1;
+    return cp;
 }
 
-bool str_replace_first(String s, const String old_str, const String new_str)
+bool str_utf8_insert(String s, size_t cp_index, const char *data, size_t len)
 {
-    if (!s || !old_str || !new_str)
+    if (!s || (!data && len > 0) || !utf8_valid((const unsigned char *)data, len))
         return false;
-    int pos = str_find_first(s, old_str, 0);
-    if (pos == -1)
+    size_t pos = str_utf8_offset(s, cp_index);
+    if (pos == STR_NPOS)
         return false;
-    size_t old_len = str_length(old_str);
-    str_delete(s, pos, old_len);
-    str_insert(s, pos, new_str);
-    return true;
+    StrEdit edit = {pos, 0, data, len};
+    return str_apply_edits(s, &edit, 1, NULL) == STR_OK;
 }
 
-int str_replace_all(String s, const String old_str, const String new_str)
+bool str_utf8_delete(String s, size_t cp_index, size_t cp_count)
 {
-    if (!s || !old_str || !new_str)
-        return -1;
-    int *pos = str_find_all(s, old_str, 0);
-    if (!pos || pos[0] == 0)
+    if (!s)
+        return false;
+    size_t start = str_utf8_offset(s, cp_index);
+    size_t total = str_utf8_length(s);
+    if (start == STR_NPOS || cp_count > total - cp_index)
+        return false;
+    size_t end = str_utf8_offset(s, cp_index + cp_count);
+    return str_delete(s, start, end - start);
+}
+
+int str_utf8_find(const String s, const String pattern, size_t start_cp)
+{
+    // UTF-8可自同步，按字节匹配的结果总是落在码点边界上
+    size_t start = str_utf8_offset(s, start_cp);
+    if (start == STR_NPOS)
         return -1;
-    size_t old_len = str_length(old_str);
-    for (int i = pos[0]; i > 0; i--)
+    int pos = str_find_first(s, pattern, start);
+    return pos < 0 ? -1 : (int)str_utf8_index(s, pos);
+}
+
+//-----Line Index-----
+
+// 原地插入删除后行首表失效，块索引仍有效；由str_track_lines()按块重新记录换行，O(n)
+static bool lines_ensure(String s)
+{
+    BlockIndex *ix = s->index;
+    if (!ix->track_lines || ix->lines_valid)
+        return ix->lines_valid;
+    char scratch[FRAME_RAW_MAX];
+    size_t pos = 0;
+    ix->line_count = 0;
+    ix->lines_valid = true;
+    for (size_t k = 0; k < ix->count && ix->lines_valid; k++)
     {
-        str_delete(s, pos[i], old_len);
-        str_insert(s, pos[i], new_str);
+        const Block *b = ix->blocks[k];
+        const char *data = block_bytes(b, scratch);
+        if (!data)
+            ix->lines_valid = false;
+        else
+            lines_record(ix, data, block_span(b), pos);
+        pos += block_span(b);
     }
-    free(pos);
-    return pos[0];
+    return ix->lines_valid;
+}
+
+bool str_track_lines(String s, bool enable)
+{
+    if (!s)
+        return false;
+    if (!enable)
+    {
+        if (s->index)
+        {
+            free(s->index->lines);
+            s->index->lines = NULL;
+            s->index->line_count = s->index->line_capacity = 0;
+            s->index->track_lines = s->index->lines_valid = false;
+        }
+        return true;
+    }
+    if (!index_ensure(s))
+        return false;
+    if (!s->index->track_lines)
+    {
+        s->index->track_lines = true;
+        index_invalidate(s); // 重建时一并生成行首表
+    }
+    return index_ensure(s) && lines_ensure(s);
+}
+
+size_t str_line_count(const String s)
+{
+    if (!s || !index_ensure(s))
+        return 0;
+    return fen_prefix(s->index->tree[IDX_LINES], s->index->count) + 1;
+}
+
+size_t str_line_start(const String s, size_t line)
+{
+    /*
+    time complexity: O(1) with an up-to-date line table, O(log n) otherwise
+    */
+    if (!s || !index_ensure(s))
+        return STR_NPOS;
+    BlockIndex *ix = s->index;
+    if (line == 0)
+        return 0;
+    if (ix->lines_valid)
+        return line <= ix->line_count ? ix->lines[line - 1] : STR_NPOS;
+    if (line > fen_prefix(ix->tree[IDX_LINES], ix->count))
+        return STR_NPOS;
+
+    // 第line个换行符所在的块
+    size_t before;
+    size_t k = fen_search(ix->tree[IDX_LINES], ix->count, line - 1, &before);
+    char scratch[FRAME_RAW_MAX];
+    const Block *b = ix->blocks[k];
+    const char *data = block_bytes(b, scratch);
+    if (!data)
+        return STR_NPOS;
+    size_t want = line - 1 - before;
+    for (size_t i = 0; i < block_span(b); i++)
+    {
+        if (data[i] == '\n' && want-- == 0)
+            return fen_prefix(ix->tree[IDX_BYTES], k) + i + 1;
+    }
+    return STR_NPOS;
+}
+
+size_t str_line_of(const String s, size_t pos)
+{
+    /*
+    time complexity: O(log n)
+    */
+    if (!s || pos > s->length || !index_ensure(s))
+        return STR_NPOS;
+    BlockIndex *ix = s->index;
+    if (pos == s->length)
+        return fen_prefix(ix->tree[IDX_LINES], ix->count);
+
+    size_t block_start;
+    size_t k = fen_search(ix->tree[IDX_BYTES], ix->count, pos, &block_start);
+    char scratch[FRAME_RAW_MAX];
+    const char *data = block_bytes(ix->blocks[k], scratch);
+    if (!data)
+        return STR_NPOS;
+    size_t counts[IDX_KINDS];
+    count_bytes(data, pos - block_start, counts);
+    return fen_prefix(ix->tree[IDX_LINES], k) + counts[IDX_LINES];
 }
 
 //-----Output-----
@@ -530,7 +3763,7 @@ void str_print(const String s, FILE *fp)
         return;
 
     Block *current = s->head;
-    while (current)
+    while (current && block_ready(s, current))
     {
         fwrite(current->data, sizeof(char), current->size, fp);
         current = current->next;
@@ -553,7 +3786,11 @@ void str_print_per_block(const String s, FILE *fp)
     while (current)
     {
         fprintf(fp, "Block %d: ", block_index++);
-        fwrite(current->data, sizeof(char), current->size, fp);
+        if (current->size == BLOCK_FROZEN)
+            fprintf(fp, "[frame %zu -> %zu bytes]", block_frame(current)->raw_len,
+                    block_frame(current)->comp_len);
+        else
+            fwrite(current->data, sizeof(char), current->size, fp);
         fprintf(fp, "\n");
         current = current->next;
     }
@@ -1,4 +1,5 @@
-#include "blockchain.h"
+#define STR_TRACE_WRAP // 菜单中的调用可录制成轨迹
+#include "str_trace.h"
 
 void test_function()
 {
@@ -182,9 +183,18 @@ void menu_string()
     }
 }
 
-int main()
+int main(int argc, char *argv[])
 {
     // test_function();
+    // 传入文件名时把本次操作录制成轨迹，可用str_replay回放
+    FILE *trace = argc > 1 ? fopen(argv[1], "w") : NULL;
+    if (trace)
+        str_trace_start(trace);
     menu_string();
+    if (trace)
+    {
+        str_trace_stop();
+        fclose(trace);
+    }
     return 0;
 }
\ No newline at end of file
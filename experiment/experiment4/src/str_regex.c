@@ -0,0 +1,1455 @@
+#include "str_regex.h"
+#include <stdint.h>
+#include <string.h>
+
+#define RE_MAX_INSTS 20000 // 程序规模上限，防止不可信模式耗尽内存
+#define RE_MAX_REPEAT 1000 // {m,n}中计数的上限
+#define RE_MAX_DEPTH 256   // 括号嵌套上限
+#define RE_MAX_NESTING 1024 // 编译时结点嵌套上限，括号外叠加的量词(如a***)也计入
+#define RE_MAX_STATES 2048 // DFA状态缓存上限，满后整体清空
+
+//-----Syntax Tree-----
+
+typedef enum
+{
+    N_EMPTY,
+    N_SET,    // 匹配一个属于集合的字节
+    N_CAT,    // a后接b
+    N_ALT,    // a或b，a优先
+    N_REPEAT, // a重复min到max次，max为-1表示不限
+    N_BEGIN,  // ^
+    N_END     // $
+} NodeType;
+
+typedef struct
+{
+    NodeType type;
+    int a, b;
+    int min, max;
+    bool greedy;
+    bool nullable; // 能匹配空串
+    int set;
+} Node;
+
+// 码点闭区间
+typedef struct
+{
+    uint32_t lo, hi;
+} Range;
+
+typedef struct
+{
+    uint8_t bits[32];
+} ByteSet;
+
+typedef struct
+{
+    const char *p;
+    Node *nodes;
+    int count, cap;
+    ByteSet *sets;
+    int nsets, set_cap;
+    int depth;
+    StrError error;
+} Parser;
+
+static int new_node(Parser *P, NodeType type, int a, int b)
+{
+    if (P->error != STR_OK)
+        return -1;
+    if (P->count == P->cap)
+    {
+        int cap = P->cap ? P->cap * 2 : 64;
+        Node *nodes = (Node *)realloc(P->nodes, sizeof(Node) * cap);
+        if (!nodes)
+        {
+            P->error = STR_ALLOC_FAILED;
+            return -1;
+        }
+        P->nodes = nodes;
+        P->cap = cap;
+    }
+    Node *n = &P->nodes[P->count];
+    n->type = type;
+    n->a = a;
+    n->b = b;
+    n->min = n->max = 0;
+    n->greedy = true;
+    n->nullable = type == N_EMPTY || type == N_BEGIN || type == N_END || type == N_REPEAT;
+    if (type == N_CAT)
+        n->nullable = P->nodes[a].nullable && P->nodes[b].nullable;
+    else if (type == N_ALT)
+        n->nullable = P->nodes[a].nullable || P->nodes[b].nullable;
+    n->set = -1;
+    return P->count++;
+}
+
+static int cat_node(Parser *P, int a, int b)
+{
+    if (a < 0)
+        return b;
+    if (b < 0)
+        return a;
+    return new_node(P, N_CAT, a, b);
+}
+
+static int alt_node(Parser *P, int a, int b)
+{
+    if (a < 0)
+        return b;
+    if (b < 0)
+        return a;
+    return new_node(P, N_ALT, a, b);
+}
+
+// 字节区间[lo, hi]对应的集合结点，相同集合只保存一份
+static int byte_range_node(Parser *P, unsigned lo, unsigned hi)
+{
+    ByteSet set = {{0}};
+    for (unsigned c = lo; c <= hi; c++)
+        set.bits[c >> 3] |= (uint8_t)(1u << (c & 7));
+
+    int id = 0;
+    while (id < P->nsets && memcmp(&P->sets[id], &set, sizeof(set)) != 0)
+        id++;
+    if (id == P->nsets)
+    {
+        if (P->nsets == P->set_cap)
+        {
+            int cap = P->set_cap ? P->set_cap * 2 : 16;
+            ByteSet *sets = (ByteSet *)realloc(P->sets, sizeof(ByteSet) * cap);
+            if (!sets)
+            {
+                P->error = STR_ALLOC_FAILED;
+                return -1;
+            }
+            P->sets = sets;
+            P->set_cap = cap;
+        }
+        P->sets[P->nsets++] = set;
+    }
+    int node = new_node(P, N_SET, -1, -1);
+    if (node >= 0)
+        P->nodes[node].set = id;
+    return node;
+}
+
+static int utf8_encode(uint32_t cp, unsigned char *out)
+{
+    if (cp < 0x80)
+    {
+        out[0] = (unsigned char)cp;
+        return 1;
+    }
+    if (cp < 0x800)
+    {
+        out[0] = (unsigned char)(0xC0 | cp >> 6);
+        out[1] = (unsigned char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000)
+    {
+        out[0] = (unsigned char)(0xE0 | cp >> 12);
+        out[1] = (unsigned char)(0x80 | (cp >> 6 & 0x3F));
+        out[2] = (unsigned char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (unsigned char)(0xF0 | cp >> 18);
+    out[1] = (unsigned char)(0x80 | (cp >> 12 & 0x3F));
+    out[2] = (unsigned char)(0x80 | (cp >> 6 & 0x3F));
+    out[3] = (unsigned char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// 把码点区间拆成若干字节区间序列，使每一段的各字节位置都是连续区间
+static void utf8_split(Parser *P, uint32_t lo, uint32_t hi, int *acc)
+{
+    static const uint32_t limits[] = {0x7F, 0x7FF, 0xFFFF};
+    if (lo > hi || P->error != STR_OK)
+        return;
+    // 按编码长度拆分
+    for (int i = 0; i < 3; i++)
+    {
+        if (lo <= limits[i] && hi > limits[i])
+        {
+            utf8_split(P, lo, limits[i], acc);
+            utf8_split(P, limits[i] + 1, hi, acc);
+            return;
+        }
+    }
+    // 按后续字节拆分，直到lo和hi只在可取满的低位上不同
+    for (int i = 1; i < 4; i++)
+    {
+        uint32_t m = (1u << (6 * i)) - 1;
+        if ((lo & ~m) != (hi & ~m))
+        {
+            if ((lo & m) != 0)
+            {
+                utf8_split(P, lo, lo | m, acc);
+                utf8_split(P, (lo | m) + 1, hi, acc);
+                return;
+            }
+            if ((hi & m) != m)
+            {
+                utf8_split(P, lo, (hi & ~m) - 1, acc);
+                utf8_split(P, hi & ~m, hi, acc);
+                return;
+            }
+        }
+    }
+    unsigned char a[4], b[4];
+    int n = utf8_encode(lo, a);
+    utf8_encode(hi, b);
+    int seq = -1;
+    for (int i = 0; i < n; i++)
+        seq = cat_node(P, seq, byte_range_node(P, a[i], b[i]));
+    *acc = alt_node(P, *acc, seq);
+}
+
+static int compare_ranges(const void *a, const void *b)
+{
+    const Range *r1 = (const Range *)a;
+    const Range *r2 = (const Range *)b;
+    return (r1->lo > r2->lo) - (r1->lo < r2->lo);
+}
+
+typedef struct
+{
+    Range *items;
+    int count, cap;
+} RangeList;
+
+static bool range_add(Parser *P, RangeList *list, uint32_t lo, uint32_t hi)
+{
+    if (list->count == list->cap)
+    {
+        int cap = list->cap ? list->cap * 2 : 8;
+        Range *items = (Range *)realloc(list->items, sizeof(Range) * cap);
+        if (!items)
+        {
+            P->error = STR_ALLOC_FAILED;
+            return false;
+        }
+        list->items = items;
+        list->cap = cap;
+    }
+    list->items[list->count].lo = lo;
+    list->items[list->count].hi = hi;
+    list->count++;
+    return true;
+}
+
+// 排序合并区间，negate时取补集
+static void range_normalize(Parser *P, RangeList *list, bool negate)
+{
+    if (list->count > 0)
+        qsort(list->items, list->count, sizeof(Range), compare_ranges);
+    int n = 0;
+    for (int i = 0; i < list->count; i++)
+    {
+        if (n > 0 && list->items[i].lo <= list->items[n - 1].hi + 1)
+        {
+            if (list->items[i].hi > list->items[n - 1].hi)
+                list->items[n - 1].hi = list->items[i].hi;
+        }
+        else
+        {
+            list->items[n++] = list->items[i];
+        }
+    }
+    list->count = n;
+    if (!negate)
+        return;
+
+    RangeList inverse = {NULL, 0, 0};
+    uint32_t next = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (list->items[i].lo > next)
+            range_add(P, &inverse, next, list->items[i].lo - 1);
+        next = list->items[i].hi + 1;
+    }
+    if (next <= 0x10FFFF)
+        range_add(P, &inverse, next, 0x10FFFF);
+    free(list->items);
+    *list = inverse;
+}
+
+static int class_node(Parser *P, RangeList *list)
+{
+    int acc = -1;
+    // ASCII部分合成一个字节集合
+    bool any_ascii = false;
+    ByteSet ascii = {{0}};
+    for (int i = 0; i < list->count && list->items[i].lo < 0x80; i++)
+    {
+        uint32_t hi = list->items[i].hi < 0x80 ? list->items[i].hi : 0x7F;
+        for (uint32_t c = list->items[i].lo; c <= hi; c++)
+            ascii.bits[c >> 3] |= (uint8_t)(1u << (c & 7));
+        any_ascii = true;
+    }
+    if (any_ascii)
+    {
+        // 连续区间直接复用byte_range_node，否则逐段合并
+        for (int i = 0; i < list->count && list->items[i].lo < 0x80; i++)
+        {
+            uint32_t hi = list->items[i].hi < 0x80 ? list->items[i].hi : 0x7F;
+            acc = alt_node(P, acc, byte_range_node(P, list->items[i].lo, hi));
+        }
+    }
+    for (int i = 0; i < list->count; i++)
+    {
+        if (list->items[i].hi >= 0x80)
+            utf8_split(P, list->items[i].lo < 0x80 ? 0x80 : list->items[i].lo, list->items[i].hi, &acc);
+    }
+    if (acc < 0)
+        P->error = STR_INVALID_PARAM; // 空集合，如[^\x00-\x{10FFFF}]
+    return acc;
+}
+
+// 预定义字符类\d \w \s
+static bool add_perl_class(Parser *P, RangeList *list, char c)
+{
+    RangeList tmp = {NULL, 0, 0};
+    switch (c)
+    {
+    case 'd':
+    case 'D':
+        range_add(P, &tmp, '0', '9');
+        break;
+    case 'w':
+    case 'W':
+        range_add(P, &tmp, '0', '9');
+        range_add(P, &tmp, 'A', 'Z');
+        range_add(P, &tmp, '_', '_');
+        range_add(P, &tmp, 'a', 'z');
+        break;
+    case 's':
+    case 'S':
+        range_add(P, &tmp, '\t', '\r');
+        range_add(P, &tmp, ' ', ' ');
+        break;
+    default:
+        return false;
+    }
+    range_normalize(P, &tmp, c >= 'A' && c <= 'Z');
+    for (int i = 0; i < tmp.count; i++)
+        range_add(P, list, tmp.items[i].lo, tmp.items[i].hi);
+    free(tmp.items);
+    return true;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// 读取一个字面码点(已处理转义)，非法UTF-8按单个字节处理
+static bool parse_char(Parser *P, uint32_t *cp)
+{
+    const unsigned char *p = (const unsigned char *)P->p;
+    if (*p == '\\')
+    {
+        char c = (char)p[1];
+        if (c == '\0')
+            return false; // 模式末尾的'\'，不越过结束符
+        P->p += 2;
+        switch (c)
+        {
+        case 'n':
+            *cp = '\n';
+            return true;
+        case 't':
+            *cp = '\t';
+            return true;
+        case 'r':
+            *cp = '\r';
+            return true;
+        case 'f':
+            *cp = '\f';
+            return true;
+        case 'v':
+            *cp = '\v';
+            return true;
+        case 'x':
+        {
+            int h = hex_value(P->p[0]), l = h < 0 ? -1 : hex_value(P->p[1]);
+            if (l < 0)
+                return false;
+            *cp = (uint32_t)(h << 4 | l);
+            P->p += 2;
+            return true;
+        }
+        default:
+            // 只允许转义标点，字母数字转义保留给将来扩展
+            if (c == '\0' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+                return false;
+            *cp = (unsigned char)c;
+            return true;
+        }
+    }
+
+    size_t len = *p < 0x80 ? 1 : (*p & 0xE0) == 0xC0 ? 2 : (*p & 0xF0) == 0xE0 ? 3 : (*p & 0xF8) == 0xF0 ? 4 : 0;
+    uint32_t value = len == 1 ? *p : *p & (0x7F >> len);
+    for (size_t k = 1; k < len; k++)
+    {
+        if ((p[k] & 0xC0) != 0x80)
+        {
+            len = 0;
+            break;
+        }
+        value = value << 6 | (p[k] & 0x3F);
+    }
+    if (len == 0)
+    {
+        len = 1;
+        value = *p;
+    }
+    P->p += len;
+    *cp = value;
+    return true;
+}
+
+static int parse_class(Parser *P)
+{
+    P->p++; // '['
+    bool negate = false;
+    if (*P->p == '^')
+    {
+        negate = true;
+        P->p++;
+    }
+    RangeList list = {NULL, 0, 0};
+    bool first = true;
+    while (*P->p && (*P->p != ']' || first))
+    {
+        first = false;
+        if (P->p[0] == '\\' && add_perl_class(P, &list, P->p[1]))
+        {
+            P->p += 2;
+            continue;
+        }
+        uint32_t lo, hi;
+        if (!parse_char(P, &lo))
+        {
+            P->error = STR_INVALID_PARAM;
+            break;
+        }
+        hi = lo;
+        if (P->p[0] == '-' && P->p[1] && P->p[1] != ']')
+        {
+            P->p++;
+            if (!parse_char(P, &hi) || hi < lo)
+            {
+                P->error = STR_INVALID_PARAM;
+                break;
+            }
+        }
+        range_add(P, &list, lo, hi);
+    }
+    if (*P->p == ']')
+        P->p++;
+    else if (P->error == STR_OK)
+        P->error = STR_INVALID_PARAM;
+
+    int node = -1;
+    if (P->error == STR_OK)
+    {
+        range_normalize(P, &list, negate);
+        node = class_node(P, &list);
+    }
+    free(list.items);
+    return node;
+}
+
+static int parse_alt(Parser *P);
+
+static int parse_atom(Parser *P)
+{
+    char c = *P->p;
+    if (c == '(')
+    {
+        if (++P->depth > RE_MAX_DEPTH)
+        {
+            P->error = STR_INVALID_PARAM;
+            return -1;
+        }
+        P->p++;
+        if (P->p[0] == '?' && P->p[1] == ':')
+            P->p += 2;
+        int node = parse_alt(P);
+        if (P->error != STR_OK || *P->p != ')')
+        {
+            P->error = STR_INVALID_PARAM;
+            return -1;
+        }
+        P->p++;
+        P->depth--;
+        return node < 0 ? new_node(P, N_EMPTY, -1, -1) : node;
+    }
+    if (c == '[')
+        return parse_class(P);
+    if (c == '^' || c == '$')
+    {
+        P->p++;
+        return new_node(P, c == '^' ? N_BEGIN : N_END, -1, -1);
+    }
+
+    RangeList list = {NULL, 0, 0};
+    int node = -1;
+    if (c == '.')
+    {
+        P->p++;
+        range_add(P, &list, 0, '\n' - 1);
+        range_add(P, &list, '\n' + 1, 0x10FFFF);
+        node = class_node(P, &list);
+    }
+    else if (c == '\\' && add_perl_class(P, &list, P->p[1]))
+    {
+        P->p += 2;
+        range_normalize(P, &list, false);
+        node = class_node(P, &list);
+    }
+    else
+    {
+        // 字面量按原始字节序列匹配
+        const char *begin = P->p;
+        uint32_t cp;
+        if (!parse_char(P, &cp))
+        {
+            P->error = STR_INVALID_PARAM;
+            return -1;
+        }
+        unsigned char bytes[4];
+        int n = c == '\\' || (unsigned char)c < 0x80 ? utf8_encode(cp, bytes) : (int)(P->p - begin);
+        if (n > 4 || (c == '\\' && cp >= 0x80))
+        {
+            // \xHH表示单个字节
+            n = 1;
+            bytes[0] = (unsigned char)cp;
+        }
+        else if (c != '\\' && (unsigned char)c >= 0x80)
+        {
+            memcpy(bytes, begin, n);
+        }
+        for (int i = 0; i < n; i++)
+            node = cat_node(P, node, byte_range_node(P, bytes[i], bytes[i]));
+    }
+    free(list.items);
+    return node;
+}
+
+static bool parse_count(Parser *P, int *value)
+{
+    if (*P->p < '0' || *P->p > '9')
+        return false;
+    long v = 0;
+    while (*P->p >= '0' && *P->p <= '9')
+    {
+        v = v * 10 + (*P->p++ - '0');
+        if (v > RE_MAX_REPEAT)
+            return false;
+    }
+    *value = (int)v;
+    return true;
+}
+
+static int parse_repeat(Parser *P)
+{
+    int atom = parse_atom(P);
+    while (P->error == STR_OK)
+    {
+        int min, max;
+        char c = *P->p;
+        if (c == '*')
+            min = 0, max = -1;
+        else if (c == '+')
+            min = 1, max = -1;
+        else if (c == '?')
+            min = 0, max = 1;
+        else if (c == '{')
+        {
+            P->p++;
+            if (!parse_count(P, &min))
+            {
+                P->error = STR_INVALID_PARAM;
+                return -1;
+            }
+            max = min;
+            if (*P->p == ',')
+            {
+                P->p++;
+                max = -1;
+                if (*P->p != '}' && (!parse_count(P, &max) || max < min))
+                {
+                    P->error = STR_INVALID_PARAM;
+                    return -1;
+                }
+            }
+            if (*P->p != '}')
+            {
+                P->error = STR_INVALID_PARAM;
+                return -1;
+            }
+        }
+        else
+            break;
+        P->p++;
+        if (atom < 0)
+        {
+            P->error = STR_INVALID_PARAM; // 量词前没有可重复的内容
+            return -1;
+        }
+        int node = new_node(P, N_REPEAT, atom, -1);
+        if (node < 0)
+            return -1;
+        P->nodes[node].min = min;
+        P->nodes[node].max = max;
+        P->nodes[node].nullable = min == 0 || P->nodes[atom].nullable;
+        if (*P->p == '?')
+        {
+            P->nodes[node].greedy = false;
+            P->p++;
+        }
+        atom = node;
+    }
+    return atom;
+}
+
+static int parse_concat(Parser *P)
+{
+    int node = -1;
+    while (P->error == STR_OK && *P->p && *P->p != '|' && *P->p != ')')
+    {
+        if (*P->p == '*' || *P->p == '+' || *P->p == '?' || *P->p == '{')
+        {
+            P->error = STR_INVALID_PARAM;
+            return -1;
+        }
+        node = cat_node(P, node, parse_repeat(P));
+    }
+    return node;
+}
+
+static int parse_alt(Parser *P)
+{
+    int node = parse_concat(P);
+    if (node < 0)
+        node = new_node(P, N_EMPTY, -1, -1);
+    while (P->error == STR_OK && *P->p == '|')
+    {
+        P->p++;
+        int rhs = parse_concat(P);
+        if (rhs < 0)
+            rhs = new_node(P, N_EMPTY, -1, -1);
+        node = alt_node(P, node, rhs);
+    }
+    return node;
+}
+
+//-----Program-----
+
+typedef enum
+{
+    I_SET,   // 消耗一个属于集合的字节，然后到pc+1
+    I_SPLIT, // 分叉到x和y，x优先
+    I_JMP,   // 跳到x
+    I_MATCH,
+    I_BEGIN, // 扫描起点断言
+    I_END    // 扫描终点断言
+} InstOp;
+
+typedef struct
+{
+    InstOp op;
+    int x, y;
+    int set;
+} Inst;
+
+typedef struct
+{
+    Inst *insts;
+    int count, cap;
+} Prog;
+
+static int emit(Prog *g, InstOp op, int set)
+{
+    if (g->count >= RE_MAX_INSTS)
+        return -1;
+    if (g->count == g->cap)
+    {
+        int cap = g->cap ? g->cap * 2 : 64;
+        Inst *insts = (Inst *)realloc(g->insts, sizeof(Inst) * cap);
+        if (!insts)
+            return -1;
+        g->insts = insts;
+        g->cap = cap;
+    }
+    Inst *in = &g->insts[g->count];
+    in->op = op;
+    in->x = in->y = g->count + 1;
+    in->set = set;
+    return g->count++;
+}
+
+// 连接和选择在解析时向左嵌套，如((a b) c) d，链长随模式长度增长。
+// 沿左侧展开成从左到右的操作数数组，编译时逐个处理，递归深度只受括号和量词嵌套限制
+static int *spine_items(const Parser *P, int node, int *count)
+{
+    NodeType type = P->nodes[node].type;
+    int n = 1;
+    for (int k = node; P->nodes[k].type == type; k = P->nodes[k].a)
+        n++;
+    int *items = (int *)malloc(sizeof(int) * n);
+    if (!items)
+        return NULL;
+    int k = node;
+    for (int i = n - 1; i > 0; i--, k = P->nodes[k].a)
+        items[i] = P->nodes[k].b;
+    items[0] = k;
+    *count = n;
+    return items;
+}
+
+// 生成结点代码，执行完后顺序落到下一条指令；reverse为真时生成反向匹配的程序
+static bool compile_node(const Parser *P, Prog *g, int node, bool reverse, int depth)
+{
+    const Node *n = &P->nodes[node];
+    if (depth > RE_MAX_NESTING)
+        return false;
+    switch (n->type)
+    {
+    case N_EMPTY:
+        return true;
+    case N_SET:
+        return emit(g, I_SET, n->set) >= 0;
+    case N_BEGIN:
+    case N_END:
+        // 反向扫描从匹配终点出发，^与$的角色互换
+        return emit(g, (n->type == N_BEGIN) != reverse ? I_BEGIN : I_END, -1) >= 0;
+    case N_CAT:
+    {
+        int count;
+        int *items = spine_items(P, node, &count);
+        bool ok = items != NULL;
+        for (int i = 0; i < count && ok; i++)
+            ok = compile_node(P, g, items[reverse ? count - 1 - i : i], reverse, depth + 1);
+        free(items);
+        return ok;
+    }
+    case N_ALT:
+    {
+        // SPLIT a1 JMP SPLIT a2 JMP ... ak，未定的JMP借x串成链表，最后统一指向出口
+        int count;
+        int *items = spine_items(P, node, &count);
+        bool ok = items != NULL;
+        int jumps = -1;
+        for (int i = 0; i < count - 1 && ok; i++)
+        {
+            int split = emit(g, I_SPLIT, -1);
+            ok = split >= 0 && compile_node(P, g, items[i], reverse, depth + 1);
+            int jmp = ok ? emit(g, I_JMP, -1) : -1;
+            ok = jmp >= 0;
+            if (ok)
+            {
+                g->insts[jmp].x = jumps;
+                jumps = jmp;
+                g->insts[split].y = g->count;
+            }
+        }
+        ok = ok && compile_node(P, g, items[count - 1], reverse, depth + 1);
+        while (ok && jumps >= 0)
+        {
+            int next = g->insts[jumps].x;
+            g->insts[jumps].x = g->count;
+            jumps = next;
+        }
+        free(items);
+        return ok;
+    }
+    case N_REPEAT:
+    {
+        // 不限次数且min>0时，最后一份必需的副本兼作循环体
+        int copies = n->max < 0 && n->min > 0 ? n->min - 1 : n->min;
+        for (int i = 0; i < copies; i++)
+        {
+            if (!compile_node(P, g, n->a, reverse, depth + 1))
+                return false;
+        }
+        if (n->max < 0 && (n->min > 0 || P->nodes[n->a].nullable))
+        {
+            // a+ 生成 L: a SPLIT(L, 出口)；循环体可空的a*按(a+)?生成(同RE2)。
+            // 空迭代回到本次已访问过的指令而终止，本次迭代中更低优先级的分支
+            // 排在退出之后，与回溯引擎拒绝空迭代的结果一致：(a??)+ 在"aa"上匹配空串
+            int quest = n->min == 0 ? emit(g, I_SPLIT, -1) : -1;
+            int body = g->count;
+            if ((n->min == 0 && quest < 0) || !compile_node(P, g, n->a, reverse, depth + 1))
+                return false;
+            int split = emit(g, I_SPLIT, -1);
+            if (split < 0)
+                return false;
+            g->insts[split].x = n->greedy ? body : split + 1;
+            g->insts[split].y = n->greedy ? split + 1 : body;
+            if (quest >= 0)
+            {
+                g->insts[quest].x = n->greedy ? body : split + 1;
+                g->insts[quest].y = n->greedy ? split + 1 : body;
+            }
+            return true;
+        }
+        if (n->max < 0)
+        {
+            int split = emit(g, I_SPLIT, -1);
+            if (split < 0 || !compile_node(P, g, n->a, reverse, depth + 1))
+                return false;
+            int jmp = emit(g, I_JMP, -1);
+            if (jmp < 0)
+                return false;
+            g->insts[jmp].x = split;
+            g->insts[split].x = n->greedy ? split + 1 : g->count;
+            g->insts[split].y = n->greedy ? g->count : split + 1;
+            return true;
+        }
+        // 可选部分嵌套展开为 (a(a(a)?)?)?，所有分叉跳到同一出口
+        int first = g->count;
+        for (int i = n->min; i < n->max; i++)
+        {
+            if (emit(g, I_SPLIT, -1) < 0 || !compile_node(P, g, n->a, reverse, depth + 1))
+                return false;
+        }
+        for (int pc = first; pc < g->count; pc++)
+        {
+            Inst *in = &g->insts[pc];
+            if (in->op == I_SPLIT && in->x == pc + 1 && in->y == pc + 1)
+            {
+                in->x = n->greedy ? pc + 1 : g->count;
+                in->y = n->greedy ? g->count : pc + 1;
+            }
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+//-----Lazy DFA-----
+
+typedef struct DState
+{
+    struct DState *hash_next;
+    uint32_t hash;
+    bool match;               // 线程列表中含MATCH
+    signed char end_match;    // 扫描到终点时是否匹配，-1表示未计算
+    int n;                    // 线程数，0表示死状态
+    int *insts;               // 按优先级排列的线程
+    struct DState **next;     // 每个字节类一个转移，NULL表示未计算
+} DState;
+
+typedef struct
+{
+    Prog prog;
+    int start;         // 程序入口
+    bool longest;      // true: 保留所有线程(反向找最长)，false: 最左优先，匹配后截断
+    DState **buckets;
+    size_t nbuckets;
+    size_t nstates;
+    DState *start_state[2]; // 下标表示扫描起点断言是否成立
+    int *stack;
+    int *list;
+    unsigned *mark;
+    unsigned gen;
+} Dfa;
+
+struct StrRegex
+{
+    ByteSet *sets;
+    int nsets;
+    unsigned char classmap[256]; // 字节 -> 字节类
+    unsigned char rep[256];      // 字节类 -> 代表字节
+    int nclasses;
+    Dfa fwd; // 非锚定正向程序，找最左优先匹配的终点
+    Dfa rev; // 锚定反向程序，从终点向前找起点
+};
+
+static bool set_has(const ByteSet *set, unsigned char c)
+{
+    return set->bits[c >> 3] >> (c & 7) & 1;
+}
+
+// 按所有集合细分字节，同一类中的字节在任何指令上表现相同
+static void build_classes(StrRegex re)
+{
+    memset(re->classmap, 0, sizeof(re->classmap));
+    int n = 1;
+    for (int s = 0; s < re->nsets; s++)
+    {
+        int in_map[256], out_map[256];
+        for (int i = 0; i < n; i++)
+            in_map[i] = out_map[i] = -1;
+        int m = 0;
+        for (int c = 0; c < 256; c++)
+        {
+            int *map = set_has(&re->sets[s], (unsigned char)c) ? in_map : out_map;
+            int old = re->classmap[c];
+            if (map[old] < 0)
+                map[old] = m++;
+            re->classmap[c] = (unsigned char)map[old];
+        }
+        n = m;
+    }
+    re->nclasses = n;
+    for (int c = 255; c >= 0; c--)
+        re->rep[re->classmap[c]] = (unsigned char)c;
+}
+
+static void dfa_flush(Dfa *d)
+{
+    for (size_t i = 0; i < d->nbuckets; i++)
+    {
+        DState *st = d->buckets[i];
+        while (st)
+        {
+            DState *next = st->hash_next;
+            free(st);
+            st = next;
+        }
+        d->buckets[i] = NULL;
+    }
+    d->nstates = 0;
+    d->start_state[0] = d->start_state[1] = NULL;
+}
+
+static bool dfa_init(Dfa *d, bool longest)
+{
+    int n = d->prog.count;
+    d->longest = longest;
+    d->nbuckets = 1024;
+    d->buckets = (DState **)calloc(d->nbuckets, sizeof(DState *));
+    d->stack = (int *)malloc(sizeof(int) * (2 * n + 2));
+    d->list = (int *)malloc(sizeof(int) * (n + 1));
+    d->mark = (unsigned *)calloc(n, sizeof(unsigned));
+    d->gen = 0;
+    return d->buckets && d->stack && d->list && d->mark;
+}
+
+static void dfa_free(Dfa *d)
+{
+    if (d->buckets)
+        dfa_flush(d);
+    free(d->buckets);
+    free(d->stack);
+    free(d->list);
+    free(d->mark);
+    free(d->prog.insts);
+}
+
+static void dfa_new_gen(Dfa *d)
+{
+    if (++d->gen == 0)
+    {
+        memset(d->mark, 0, sizeof(unsigned) * d->prog.count);
+        d->gen = 1;
+    }
+}
+
+// 从pc沿空转移展开，按优先级把线程追加到list
+// 最左优先模式遇到MATCH时返回true，其后更低优先级的线程全部丢弃
+static bool closure(Dfa *d, int pc, bool at_begin, bool at_end, int *n)
+{
+    int top = 0;
+    d->stack[top++] = pc;
+    while (top > 0)
+    {
+        pc = d->stack[--top];
+        if (d->mark[pc] == d->gen)
+            continue;
+        d->mark[pc] = d->gen;
+        const Inst *in = &d->prog.insts[pc];
+        switch (in->op)
+        {
+        case I_JMP:
+            d->stack[top++] = in->x;
+            break;
+        case I_SPLIT:
+            d->stack[top++] = in->y;
+            d->stack[top++] = in->x;
+            break;
+        case I_BEGIN:
+            if (at_begin)
+                d->stack[top++] = pc + 1;
+            break;
+        case I_END:
+            if (at_end)
+                d->stack[top++] = pc + 1;
+            else
+                d->list[(*n)++] = pc; // 留到扫描终点再判断
+            break;
+        case I_SET:
+            d->list[(*n)++] = pc;
+            break;
+        case I_MATCH:
+            d->list[(*n)++] = pc;
+            if (!d->longest)
+                return true;
+            break;
+        }
+    }
+    return false;
+}
+
+// 查找或创建线程列表为d->list[0..n)的状态，缓存满时返回NULL
+static DState *dfa_state(Dfa *d, const StrRegex re, int n)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < n; i++)
+        h = (h ^ (uint32_t)d->list[i]) * 16777619u;
+    size_t bucket = h % d->nbuckets;
+    for (DState *st = d->buckets[bucket]; st; st = st->hash_next)
+    {
+        if (st->hash == h && st->n == n && memcmp(st->insts, d->list, sizeof(int) * n) == 0)
+            return st;
+    }
+    if (d->nstates >= RE_MAX_STATES)
+        return NULL;
+
+    size_t next_bytes = sizeof(DState *) * re->nclasses;
+    DState *st = (DState *)malloc(sizeof(DState) + next_bytes + sizeof(int) * n);
+    if (!st)
+        return NULL;
+    st->next = (DState **)(st + 1);
+    st->insts = (int *)((char *)st->next + next_bytes);
+    memset(st->next, 0, next_bytes);
+    memcpy(st->insts, d->list, sizeof(int) * n);
+    st->n = n;
+    st->hash = h;
+    st->end_match = -1;
+    st->match = false;
+    for (int i = 0; i < n; i++)
+        st->match |= d->prog.insts[d->list[i]].op == I_MATCH;
+    st->hash_next = d->buckets[bucket];
+    d->buckets[bucket] = st;
+    d->nstates++;
+    return st;
+}
+
+// 缓存满时清空后重建，仍失败说明内存不足
+static DState *dfa_state_or_flush(Dfa *d, const StrRegex re, int n)
+{
+    DState *st = dfa_state(d, re, n);
+    if (!st)
+    {
+        dfa_flush(d);
+        st = dfa_state(d, re, n);
+    }
+    return st;
+}
+
+static DState *dfa_start(Dfa *d, const StrRegex re, bool at_begin)
+{
+    if (!d->start_state[at_begin])
+    {
+        int n = 0;
+        dfa_new_gen(d);
+        closure(d, d->start, at_begin, false, &n);
+        d->start_state[at_begin] = dfa_state_or_flush(d, re, n);
+    }
+    return d->start_state[at_begin];
+}
+
+static DState *dfa_step(Dfa *d, const StrRegex re, DState *st, unsigned char c)
+{
+    int cls = re->classmap[c];
+    if (st->next[cls])
+        return st->next[cls];
+
+    int n = 0;
+    dfa_new_gen(d);
+    for (int i = 0; i < st->n; i++)
+    {
+        const Inst *in = &d->prog.insts[st->insts[i]];
+        if (in->op == I_SET && set_has(&re->sets[in->set], re->rep[cls]) &&
+            closure(d, st->insts[i] + 1, false, false, &n))
+            break;
+    }
+    DState *next = dfa_state(d, re, n);
+    if (next)
+    {
+        st->next[cls] = next;
+        return next;
+    }
+    // 缓存已满：st会随缓存一起释放，只保留新状态
+    dfa_flush(d);
+    return dfa_state(d, re, n);
+}
+
+// 到达扫描终点时，$等待中的线程能否到达MATCH；at_begin表示终点同时也是起点
+static bool dfa_end_match(Dfa *d, DState *st, bool at_begin)
+{
+    if (st->end_match >= 0 && !at_begin)
+        return st->end_match;
+    bool match = false;
+    for (int i = 0; i < st->n && !match; i++)
+    {
+        const Inst *in = &d->prog.insts[st->insts[i]];
+        if (in->op == I_MATCH)
+            match = true;
+        else if (in->op == I_END)
+        {
+            int n = 0;
+            dfa_new_gen(d);
+            closure(d, st->insts[i] + 1, at_begin, true, &n);
+            for (int k = 0; k < n && !match; k++)
+                match = d->prog.insts[d->list[k]].op == I_MATCH;
+        }
+    }
+    // 起点处的结果只在空扫描时用到，不缓存
+    if (!at_begin)
+        st->end_match = match;
+    return match;
+}
+
+//-----Compile-----
+
+static bool build_program(const Parser *P, int root, Dfa *d, bool reverse)
+{
+    Prog *g = &d->prog;
+    if (!reverse)
+    {
+        // 非锚定前缀 .*? ，优先尝试模式本身；集合0是编译开始时加入的全集
+        int split = emit(g, I_SPLIT, -1);
+        emit(g, I_SET, 0);
+        int jmp = emit(g, I_JMP, -1);
+        if (jmp < 0)
+            return false;
+        g->insts[split].x = jmp + 1;
+        g->insts[split].y = split + 1;
+        g->insts[jmp].x = split;
+    }
+    d->start = 0;
+    return compile_node(P, g, root, reverse, 0) && emit(g, I_MATCH, -1) >= 0;
+}
+
+StrRegex str_regex_compile(const char *pattern, StrError *err)
+{
+    StrError dummy;
+    if (!err)
+        err = &dummy;
+    *err = STR_INVALID_PARAM;
+    if (!pattern)
+        return NULL;
+
+    Parser P = {pattern, NULL, 0, 0, NULL, 0, 0, 0, STR_OK};
+    // 预先加入全集(集合0)，供非锚定前缀使用
+    byte_range_node(&P, 0, 255);
+    int root = parse_alt(&P);
+    if (P.error == STR_OK && *P.p != '\0')
+        P.error = STR_INVALID_PARAM; // 多余的')'
+
+    StrRegex re = NULL;
+    if (P.error == STR_OK)
+        re = (StrRegex)calloc(1, sizeof(struct StrRegex));
+    if (re)
+    {
+        re->sets = P.sets;
+        re->nsets = P.nsets;
+        P.sets = NULL;
+        build_classes(re);
+        if (!build_program(&P, root, &re->fwd, false) || !build_program(&P, root, &re->rev, true))
+            P.error = STR_INVALID_PARAM;
+        else if (!dfa_init(&re->fwd, false) || !dfa_init(&re->rev, true))
+            P.error = STR_ALLOC_FAILED;
+    }
+    else if (P.error == STR_OK)
+    {
+        P.error = STR_ALLOC_FAILED;
+    }
+
+    free(P.nodes);
+    free(P.sets);
+    *err = P.error;
+    if (P.error != STR_OK)
+        str_regex_destroy(&re);
+    return re;
+}
+
+void str_regex_destroy(StrRegex *re)
+{
+    if (!re || !*re)
+        return;
+    dfa_free(&(*re)->fwd);
+    dfa_free(&(*re)->rev);
+    free((*re)->sets);
+    free(*re);
+    *re = NULL;
+}
+
+//-----Search-----
+
+// 正向扫描经过的块片段，反向找起点和定位下一次搜索的起点时使用
+typedef struct
+{
+    const char *data;
+    size_t len;
+    size_t pos;
+    StrCursor at; // 位于片段起点的游标
+} Chunk;
+
+typedef struct
+{
+    Chunk *items;
+    size_t count, cap;
+} ChunkLog;
+
+static bool log_push(ChunkLog *log, const StrCursor *at, const char *data, size_t len)
+{
+    if (log->count == log->cap)
+    {
+        size_t cap = log->cap ? log->cap * 2 : 16;
+        Chunk *items = (Chunk *)realloc(log->items, sizeof(Chunk) * cap);
+        if (!items)
+            return false;
+        log->items = items;
+        log->cap = cap;
+    }
+    log->items[log->count].data = data;
+    log->items[log->count].len = len;
+    log->items[log->count].pos = str_cursor_pos(at);
+    log->items[log->count].at = *at;
+    log->count++;
+    return true;
+}
+
+// 把游标移到pos，pos须落在最近一次正向扫描记录的片段中(或就是扫描起点)
+static void log_seek(const ChunkLog *log, StrCursor *cur, size_t pos)
+{
+    for (size_t i = log->count; i > 0; i--)
+    {
+        if (log->items[i - 1].pos <= pos)
+        {
+            *cur = log->items[i - 1].at;
+            break;
+        }
+    }
+    str_cursor_advance(cur, pos - str_cursor_pos(cur));
+}
+
+// 返回从游标from起最左优先匹配的终点，没有匹配返回STR_NPOS
+static size_t forward_scan(StrRegex re, const StrCursor *from, ChunkLog *log)
+{
+    Dfa *d = &re->fwd;
+    size_t pos = str_cursor_pos(from);
+    DState *st = dfa_start(d, re, pos == 0);
+    if (!st)
+        return STR_NPOS;
+    size_t last = st->match ? pos : STR_NPOS;
+
+    StrCursor cur = *from;
+    size_t len;
+    const char *p;
+    log->count = 0;
+    while ((p = str_cursor_chunk(&cur, &len)) != NULL)
+    {
+        if (!log_push(log, &cur, p, len))
+            return STR_NPOS;
+        for (size_t i = 0; i < len; i++)
+        {
+            st = dfa_step(d, re, st, (unsigned char)p[i]);
+            pos++;
+            if (!st || st->n == 0)
+                return last;
+            if (st->match)
+                last = pos;
+            else if (last == STR_NPOS && st == d->start_state[0] && log->count > 1)
+            {
+                // 回到初始状态，之前的片段通常不再需要，反向扫描缺片段时会重新收集
+                log->items[0] = log->items[log->count - 1];
+                log->count = 1;
+            }
+        }
+        str_cursor_advance(&cur, len);
+    }
+    if (dfa_end_match(d, st, pos == 0))
+        last = pos;
+    return last;
+}
+
+// 从终点end向前扫描到游标from的位置，返回匹配的最小起点
+static size_t reverse_scan(StrRegex re, const String s, const ChunkLog *log, size_t end, const StrCursor *from)
+{
+    size_t lower = str_cursor_pos(from);
+    Dfa *d = &re->rev;
+    DState *st = dfa_start(d, re, end == str_length(s));
+    if (!st)
+        return STR_NPOS;
+    size_t best = st->match ? end : STR_NPOS;
+    size_t pos = end;
+    const ChunkLog *chunks = log;
+    ChunkLog refill = {NULL, 0, 0};
+    size_t ci = log->count;
+    while (ci > 0 && log->items[ci - 1].pos >= end)
+        ci--;
+    while (pos > lower)
+    {
+        if (ci == 0)
+        {
+            // 正向扫描裁剪过记录，从lower重新收集到pos为止的片段
+            if (chunks == &refill)
+                break;
+            StrCursor cur = *from;
+            size_t len;
+            const char *p;
+            while (str_cursor_pos(&cur) < pos && (p = str_cursor_chunk(&cur, &len)) != NULL)
+            {
+                if (!log_push(&refill, &cur, p, len))
+                    break;
+                str_cursor_advance(&cur, len);
+            }
+            chunks = &refill;
+            ci = refill.count;
+            while (ci > 0 && refill.items[ci - 1].pos >= pos)
+                ci--;
+            if (ci == 0)
+                break;
+        }
+        const Chunk *c = &chunks->items[--ci];
+        size_t i = pos - c->pos;
+        size_t stop = lower > c->pos ? lower - c->pos : 0;
+        while (i > stop)
+        {
+            i--;
+            pos--;
+            st = dfa_step(d, re, st, (unsigned char)c->data[i]);
+            if (!st || st->n == 0)
+            {
+                free(refill.items);
+                return best;
+            }
+            if (st->match)
+                best = pos;
+        }
+    }
+    free(refill.items);
+    if (pos == 0 && dfa_end_match(d, st, end == 0 && str_length(s) == 0))
+        best = 0;
+    return best;
+}
+
+static bool regex_search(StrRegex re, const String s, const StrCursor *from, ChunkLog *log, StrMatch *match)
+{
+    size_t end = forward_scan(re, from, log);
+    if (end == STR_NPOS)
+        return false;
+    size_t start = reverse_scan(re, s, log, end, from);
+    if (start == STR_NPOS)
+        return false;
+    match->start = start;
+    match->end = end;
+    return true;
+}
+
+bool str_regex_find_first(StrRegex re, const String s, size_t start_pos, StrMatch *match)
+{
+    if (!re || !s || start_pos > str_length(s))
+        return false;
+    ChunkLog log = {NULL, 0, 0};
+    StrMatch m;
+    StrCursor cur;
+    str_cursor_init(&cur, s, start_pos);
+    bool found = regex_search(re, s, &cur, &log, &m);
+    free(log.items);
+    if (found && match)
+        *match = m;
+    return found;
+}
+
+StrMatch *str_regex_find_all(StrRegex re, const String s, size_t start_pos, size_t *count)
+{
+    /*
+    time complexity: O(n) plus the read-ahead past each match end, which the
+    next attempt scans again. The read-ahead is not bounded: a higher-priority
+    alternative that stays alive (e.g. [a-z]*X|a over letters) reads to the
+    end on every match, O(n^2) worst case. Every attempt resumes from a
+    cursor kept in the chunk log instead of locating its start from the head
+    */
+    *count = 0;
+    if (!re || !s || start_pos > str_length(s))
+        return NULL;
+
+    ChunkLog log = {NULL, 0, 0};
+    StrMatch *matches = NULL;
+    size_t cap = 0;
+    StrCursor cur;
+    str_cursor_init(&cur, s, start_pos);
+    StrMatch m;
+    while (regex_search(re, s, &cur, &log, &m))
+    {
+        if (*count == cap)
+        {
+            cap = cap ? cap * 2 : 16;
+            StrMatch *grown = (StrMatch *)realloc(matches, sizeof(StrMatch) * cap);
+            if (!grown)
+            {
+                free(matches);
+                free(log.items);
+                *count = 0;
+                return NULL;
+            }
+            matches = grown;
+        }
+        matches[(*count)++] = m;
+        log_seek(&log, &cur, m.end);
+        if (m.end == m.start)
+        {
+            // 空匹配后前进一个完整字符
+            if (str_cursor_next(&cur) < 0)
+                break;
+            size_t len;
+            const char *p;
+            while ((p = str_cursor_chunk(&cur, &len)) != NULL && ((unsigned char)*p & 0xC0) == 0x80)
+                str_cursor_advance(&cur, 1);
+        }
+    }
+    free(log.items);
+    return matches;
+}
+
+int str_regex_replace_all(String s, StrRegex re, const String replacement)
+{
+    if (!s || !re || !replacement)
+        return -1;
+    size_t count;
+    StrMatch *matches = str_regex_find_all(re, s, 0, &count);
+    if (!matches)
+        return 0;
+
+    size_t text_len = str_length(replacement);
+    char *text = (char *)malloc(text_len + 1);
+    StrEdit *edits = (StrEdit *)malloc(sizeof(StrEdit) * count);
+    int result = -1;
+    if (text && edits)
+    {
+        StrCursor cur;
+        str_cursor_init(&cur, replacement, 0);
+        for (size_t i = 0; i < text_len; i++)
+            text[i] = (char)str_cursor_next(&cur);
+        for (size_t i = 0; i < count; i++)
+        {
+            edits[i].pos = matches[i].start;
+            edits[i].delete_len = matches[i].end - matches[i].start;
+            edits[i].insert_text = text;
+            edits[i].insert_len = text_len;
+        }
+        if (str_apply_edits(s, edits, count, NULL) == STR_OK)
+            result = (int)count;
+    }
+    free(text);
+    free(edits);
+    free(matches);
+    return result;
+}
@@ -0,0 +1,334 @@
+/* str_replay.c: replay a String API trace (see str_trace.h) with per-op timing
+ *
+ * Built twice: against blockchain.c, and with REPLAY_CLAUDE_GEN against the
+ * Claude_gen implementation, so both can be timed on the same workload.
+ *
+ * usage: str_replay <trace> [repeat]
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <string.h>
+#include <time.h>
+
+#ifdef REPLAY_CLAUDE_GEN
+#include "string_c.h"
+#define REPLAY_IMPL "Claude_gen"
+
+// Claude_gen缺少的接口用已有接口拼出来
+#define str_find_first str_find
+
+static bool str_insert_char(String s, size_t pos, char c)
+{
+    String t = str_create();
+    bool ok = t && str_push_back(t, c) && str_insert(s, pos, t);
+    str_destroy(&t);
+    return ok;
+}
+#else
+#include "blockchain.h"
+#define REPLAY_IMPL "blockchain"
+#endif
+
+//-----Trace-----
+
+typedef enum
+{
+    OP_NEW,
+    OP_FROM,
+    OP_FREE,
+    OP_CLEAR,
+    OP_APPEND,
+    OP_PUSH,
+    OP_INSERT,
+    OP_INSERT_CHAR,
+    OP_DELETE,
+    OP_SUBSTRING,
+    OP_FIND,
+    OP_FIND_CHAR,
+    OP_REPLACE_FIRST,
+    OP_REPLACE_ALL,
+    OP_AT,
+    OP_KINDS
+} OpKind;
+
+static const char *op_names[OP_KINDS] = {
+    "new", "from", "free", "clear", "append", "push", "insert", "insert_char",
+    "delete", "substring", "find", "find_char", "replace_first", "replace_all", "at"};
+
+typedef struct
+{
+    OpKind kind;
+    size_t id[3];  // 涉及的String，0表示NULL
+    size_t a, b;   // 位置、长度或字节
+    int result;    // 记录时的返回值
+    bool has_result;
+    char *text;    // from的内容
+    size_t len;
+} Op;
+
+typedef struct
+{
+    Op *ops;
+    size_t count;
+    size_t capacity;
+    size_t max_id;
+} Trace;
+
+static bool read_id(FILE *fp, size_t *id)
+{
+    return fscanf(fp, " s%zu", id) == 1;
+}
+
+// 解析一行，返回false表示格式错误
+static bool parse_op(FILE *fp, OpKind kind, Op *op)
+{
+    memset(op, 0, sizeof(Op));
+    op->kind = kind;
+    bool ok = read_id(fp, &op->id[0]);
+    switch (kind)
+    {
+    case OP_FROM:
+        ok = ok && fscanf(fp, " %zu:", &op->len) == 1;
+        if (ok)
+        {
+            op->text = (char *)malloc(op->len + 1);
+            ok = op->text && fread(op->text, 1, op->len, fp) == op->len;
+            if (ok)
+                op->text[op->len] = '\0';
+        }
+        break;
+    case OP_APPEND:
+        ok = ok && read_id(fp, &op->id[1]);
+        break;
+    case OP_PUSH:
+        ok = ok && fscanf(fp, " %zu", &op->a) == 1;
+        break;
+    case OP_INSERT:
+        ok = ok && fscanf(fp, " %zu", &op->a) == 1 && read_id(fp, &op->id[1]);
+        break;
+    case OP_INSERT_CHAR:
+    case OP_DELETE:
+        ok = ok && fscanf(fp, " %zu %zu", &op->a, &op->b) == 2;
+        break;
+    case OP_SUBSTRING:
+        ok = ok && read_id(fp, &op->id[1]) && fscanf(fp, " %zu %zu", &op->a, &op->b) == 2;
+        break;
+    case OP_FIND:
+        ok = ok && read_id(fp, &op->id[1]) && fscanf(fp, " %zu", &op->a) == 1;
+        break;
+    case OP_FIND_CHAR:
+        ok = ok && fscanf(fp, " %zu %zu", &op->a, &op->b) == 2;
+        break;
+    case OP_REPLACE_FIRST:
+    case OP_REPLACE_ALL:
+        ok = ok && read_id(fp, &op->id[1]) && read_id(fp, &op->id[2]);
+        break;
+    case OP_AT:
+        ok = ok && fscanf(fp, " %zu", &op->a) == 1;
+        break;
+    default:
+        break;
+    }
+    if (ok && (kind == OP_FIND || kind == OP_FIND_CHAR || kind == OP_REPLACE_ALL || kind == OP_AT))
+        ok = op->has_result = fscanf(fp, " = %d", &op->result) == 1;
+    return ok;
+}
+
+static bool load_trace(const char *path, Trace *t)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+    {
+        perror(path);
+        return false;
+    }
+    char word[32];
+    int version;
+    if (fscanf(fp, "%31s %d", word, &version) != 2 || strcmp(word, "strtrace") != 0 || version != 1)
+    {
+        fprintf(stderr, "%s: not a version 1 trace\n", path);
+        fclose(fp);
+        return false;
+    }
+    size_t line = 1;
+    while (fscanf(fp, "%31s", word) == 1)
+    {
+        line++;
+        int kind = 0;
+        while (kind < OP_KINDS && strcmp(word, op_names[kind]) != 0)
+            kind++;
+        if (t->count == t->capacity)
+        {
+            size_t cap = t->capacity ? t->capacity * 2 : 256;
+            Op *grown = (Op *)realloc(t->ops, sizeof(Op) * cap);
+            if (!grown)
+                break;
+            t->ops = grown;
+            t->capacity = cap;
+        }
+        Op *op = &t->ops[t->count];
+        if (kind == OP_KINDS || !parse_op(fp, (OpKind)kind, op))
+        {
+            fprintf(stderr, "%s:%zu: bad record \"%s\"\n", path, line, word);
+            if (kind != OP_KINDS)
+                free(op->text);
+            fclose(fp);
+            return false;
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            if (op->id[i] > t->max_id)
+                t->max_id = op->id[i];
+        }
+        t->count++;
+    }
+    fclose(fp);
+    return true;
+}
+
+//-----Replay-----
+
+typedef struct
+{
+    size_t count;
+    double seconds;
+} OpStats;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static String make_string(const char *text, size_t len)
+{
+    if (strlen(text) == len)
+        return str_create_from(text);
+    // 内容含'\0'时逐字节追加
+    String s = str_create();
+    for (size_t i = 0; s && i < len; i++)
+        str_push_back(s, text[i]);
+    return s;
+}
+
+// 执行一次，返回值与记录不一致时计数
+static void run_op(const Op *op, String *strings, OpStats *stats, size_t *mismatches, size_t *skipped)
+{
+    String s = strings[op->id[0]];
+    String x = strings[op->id[1]];
+    String y = strings[op->id[2]];
+    if (op->kind != OP_NEW && op->kind != OP_FROM && !s)
+    {
+        (*skipped)++;
+        return;
+    }
+    int result = 0;
+    double start = now();
+    switch (op->kind)
+    {
+    case OP_NEW:
+        str_destroy(&strings[op->id[0]]);
+        strings[op->id[0]] = str_create();
+        break;
+    case OP_FROM:
+        str_destroy(&strings[op->id[0]]);
+        strings[op->id[0]] = make_string(op->text, op->len);
+        break;
+    case OP_FREE:
+        str_destroy(&strings[op->id[0]]);
+        break;
+    case OP_CLEAR:
+        str_clear(s);
+        break;
+    case OP_APPEND:
+        str_append_str(s, x);
+        break;
+    case OP_PUSH:
+        str_push_back(s, (char)op->a);
+        break;
+    case OP_INSERT:
+        str_insert(s, op->a, x);
+        break;
+    case OP_INSERT_CHAR:
+        str_insert_char(s, op->a, (char)op->b);
+        break;
+    case OP_DELETE:
+        str_delete(s, op->a, op->b);
+        break;
+    case OP_SUBSTRING:
+        str_substring(s, x, op->a, op->b);
+        break;
+    case OP_FIND:
+        result = str_find_first(s, x, op->a);
+        break;
+    case OP_FIND_CHAR:
+        result = str_find_char(s, (char)op->a, op->b);
+        break;
+    case OP_REPLACE_FIRST:
+        str_replace_first(s, x, y);
+        break;
+    case OP_REPLACE_ALL:
+        result = str_replace_all(s, x, y);
+        break;
+    case OP_AT:
+        result = (unsigned char)str_at(s, op->a);
+        break;
+    default:
+        break;
+    }
+    stats[op->kind].seconds += now() - start;
+    stats[op->kind].count++;
+    if (op->has_result && result != op->result)
+        (*mismatches)++;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <trace> [repeat]\n", argv[0]);
+        return 2;
+    }
+    int repeat = argc > 2 ? atoi(argv[2]) : 1;
+    if (repeat < 1)
+        repeat = 1;
+
+    Trace trace = {0};
+    if (!load_trace(argv[1], &trace))
+        return 1;
+    String *strings = (String *)calloc(trace.max_id + 1, sizeof(String));
+    if (!strings)
+        return 1;
+
+    OpStats stats[OP_KINDS] = {{0}};
+    size_t mismatches = 0, skipped = 0;
+    for (int r = 0; r < repeat; r++)
+    {
+        for (size_t i = 0; i < trace.count; i++)
+            run_op(&trace.ops[i], strings, stats, &mismatches, &skipped);
+        // 每轮结束释放仍存活的String，下一轮从头开始
+        for (size_t i = 0; i <= trace.max_id; i++)
+            str_destroy(&strings[i]);
+    }
+
+    printf("implementation: %s, %zu ops x %d\n", REPLAY_IMPL, trace.count, repeat);
+    printf("%-14s %10s %12s %10s\n", "op", "count", "total ms", "mean ns");
+    double total = 0;
+    for (int k = 0; k < OP_KINDS; k++)
+    {
+        if (stats[k].count == 0)
+            continue;
+        total += stats[k].seconds;
+        printf("%-14s %10zu %12.3f %10.0f\n", op_names[k], stats[k].count, stats[k].seconds * 1e3,
+               stats[k].seconds * 1e9 / (double)stats[k].count);
+    }
+    printf("%-14s %10zu %12.3f\n", "total", trace.count * (size_t)repeat, total * 1e3);
+    if (mismatches || skipped)
+        printf("result mismatches: %zu, skipped: %zu\n", mismatches, skipped);
+
+    for (size_t i = 0; i < trace.count; i++)
+        free(trace.ops[i].text);
+    free(trace.ops);
+    free(strings);
+    return mismatches ? 3 : 0;
+}
@@ -0,0 +1,298 @@
+#include "str_trace.h"
+#include <stdint.h>
+#include <string.h>
+
+//-----Recorder State-----
+
+#define TRACE_TOMBSTONE ((uintptr_t)1) // 已销毁String留下的删除标记
+
+typedef struct
+{
+    uintptr_t key; // String地址，0为空槽
+    size_t id;
+} TraceSlot;
+
+static FILE *trace_out;
+static TraceSlot *slots; // 已出现在轨迹中的String -> id，开放定址
+static size_t slot_cap;
+static size_t slot_used; // 含删除标记
+static size_t next_id;
+
+static size_t slot_hash(uintptr_t key)
+{
+    uint64_t h = (uint64_t)(key >> 4) * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h >> 32);
+}
+
+// 返回key所在的槽；不存在时返回可插入的槽
+static size_t slot_find(uintptr_t key, bool *present)
+{
+    size_t mask = slot_cap - 1;
+    size_t reuse = SIZE_MAX;
+    for (size_t i = slot_hash(key) & mask;; i = (i + 1) & mask)
+    {
+        if (slots[i].key == key)
+        {
+            *present = true;
+            return i;
+        }
+        if (slots[i].key == 0)
+        {
+            *present = false;
+            return reuse != SIZE_MAX ? reuse : i;
+        }
+        if (slots[i].key == TRACE_TOMBSTONE && reuse == SIZE_MAX)
+            reuse = i;
+    }
+}
+
+// 装载率超过一半时重建，顺带清掉删除标记
+static bool slots_reserve(void)
+{
+    if ((slot_used + 1) * 2 <= slot_cap)
+        return true;
+    size_t live = 0;
+    for (size_t i = 0; i < slot_cap; i++)
+        live += slots[i].key > TRACE_TOMBSTONE;
+    size_t cap = slot_cap ? slot_cap : 64;
+    while ((live + 1) * 2 > cap / 2)
+        cap *= 2;
+    TraceSlot *old = slots;
+    size_t old_cap = slot_cap;
+    slots = (TraceSlot *)calloc(cap, sizeof(TraceSlot));
+    if (!slots)
+    {
+        slots = old;
+        return false;
+    }
+    slot_cap = cap;
+    slot_used = live;
+    for (size_t i = 0; i < old_cap; i++)
+    {
+        if (old[i].key > TRACE_TOMBSTONE)
+        {
+            bool present;
+            slots[slot_find(old[i].key, &present)] = old[i];
+        }
+    }
+    free(old);
+    return true;
+}
+
+static size_t register_string(String s)
+{
+    if (!slots_reserve())
+        return 0;
+    bool present;
+    size_t i = slot_find((uintptr_t)s, &present);
+    if (!present)
+    {
+        if (slots[i].key == 0)
+            slot_used++;
+        slots[i].key = (uintptr_t)s;
+        slots[i].id = ++next_id;
+    }
+    return slots[i].id;
+}
+
+//-----Output-----
+
+static void put_bytes(const char *data, size_t len)
+{
+    fprintf(trace_out, " %zu:", len);
+    fwrite(data, 1, len, trace_out);
+}
+
+// 首次出现的String先写一条内容快照，返回它的id
+static size_t string_id(String s)
+{
+    if (!s)
+        return 0;
+    bool present;
+    if (slot_cap > 0)
+    {
+        size_t i = slot_find((uintptr_t)s, &present);
+        if (present)
+            return slots[i].id;
+    }
+    size_t id = register_string(s);
+    fprintf(trace_out, "from s%zu", id);
+    fprintf(trace_out, " %zu:", str_length(s));
+    StrCursor cur;
+    str_cursor_init(&cur, s, 0);
+    const char *p;
+    size_t len;
+    while ((p = str_cursor_chunk(&cur, &len)) != NULL)
+    {
+        fwrite(p, 1, len, trace_out);
+        str_cursor_advance(&cur, len);
+    }
+    fputc('\n', trace_out);
+    return id;
+}
+
+bool str_trace_start(FILE *out)
+{
+    if (!out || trace_out)
+        return false;
+    trace_out = out;
+    next_id = 0;
+    fprintf(trace_out, "strtrace 1\n");
+    return true;
+}
+
+void str_trace_stop(void)
+{
+    if (!trace_out)
+        return;
+    fflush(trace_out);
+    trace_out = NULL;
+    free(slots);
+    slots = NULL;
+    slot_cap = slot_used = 0;
+}
+
+//-----Wrappers-----
+
+String str_trace_create(void)
+{
+    String s = str_create();
+    if (trace_out && s)
+        fprintf(trace_out, "new s%zu\n", register_string(s));
+    return s;
+}
+
+String str_trace_create_from(const char *cstr)
+{
+    String s = str_create_from(cstr);
+    if (trace_out && s)
+    {
+        fprintf(trace_out, "from s%zu", register_string(s));
+        put_bytes(cstr, strlen(cstr));
+        fputc('\n', trace_out);
+    }
+    return s;
+}
+
+void str_trace_destroy(String *s)
+{
+    if (trace_out && s && *s && slot_cap > 0)
+    {
+        bool present;
+        size_t i = slot_find((uintptr_t)*s, &present);
+        if (present)
+        {
+            fprintf(trace_out, "free s%zu\n", slots[i].id);
+            slots[i].key = TRACE_TOMBSTONE;
+        }
+    }
+    str_destroy(s);
+}
+
+void str_trace_clear(String s)
+{
+    if (trace_out && s)
+        fprintf(trace_out, "clear s%zu\n", string_id(s));
+    str_clear(s);
+}
+
+bool str_trace_append_str(String s, const String other)
+{
+    if (trace_out && s)
+    {
+        size_t a = string_id(s), b = string_id(other);
+        fprintf(trace_out, "append s%zu s%zu\n", a, b);
+    }
+    return str_append_str(s, other);
+}
+
+bool str_trace_push_back(String s, char c)
+{
+    if (trace_out && s)
+        fprintf(trace_out, "push s%zu %d\n", string_id(s), (unsigned char)c);
+    return str_push_back(s, c);
+}
+
+bool str_trace_insert(String s, size_t pos, const String t)
+{
+    if (trace_out && s)
+    {
+        size_t a = string_id(s), b = string_id(t);
+        fprintf(trace_out, "insert s%zu %zu s%zu\n", a, pos, b);
+    }
+    return str_insert(s, pos, t);
+}
+
+bool str_trace_insert_char(String s, size_t pos, char c)
+{
+    if (trace_out && s)
+        fprintf(trace_out, "insert_char s%zu %zu %d\n", string_id(s), pos, (unsigned char)c);
+    return str_insert_char(s, pos, c);
+}
+
+bool str_trace_delete(String s, size_t pos, size_t len)
+{
+    if (trace_out && s)
+        fprintf(trace_out, "delete s%zu %zu %zu\n", string_id(s), pos, len);
+    return str_delete(s, pos, len);
+}
+
+bool str_trace_substring(String sub, const String s, size_t pos, size_t len)
+{
+    if (trace_out && sub && s)
+    {
+        size_t a = string_id(sub), b = string_id(s);
+        fprintf(trace_out, "substring s%zu s%zu %zu %zu\n", a, b, pos, len);
+    }
+    return str_substring(sub, s, pos, len);
+}
+
+int str_trace_find_first(const String s, const String pattern, size_t start_pos)
+{
+    if (!trace_out || !s)
+        return str_find_first(s, pattern, start_pos);
+    size_t a = string_id(s), b = string_id(pattern);
+    int result = str_find_first(s, pattern, start_pos);
+    fprintf(trace_out, "find s%zu s%zu %zu = %d\n", a, b, start_pos, result);
+    return result;
+}
+
+int str_trace_find_char(const String s, char c, size_t start_pos)
+{
+    if (!trace_out || !s)
+        return str_find_char(s, c, start_pos);
+    size_t a = string_id(s);
+    int result = str_find_char(s, c, start_pos);
+    fprintf(trace_out, "find_char s%zu %d %zu = %d\n", a, (unsigned char)c, start_pos, result);
+    return result;
+}
+
+bool str_trace_replace_first(String s, const String old_str, const String new_str)
+{
+    if (trace_out && s)
+    {
+        size_t a = string_id(s), b = string_id(old_str), c = string_id(new_str);
+        fprintf(trace_out, "replace_first s%zu s%zu s%zu\n", a, b, c);
+    }
+    return str_replace_first(s, old_str, new_str);
+}
+
+int str_trace_replace_all(String s, const String old_str, const String new_str)
+{
+    if (!trace_out || !s)
+        return str_replace_all(s, old_str, new_str);
+    size_t a = string_id(s), b = string_id(old_str), c = string_id(new_str);
+    int result = str_replace_all(s, old_str, new_str);
+    fprintf(trace_out, "replace_all s%zu s%zu s%zu = %d\n", a, b, c, result);
+    return result;
+}
+
+char str_trace_at(const String s, size_t index)
+{
+    if (!trace_out || !s)
+        return str_at(s, index);
+    size_t a = string_id(s);
+    char result = str_at(s, index);
+    fprintf(trace_out, "at s%zu %zu = %d\n", a, index, (unsigned char)result);
+    return result;
+}
@@ -1,8 +1,12 @@
 /* test_string.c */
 #include "blockchain.h"
+#include "str_regex.h"
+#include "str_trace.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 static void expect_int(int got, int want, const char *msg)
 {
@@ -30,6 +34,46 @@ static void expect_str(String s, const char *want, const char *msg)
     free(buf);
 }
 
+/* producer thread for the stream test: 100000 numbered lines */
+static void *produce_lines(void *arg)
+{
+    StrStream st = arg;
+    for (int i = 0; i < 100000; ++i)
+    {
+        if (i % 1000 == 0)
+        {
+            String chunk = str_create();
+            str_append_i64(chunk, i);
+            str_push_back(chunk, '\n');
+            str_stream_write_str(st, chunk);
+            str_destroy(&chunk);
+            continue;
+        }
+        char line[16];
+        int n = snprintf(line, sizeof(line), "%d\n", i);
+        str_stream_write(st, line, (size_t)n);
+    }
+    str_stream_close(st);
+    return NULL;
+}
+
+/* collects split fields joined by '|' */
+static bool collect_field(const StrView *view, void *ctx)
+{
+    char *out = ctx;
+    size_t n = strlen(out);
+    if (n > 0)
+        out[n++] = '|';
+    str_view_copy(view, out + n, 256 - n);
+    return true;
+}
+
+static bool stop_after_two(const StrView *view, void *ctx)
+{
+    (void)view;
+    return ++*(int *)ctx < 2;
+}
+
 int main(void)
 {
     String s = str_create_from("hello");
@@ -68,7 +112,556 @@ int main(void)
     str_concat(rstr, sub, neu);
     expect_str(rstr, "hellouniverse", "concat result");
 
+    /* batched edits */
+    String doc = str_create_from("Hello World");
+    StrEdit edits[] = {
+        {6, 5, "Blocks", 6},
+        {0, 0, ">> ", 3},
+        {11, 0, "!", 1},
+    };
+    size_t where[3];
+    expect_int(str_apply_edits(doc, edits, 3, where), STR_OK, "apply_edits status");
+    expect_str(doc, ">> Hello Blocks!", "after apply_edits");
+    expect_int((int)where[0], 9, "apply_edits new pos 0");
+    expect_int((int)where[1], 0, "apply_edits new pos 1");
+    expect_int((int)where[2], 15, "apply_edits new pos 2");
+    StrEdit overlap[] = {{0, 4, NULL, 0}, {2, 1, "x", 1}};
+    expect_int(str_apply_edits(doc, overlap, 2, NULL), STR_INVALID_PARAM, "apply_edits overlap");
+    StrEdit past_end[] = {{10, 20, NULL, 0}};
+    expect_int(str_apply_edits(doc, past_end, 1, NULL), STR_OUT_OF_RANGE, "apply_edits out of range");
+    expect_str(doc, ">> Hello Blocks!", "apply_edits leaves string on error");
+    StrEdit same_dup[] = {{3, 2, NULL, 0}, {3, 1, "x", 1}};
+    expect_int(str_apply_edits(doc, same_dup, 2, NULL), STR_INVALID_PARAM, "apply_edits same start deletes");
+    StrEdit insert_first[] = {{3, 0, "[", 1}, {3, 5, "Hi", 2}};
+    StrEdit delete_first[] = {{3, 5, "Hi", 2}, {3, 0, "[", 1}};
+    String doc1 = str_create_from(">> Hello Blocks!"), doc2 = str_create_from(">> Hello Blocks!");
+    expect_int(str_apply_edits(doc1, insert_first, 2, where), STR_OK, "insert before delete");
+    expect_int((int)where[1], 4, "insert before delete new pos");
+    expect_int(str_apply_edits(doc2, delete_first, 2, where), STR_OK, "delete before insert");
+    expect_int((int)where[0], 4, "delete before insert new pos");
+    expect_str(doc1, ">> [Hi Blocks!", "insert before delete result");
+    expect_str(doc2, ">> [Hi Blocks!", "edit order does not matter");
+    str_destroy(&doc1);
+    str_destroy(&doc2);
+
+    /* replace all across block boundaries */
+    String many = str_create_from("ab ab ab ab ab ab ab ab ab ab ab ab ab ab ab ab");
+    String ab = str_create_from("ab");
+    String xyz = str_create_from("xyz");
+    expect_int(str_replace_all(many, ab, xyz), 16, "replace_all count");
+    expect_int((int)str_length(many), 16 * 3 + 15, "replace_all length");
+    expect_int(str_find_first(many, ab, 0), -1, "replace_all leaves no match");
+
+    /* cold block compression */
+    String cold = str_create();
+    for (int i = 0; i < 400; ++i)
+        str_push_back(cold, "log line 0123456789\n"[i % 20]);
+    size_t warm_bytes = str_memory_usage(cold);
+    expect_int(str_compact(cold) > 0, 1, "compact creates frames");
+    expect_int(str_memory_usage(cold) < warm_bytes, 1, "compact saves memory");
+    expect_int(str_at(cold, 201), 'o', "str_at inside a frame");
+    expect_int((int)str_length(cold), 400, "length kept after compact");
+    str_compact(cold);
+    str_delete(cold, 20, 360);
+    str_push_back(cold, '!');
+    expect_str(cold, "log line 0123456789\nlog line 0123456789\n!", "edit across frames");
+    str_set_cold_threshold(cold, 4);
+    for (int i = 0; i < 400; ++i)
+        str_push_back(cold, 'z');
+    expect_int(str_at(cold, 0), 'l', "str_at after auto compaction");
+    expect_int(str_find_char(cold, '!', 0), 40, "find after auto compaction");
+    String tailing = str_create(), plain = str_create();
+    str_set_cold_threshold(tailing, 1000);
+    str_push_back(tailing, 'l');
+    str_push_back(plain, 'l');
+    size_t cold_state = str_memory_usage(tailing) - str_memory_usage(plain);
+    for (int i = 1; i < 1999; ++i)
+    {
+        str_push_back(tailing, "log line 0123456789\n"[i % 20]);
+        str_push_back(plain, "log line 0123456789\n"[i % 20]);
+    }
+    expect_int((int)(str_memory_usage(tailing) - str_memory_usage(plain)), (int)cold_state,
+               "fresh appends stay warm");
+    for (int i = 1999; i < 3000; ++i)
+        str_push_back(tailing, 'x');
+    for (int i = 1999; i < 3000; ++i)
+        str_push_back(plain, 'x');
+    expect_int(str_memory_usage(tailing) < str_memory_usage(plain), 1, "stale appends compact");
+    str_destroy(&tailing);
+    str_destroy(&plain);
+
+    /* serialization round trip, including compressed frames */
+    size_t image_size = str_serialized_size(cold);
+    unsigned char *image = malloc(image_size);
+    expect_int((int)str_serialize(cold, image, image_size), (int)image_size, "serialize size");
+    String restored = str_deserialize(image, image_size);
+    expect_int((int)str_length(restored), (int)str_length(cold), "deserialize length");
+    expect_int(str_at(restored, 40), '!', "deserialize content");
+    image[image_size - 1] ^= 1;
+    expect_int(str_deserialize(image, image_size - 1) == NULL, 1, "reject truncated image");
+    free(image);
+    FILE *fp = tmpfile();
+    str_save(doc, fp);
+    rewind(fp);
+    String loaded = str_load(fp);
+    fclose(fp);
+    expect_str(loaded, ">> Hello Blocks!", "save and load");
+
+    /* utf-8 indexing */
+    String cjk = str_create_from("区块链Blockchain。");
+    expect_int((int)str_utf8_length(cjk), 14, "utf8 length");
+    expect_int((int)str_utf8_offset(cjk, 3), 9, "utf8 offset");
+    expect_int((int)str_utf8_at(cjk, 1), 0x5757, "utf8 at");
+    expect_int((int)str_utf8_at(cjk, 13), 0x3002, "utf8 at across blocks");
+    String block_pat = str_create_from("chain");
+    expect_int(str_utf8_find(cjk, block_pat, 0), 8, "utf8 find");
+    expect_int(str_append_utf8(cjk, "\xE6\x95", 2), 0, "reject truncated sequence");
+    expect_int(str_append_utf8(cjk, "\xC0\xAF", 2), 0, "reject overlong form");
+    for (int i = 0; i < 20; ++i)
+        str_append_utf8(cjk, "数据", 6);
+    expect_int((int)str_utf8_length(cjk), 54, "utf8 length after appends");
+    str_utf8_delete(cjk, 0, 3);
+    str_utf8_insert(cjk, 11, "！", 3);
+    expect_int((int)str_utf8_at(cjk, 11), 0xFF01, "utf8 insert");
+    expect_int((int)str_utf8_at(cjk, 51), 0x636E, "utf8 last code point");
+    for (int i = 0; i < 40; ++i)
+        str_insert_char(cjk, 30, 'x');
+    expect_int((int)str_utf8_length(cjk), 92, "block splits keep code points");
+    expect_int((int)str_utf8_at(cjk, 91), 0x636E, "utf8 after splits");
+
+    /* cursor */
+    StrCursor cur;
+    str_cursor_init(&cur, cjk, 9);
+    size_t chunk_len, walked = 0;
+    while (str_cursor_chunk(&cur, &chunk_len))
+    {
+        walked += chunk_len;
+        str_cursor_advance(&cur, chunk_len);
+    }
+    expect_int((int)walked, (int)str_length(cjk) - 9, "cursor walks to end");
+
+    /* regex */
+    StrError rerr;
+    StrRegex num = str_regex_compile("[0-9]+(\\.[0-9]+)?", &rerr);
+    expect_int(rerr, STR_OK, "regex compile");
+    String text = str_create_from("id=42, ver=3.14, build 7");
+    StrMatch m;
+    expect_int(str_regex_find_first(num, text, 0, &m), 1, "regex find");
+    expect_int((int)m.start * 100 + (int)m.end, 305, "regex first range");
+    size_t nmatch;
+    StrMatch *all = str_regex_find_all(num, text, 0, &nmatch);
+    expect_int((int)nmatch, 3, "regex find_all count");
+    expect_int((int)all[1].start * 100 + (int)all[1].end, 1115, "regex longest alternative");
+    free(all);
+    StrRegex alt = str_regex_compile("ab|abcd", NULL);
+    String abcd = str_create_from("xxabcd");
+    str_regex_find_first(alt, abcd, 0, &m);
+    expect_int((int)m.end, 4, "regex leftmost-first");
+    StrRegex anchored = str_regex_compile("^x+|d$", NULL);
+    all = str_regex_find_all(anchored, abcd, 0, &nmatch);
+    expect_int((int)nmatch, 2, "regex anchors");
+    expect_int((int)all[1].start, 5, "regex end anchor");
+    free(all);
+    StrRegex han = str_regex_compile("[一-龥]+", NULL);
+    expect_int(str_regex_find_first(han, cjk, 0, &m), 1, "regex utf-8 class");
+    expect_int((int)m.start, 16, "regex utf-8 start");
+    String runs = str_create_from("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab");
+    StrRegex run = str_regex_compile("a*b", NULL);
+    str_regex_find_first(run, runs, 0, &m);
+    expect_int((int)m.start * 100 + (int)m.end, 59, "regex match spans blocks");
+    String hash = str_create_from("#");
+    expect_int(str_regex_replace_all(text, num, hash), 3, "regex replace count");
+    expect_str(text, "id=#, ver=#, build #", "regex replace");
+    expect_int(str_regex_compile("a{2,1}", &rerr) == NULL, 1, "regex bad repeat");
+    expect_int(str_regex_compile("(ab", &rerr) == NULL, 1, "regex unbalanced");
+    expect_int(rerr, STR_INVALID_PARAM, "regex error code");
+    /* malformed patterns stop at the terminator; each is copied to an exact-size buffer for ASan */
+    const char *malformed[] = {"\\", "a\\", "[", "[^", "[]", "[\\", "[a-\\", "(a|", "\\x4"};
+    for (int i = 0; i < 9; i++)
+    {
+        char *exact = malloc(strlen(malformed[i]) + 1);
+        strcpy(exact, malformed[i]);
+        expect_int(str_regex_compile(exact, &rerr) == NULL && rerr == STR_INVALID_PARAM, 1, malformed[i]);
+        free(exact);
+    }
+    char *long_pat = malloc(200001);
+    memset(long_pat, 'x', 200000);
+    long_pat[200000] = '\0';
+    expect_int(str_regex_compile(long_pat, &rerr) == NULL && rerr == STR_INVALID_PARAM, 1, "regex long literal");
+    memset(long_pat, '*', 200000);
+    long_pat[0] = 'a';
+    expect_int(str_regex_compile(long_pat, &rerr) == NULL && rerr == STR_INVALID_PARAM, 1, "regex stacked quantifiers");
+    for (int i = 0; i < 4000; i++)
+        memcpy(long_pat + 2 * i, i < 3999 ? "a|" : "b", 2);
+    StrRegex branches = str_regex_compile(long_pat, NULL);
+    expect_int(branches && str_regex_find_first(branches, abcd, 0, &m), 1, "regex long alternation");
+    expect_int((int)m.start, 2, "regex long alternation start");
+    str_regex_destroy(&branches);
+    free(long_pat);
+    /* find_all resumes where the last match ended: 8x the matches take about 8x the time */
+    double find_all_time[2];
+    for (int round = 0; round < 2; round++)
+    {
+        size_t pairs = round == 0 ? 50000 : 400000;
+        char *ab_text = malloc(2 * pairs + 1);
+        for (size_t i = 0; i < pairs; i++)
+            memcpy(ab_text + 2 * i, "ab", 2);
+        ab_text[2 * pairs] = '\0';
+        String ab_str = str_create_from(ab_text);
+        StrRegex a_re = str_regex_compile("a", NULL);
+        clock_t begin = clock();
+        all = str_regex_find_all(a_re, ab_str, 0, &nmatch);
+        find_all_time[round] = (double)(clock() - begin) / CLOCKS_PER_SEC;
+        expect_int((int)nmatch, (int)pairs, "regex find_all scaling count");
+        expect_int((int)all[nmatch - 1].start, (int)(2 * pairs - 2), "regex find_all scaling last");
+        free(all);
+        free(ab_text);
+        str_regex_destroy(&a_re);
+        str_destroy(&ab_str);
+    }
+    expect_int(find_all_time[1] < 24 * find_all_time[0] + 0.05, 1, "regex find_all scales linearly");
+    /* loops over bodies that can match empty stop at an empty iteration */
+    const char *empty_loops[][3] = {{"(a?\?)+", "aa", "0"}, {"(b*?)*", "bb", "0"},
+                                    {"(a|b?\?)*", "b", "0"}, {"c(.*?)*", "cab", "1"},
+                                    {"(a*)+", "aa", "2"},    {"(a|)+", "aa", "2"}};
+    for (int i = 0; i < 6; i++)
+    {
+        StrRegex loop = str_regex_compile(empty_loops[i][0], NULL);
+        String subject = str_create_from(empty_loops[i][1]);
+        expect_int(str_regex_find_first(loop, subject, 0, &m), 1, empty_loops[i][0]);
+        expect_int((int)m.start * 100 + (int)m.end, atoi(empty_loops[i][2]), empty_loops[i][0]);
+        str_regex_destroy(&loop);
+        str_destroy(&subject);
+    }
+
+    /* split / tokenize */
+    String csv = str_create_from("id,name,,city,a-very-long-field-that-spans-more-than-one-block,");
+    char fields[256] = "";
+    expect_int((int)str_split(csv, ',', collect_field, fields), 6, "split count");
+    expect_int(strcmp(fields, "id|name||city|a-very-long-field-that-spans-more-than-one-block|"), 0, "split fields");
+    int seen = 0;
+    expect_int((int)str_split(csv, ',', stop_after_two, &seen), 2, "split stops early");
+    String words = str_create_from("  GET /index.html\t200  ");
+    fields[0] = '\0';
+    expect_int((int)str_tokenize(words, " \t", collect_field, fields), 3, "tokenize count");
+    expect_int(strcmp(fields, "GET|/index.html|200"), 0, "tokenize fields");
+    expect_int(str_find_char(csv, 's', 0), 37, "find_char across blocks");
+
+    /* line index */
+    String logbuf = str_create();
+    expect_int(str_track_lines(logbuf, true), 1, "track lines");
+    char line[32];
+    for (int i = 0; i < 200; ++i)
+    {
+        int n = snprintf(line, sizeof(line), "line %d\n", i);
+        for (int k = 0; k < n; ++k)
+            str_push_back(logbuf, line[k]);
+    }
+    expect_int((int)str_line_count(logbuf), 201, "line count");
+    expect_int((int)str_line_start(logbuf, 11), 7 * 10 + 8, "line start from table");
+    expect_int((int)str_line_of(logbuf, 7 * 10 + 8 + 3), 11, "line of position");
+    expect_int(str_line_start(logbuf, 201) == STR_NPOS, 1, "line out of range");
+    str_delete(logbuf, 0, 7); /* drop "line 0\n" */
+    expect_int((int)str_line_start(logbuf, 10), 7 * 9 + 8, "line start after delete");
+    str_insert_char(logbuf, 2, '\n');
+    expect_int((int)str_line_count(logbuf), 201, "line count after insert");
+    expect_int((int)str_line_start(logbuf, 1), 3, "line start after insert");
+    expect_int(str_at(logbuf, str_line_start(logbuf, 150)), 'l', "line start lands on line");
+    /* a table made stale by edits falls back to the block index, like an untracked copy */
+    String tracked = str_create(), untracked = str_create();
+    str_append_str(tracked, logbuf);
+    str_append_str(untracked, logbuf);
+    expect_int(str_track_lines(tracked, true), 1, "track lines of copy");
+    str_insert_char(tracked, 40, '\n');
+    str_insert_char(untracked, 40, '\n');
+    str_delete(tracked, 100, 20);
+    str_delete(untracked, 100, 20);
+    int lines_agree = str_line_count(tracked) == str_line_count(untracked);
+    for (size_t i = 0; i <= str_line_count(tracked); ++i)
+        lines_agree &= str_line_start(tracked, i) == str_line_start(untracked, i);
+    str_push_back(tracked, '\n');
+    lines_agree &= str_line_start(tracked, str_line_count(tracked) - 1) == str_length(tracked);
+    expect_int(lines_agree, 1, "stale line table falls back to the index");
+    expect_int(str_track_lines(tracked, true), 1, "line table rebuilt after edits");
+    str_push_back(untracked, '\n');
+    for (size_t i = 0; i <= str_line_count(tracked); ++i)
+        lines_agree &= str_line_start(tracked, i) == str_line_start(untracked, i);
+    expect_int(lines_agree, 1, "rebuilt line table agrees");
+    str_destroy(&tracked);
+    str_destroy(&untracked);
+    /* splits and cross-block deletes patch the block index instead of dropping it */
+    char model[4096];
+    size_t model_len = 0;
+    String edited = str_create();
+    for (int i = 0; i < 2000; ++i)
+        str_push_back(edited, model[model_len++] = "ab\ncd\u00e9f\n"[i % 9]);
+    unsigned seed = 12345;
+    int index_agrees = 1;
+    for (int step = 0; step < 400; ++step)
+    {
+        seed = seed * 1103515245u + 12345u;
+        size_t at = (seed >> 8) % (model_len + 1);
+        if (step % 2 == 0 && model_len < sizeof(model) - 1)
+        {
+            char c = step % 6 == 0 ? '\n' : 'x';
+            str_insert_char(edited, at, c);
+            memmove(model + at + 1, model + at, model_len - at);
+            model[at] = c;
+            model_len++;
+        }
+        else
+        {
+            size_t n = (seed >> 20) % 90;
+            if (n > model_len - at)
+                n = model_len - at;
+            str_delete(edited, at, n);
+            memmove(model + at, model + at + n, model_len - at - n);
+            model_len -= n;
+        }
+        size_t probe = model_len ? (seed >> 4) % model_len : 0;
+        size_t probe_line = 0;
+        for (size_t i = 0; i < probe; ++i)
+            probe_line += model[i] == '\n';
+        index_agrees &= str_length(edited) == model_len;
+        index_agrees &= !model_len || str_at(edited, probe) == model[probe];
+        index_agrees &= str_line_of(edited, probe) == probe_line;
+        index_agrees &= probe_line == 0 || model[str_line_start(edited, probe_line) - 1] == '\n';
+    }
+    expect_int(index_agrees, 1, "block index follows splits and deletes");
+    str_destroy(&edited);
+    str_set_cold_threshold(logbuf, 1);
+    str_compact(logbuf);
+    expect_int((int)str_line_of(logbuf, str_length(logbuf) - 1), 199, "line of in compressed blocks");
+
+    /* reserve / builder */
+    String big = str_create();
+    expect_int(str_reserve(big, 1000), 1, "reserve");
+    expect_int(str_capacity(big) >= 1000, 1, "capacity after reserve");
+    for (int i = 0; i < 1000; ++i)
+        str_push_back(big, (char)('a' + i % 26));
+    expect_int((int)str_capacity(big), 1000 + 23, "reserved blocks used up");
+    str_delete(big, 100, 500);
+    str_insert_char(big, 10, '#');
+    expect_int(str_at(big, 10), '#', "insert into reused block");
+    expect_int(str_at(big, 101), 'a' + 600 % 26, "content after reuse");
+    StrBuilder sb = str_builder_create(64);
+    expect_int(str_builder_append_fmt(sb, "HTTP/1.1 %d %s\r\n", 200, "OK"), 17, "builder fmt");
+    for (int i = 0; i < 50; ++i)
+        str_builder_append_fmt(sb, "%03d,", i);
+    expect_int(str_builder_append_fmt(sb, "%300s", "!"), 300, "builder long fmt");
+    str_builder_append_char(sb, '$');
+    expect_int((int)str_builder_length(sb), 17 + 200 + 301, "builder length");
+    String built = str_builder_finish(&sb);
+    expect_int(sb == NULL, 1, "builder consumed");
+    expect_int(str_at(built, 17 + 4 * 49), '0', "builder content");
+    expect_int(str_at(built, 517), '$', "builder tail");
+
+    /* transforms */
+    String key = str_create_from("  \tContent-Type: Text/HTML; charset=UTF-8 (区块) \r\n");
+    expect_int(str_trim(key), 1, "trim");
+    expect_str(key, "Content-Type: Text/HTML; charset=UTF-8 (区块)", "trim result");
+    str_to_lower(key);
+    expect_str(key, "content-type: text/html; charset=utf-8 (区块)", "to_lower");
+    str_to_upper(key);
+    expect_str(key, "CONTENT-TYPE: TEXT/HTML; CHARSET=UTF-8 (区块)", "to_upper");
+    unsigned char dash_to_us[256];
+    for (int i = 0; i < 256; ++i)
+        dash_to_us[i] = (unsigned char)i;
+    dash_to_us['-'] = '_';
+    str_translate(key, dash_to_us);
+    expect_int(str_count_char(key, '_'), 2, "translate and count");
+    expect_int((int)str_count_char(logbuf, '\n'), 200, "count newlines");
+    expect_int((int)str_count_char(big, 'a'), 19, "count across reused blocks");
+    String blank = str_create_from(" \t\n ");
+    str_trim(blank);
+    expect_int((int)str_length(blank), 0, "trim all whitespace");
+    String leading = str_create_from("  abc");
+    expect_int(str_trim(leading), 1, "trim leading only");
+    expect_str(leading, "abc", "trim leading only result");
+    String trailing = str_create_from("abc \n");
+    expect_int(str_trim(trailing), 1, "trim trailing only");
+    expect_str(trailing, "abc", "trim trailing only result");
+    expect_int(str_trim(leading), 1, "trim without whitespace");
+    expect_str(leading, "abc", "trim without whitespace result");
+    str_destroy(&leading);
+    str_destroy(&trailing);
+
+    /* numbers */
+    String nums = str_create_from("pad pad pad pad pad pad pad 1234567890123456789 -9223372036854775808 "
+                                  "99999999999999999999 x 3.25e2 -0.1 1e 2.2250738585072014e-308 "
+                                  "123456789012345678901234567890 1e400 -Infinity");
+    int64_t iv = 0;
+    double dv = 0;
+    size_t end = 0;
+    expect_int(str_parse_i64(nums, 27, &iv, &end), STR_OK, "parse i64 across blocks");
+    expect_int(iv == 1234567890123456789LL, 1, "parse i64 value");
+    expect_int((int)end, 47, "parse i64 end");
+    expect_int(str_parse_i64(nums, end, &iv, &end), STR_OK, "parse INT64_MIN");
+    expect_int(iv == INT64_MIN, 1, "INT64_MIN value");
+    expect_int(str_parse_i64(nums, end, &iv, &end), STR_OUT_OF_RANGE, "parse i64 overflow");
+    expect_int(iv == INT64_MAX, 1, "overflow clamps");
+    expect_int(str_parse_i64(nums, end, &iv, NULL), STR_INVALID_PARAM, "parse i64 no digits");
+    expect_int(str_parse_f64(nums, end + 2, &dv, &end), STR_OK, "parse f64 exponent");
+    expect_int(dv == 325.0, 1, "f64 fast path");
+    expect_int(str_parse_f64(nums, end, &dv, &end), STR_OK, "parse f64 fraction");
+    expect_int(dv == -0.1, 1, "f64 fraction value");
+    expect_int(str_parse_f64(nums, end, &dv, &end), STR_OK, "parse f64 dangling e");
+    expect_int(dv == 1.0 && str_at(nums, end) == 'e', 1, "dangling e not consumed");
+    expect_int(str_parse_f64(nums, end + 1, &dv, &end), STR_OK, "parse f64 slow path");
+    expect_int(dv == 2.2250738585072014e-308, 1, "f64 slow path value");
+    expect_int(str_parse_f64(nums, end, &dv, &end), STR_OK, "parse f64 long mantissa");
+    expect_int(dv == 123456789012345678901234567890.0, 1, "f64 long mantissa value");
+    expect_int(str_parse_f64(nums, end, &dv, &end), STR_OUT_OF_RANGE, "parse f64 overflow");
+    expect_int(str_parse_f64(nums, end, &dv, &end), STR_OK, "parse f64 infinity");
+    expect_int(dv < -1e308 && end == str_length(nums), 1, "f64 infinity value");
+    String out = str_create();
+    str_append_i64(out, INT64_MIN);
+    str_push_back(out, ' ');
+    str_append_i64(out, 0);
+    str_push_back(out, ' ');
+    str_append_f64(out, 0.1 + 0.2);
+    str_push_back(out, ' ');
+    str_append_f64(out, 1e21);
+    str_push_back(out, ' ');
+    str_append_f64(out, -1.5);
+    expect_str(out, "-9223372036854775808 0 0.30000000000000004 1e+21 -1.5", "append numbers");
+    str_parse_f64(out, 23, &dv, NULL);
+    expect_int(dv == 0.1 + 0.2, 1, "f64 round trip");
+
+    /* diff */
+    String v1 = str_create_from("[server]\nport=80\nhost=example.org\nworkers=4\n[log]\nlevel=info\n");
+    String v2 = str_create_from("[server]\nport=8080\nhost=example.org\n[log]\nlevel=debug\nfile=a.log\n");
+    StrEdit *delta = NULL;
+    size_t delta_count = 0;
+    expect_int(str_diff(v1, v2, &delta, &delta_count), STR_OK, "diff");
+    expect_int(delta_count >= 3, 1, "diff edit count");
+    expect_int((int)delta[0].pos, 16, "diff first edit position");
+    expect_int(delta[0].delete_len == 0 && delta[0].insert_len == 2, 1, "diff first edit inserts \"80\"");
+    expect_int(delta[1].pos == 34 && delta[1].delete_len == 10, 1, "diff deletes removed line");
+    expect_int(str_apply_edits(v1, delta, delta_count, NULL), STR_OK, "apply diff");
+    expect_str(v1, "[server]\nport=8080\nhost=example.org\n[log]\nlevel=debug\nfile=a.log\n", "diff round trip");
+    free(delta);
+    expect_int(str_diff(v1, v2, &delta, &delta_count), STR_OK, "diff equal");
+    expect_int(delta == NULL && delta_count == 0, 1, "equal strings have no edits");
+    String empty = str_create();
+    expect_int(str_diff(empty, v2, &delta, &delta_count), STR_OK, "diff from empty");
+    expect_int(delta_count == 1 && delta[0].insert_len == str_length(v2), 1, "diff from empty is one insert");
+    free(delta);
+
+    /* rolling hash */
+    String dna = str_create_from("GATTACAGATTACA");
+    String pats[] = {str_create_from("TTA"), str_create_from("ACA")};
+    StrHit *hits = NULL;
+    size_t hit_count = 0;
+    expect_int(str_find_patterns(dna, pats, 2, &hits, &hit_count), STR_OK, "find patterns");
+    expect_int((int)hit_count, 4, "pattern hit count");
+    expect_int(hits[2].pos == 9 && hits[2].pattern == 0 && hits[3].pos == 11 && hits[3].pattern == 1, 1,
+               "pattern hits in order");
+    free(hits);
+    String bad_pats[] = {pats[0], abcd};
+    expect_int(str_find_patterns(dna, bad_pats, 2, &hits, &hit_count), STR_INVALID_PARAM, "patterns of unequal length");
+    size_t rep_pos = 0, rep_len = 0;
+    String banana = str_create_from("banana");
+    expect_int(str_longest_repeated_substring(banana, &rep_pos, &rep_len), STR_OK, "longest repeat");
+    expect_int(rep_pos == 1 && rep_len == 3, 1, "longest repeat overlaps");
+    expect_int(str_longest_repeated_substring(dna, &rep_pos, &rep_len), STR_OK, "longest repeat dna");
+    expect_int(rep_pos == 0 && rep_len == 7, 1, "longest repeat value");
+    StrFingerprint *fp1 = NULL, *fp2 = NULL;
+    size_t fp1_count = 0, fp2_count = 0;
+    expect_int(str_fingerprints(csv, 5, 4, &fp1, &fp1_count), STR_OK, "fingerprints");
+    expect_int(str_fingerprints(csv, 5, 4, &fp2, &fp2_count), STR_OK, "fingerprints again");
+    expect_int(fp1_count > 0 && fp1_count == fp2_count && fp1[0].hash == fp2[0].hash, 1, "fingerprints stable");
+    free(fp1);
+    free(fp2);
+
+    /* stream */
+    StrStream pipe = str_stream_create();
+    pthread_t producer;
+    pthread_create(&producer, NULL, produce_lines, pipe);
+    long next_line = 0, line_value = 0;
+    int stream_ok = 1;
+    while (!str_stream_eof(pipe))
+    {
+        size_t len;
+        const char *p = str_stream_peek(pipe, &len);
+        if (!p)
+            continue;
+        for (size_t i = 0; i < len; ++i)
+        {
+            if (p[i] != '\n')
+            {
+                line_value = line_value * 10 + (p[i] - '0');
+                continue;
+            }
+            stream_ok &= line_value == next_line++;
+            line_value = 0;
+        }
+        str_stream_consume(pipe, len);
+        stream_ok &= str_stream_buffered(pipe) < 1000000; /* never below zero while the producer runs */
+    }
+    pthread_join(producer, NULL);
+    expect_int(stream_ok && next_line == 100000, 1, "stream delivers lines in order");
+    expect_int((int)str_stream_buffered(pipe), 0, "stream drained");
+    str_stream_destroy(&pipe);
+    expect_int(pipe == NULL, 1, "stream destroyed");
+
+    /* trace */
+    FILE *trace = tmpfile();
+    String before = str_create_from("ab");
+    expect_int(str_trace_start(trace), 1, "trace start");
+    expect_int(str_trace_start(trace), 0, "trace already started");
+    String traced = str_trace_create_from("x y");
+    str_trace_append_str(traced, before);
+    str_trace_insert_char(traced, 1, '\n');
+    expect_int(str_trace_find_char(traced, 'b', 0), 5, "traced call result");
+    str_trace_destroy(&traced);
+    expect_int(traced == NULL, 1, "traced destroy");
+    str_trace_stop();
+    str_trace_push_back(before, 'c'); /* not recorded */
+    rewind(trace);
+    char trace_text[256] = {0};
+    fread(trace_text, 1, sizeof(trace_text) - 1, trace);
+    fclose(trace);
+    expect_int(strcmp(trace_text, "strtrace 1\nfrom s1 3:x y\nfrom s2 2:ab\nappend s1 s2\n"
+                                  "insert_char s1 1 10\nfind_char s1 98 0 = 5\nfree s1\n"),
+               0, "trace text");
+
     /* cleanup */
+    str_destroy(&before);
+    str_destroy(&dna);
+    str_destroy(&pats[0]);
+    str_destroy(&pats[1]);
+    str_destroy(&banana);
+    str_destroy(&v1);
+    str_destroy(&v2);
+    str_destroy(&empty);
+    str_destroy(&nums);
+    str_destroy(&out);
+    str_destroy(&key);
+    str_destroy(&blank);
+    str_destroy(&big);
+    str_destroy(&built);
+    str_destroy(&logbuf);
+    str_destroy(&csv);
+    str_destroy(&words);
+    str_regex_destroy(&num);
+    str_regex_destroy(&alt);
+    str_regex_destroy(&anchored);
+    str_regex_destroy(&han);
+    str_regex_destroy(&run);
+    str_destroy(&text);
+    str_destroy(&abcd);
+    str_destroy(&runs);
+    str_destroy(&hash);
+    str_destroy(&cjk);
+    str_destroy(&block_pat);
+    str_destroy(&restored);
+    str_destroy(&loaded);
+    str_destroy(&cold);
+    str_destroy(&doc);
+    str_destroy(&many);
+    str_destroy(&ab);
+    str_destroy(&xyz);
     str_destroy(&s);
     str_destroy(&t);
     str_destroy(&old);
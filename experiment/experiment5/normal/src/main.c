@@ -1,6 +1,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <ctype.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define INITIAL_CAPACITY 4
 typedef struct
@@ -20,10 +36,12 @@ static int compare_triples(const void *a, const void *b)
     Triple *t1 = (Triple *)a;
     Triple *t2 = (Triple *)b;
     if (t1->x != t2->x)
-        return t1->x - t2->x;
-    return t1->y - t2->y;
+        return (t1->x > t2->x) - (t1->x < t2->x); // a plain difference can overflow
+    return (t1->y > t2->y) - (t1->y < t2->y);
 }
 
+void sort_triples(Matrix A); // radix sort with duplicate coalescing, defined after the thread pool
+
 Matrix init_matrix(int num_elem, int rows, int cols)
 {
     Matrix A = (Matrix)malloc(sizeof(*A));
@@ -42,28 +60,6 @@ Matrix init_matrix(int num_elem, int rows, int cols)
     return A;
 }
 
-Matrix creat_from_array(double **arr, int rows, int cols)
-{
-    int count = 0;
-    for (int i = 0; i < rows; i++)
-        for (int j = 0; j < cols; j++)
-            if (arr[i][j] != 0.0)
-                count++;
-
-    Matrix A = init_matrix(count, rows, cols);
-    int idx = 0;
-    for (int i = 0; i < rows; i++)
-        for (int j = 0; j < cols; j++)
-            if (arr[i][j] != 0.0)
-            {
-                A->data[idx].x = i;
-                A->data[idx].y = j;
-                A->data[idx].value = arr[i][j];
-                idx++;
-            }
-    return A;
-}
-
 void free_matrix(Matrix *A)
 {
     free((*A)->data);
@@ -73,6 +69,8 @@ void free_matrix(Matrix *A)
 
 void resize_matrix(Matrix A, size_t new_capacity)
 {
+    if (new_capacity == 0) // realloc(p, 0) may free p and return NULL
+        new_capacity = 1;
     Triple *new_data = (Triple *)realloc(A->data, sizeof(Triple) * new_capacity);
     if (new_data == NULL)
     {
@@ -83,6 +81,49 @@ void resize_matrix(Matrix A, size_t new_capacity)
     A->capacity = new_capacity;
 }
 
+// append one triple, doubling the capacity when full
+static void push_triple(Matrix A, int row, int col, double value)
+{
+    if (A->length == A->capacity)
+        resize_matrix(A, A->capacity * 2);
+    A->data[A->length].x = row;
+    A->data[A->length].y = col;
+    A->data[A->length].value = value;
+    A->length++;
+}
+
+// one pass over the row pointers; whole vectors of zeros are skipped with a single compare
+Matrix creat_from_array(double **arr, int rows, int cols)
+{
+    Matrix A = init_matrix(0, rows, cols);
+    for (int i = 0; i < rows; i++)
+    {
+        const double *row = arr[i];
+        int j = 0;
+#if defined(__AVX2__)
+        for (; j + 4 <= cols; j += 4)
+        {
+            __m256d v = _mm256_loadu_pd(row + j);
+            int mask = _mm256_movemask_pd(_mm256_cmp_pd(v, _mm256_setzero_pd(), _CMP_NEQ_UQ));
+            for (; mask != 0; mask &= mask - 1)
+                push_triple(A, i, j + __builtin_ctz(mask), row[j + __builtin_ctz(mask)]);
+        }
+#elif defined(__SSE2__)
+        for (; j + 2 <= cols; j += 2)
+        {
+            int mask = _mm_movemask_pd(_mm_cmpneq_pd(_mm_loadu_pd(row + j), _mm_setzero_pd()));
+            for (; mask != 0; mask &= mask - 1)
+                push_triple(A, i, j + __builtin_ctz(mask), row[j + __builtin_ctz(mask)]);
+        }
+#endif
+        for (; j < cols; j++)
+            if (row[j] != 0.0)
+                push_triple(A, i, j, row[j]);
+    }
+    resize_matrix(A, A->length);
+    return A;
+}
+
 void input_matrix(Matrix A)
 {
     printf("Enter matrix elements in format (row col value), one per line. Enter -1 -1 -1 to end input.\n");
@@ -110,37 +151,64 @@ void input_matrix(Matrix A)
     }
     A->length = count; // update size to actual number of elements
 
-    qsort(A->data, A->length, sizeof(Triple), compare_triples);
+    sort_triples(A); // duplicate entries are summed
+}
+
+// stdout in large writes; print_matrix output can be rows * cols numbers
+typedef struct
+{
+    char data[1 << 16];
+    size_t used;
+} PrintBuffer;
+
+static void print_flush(PrintBuffer *b)
+{
+    fwrite(b->data, 1, b->used, stdout);
+    b->used = 0;
+}
+
+static void print_text(PrintBuffer *b, const char *text, size_t len)
+{
+    if (b->used + len > sizeof(b->data))
+        print_flush(b);
+    memcpy(b->data + b->used, text, len);
+    b->used += len;
 }
 
+// the dense form walks the sorted triples row by row and writes the zeros in between,
+// so nothing of size rows * cols is ever held in memory
 void print_matrix(const Matrix A, bool print_full)
 {
+    static PrintBuffer out;
+    char number[512]; // %lf of a double can take over 300 characters
     if (print_full)
     {
-        double mat[A->rows][A->cols];
-        for (int i = 0; i < A->rows; i++)
-            for (int j = 0; j < A->cols; j++)
-                mat[i][j] = 0.0;
-        for (int k = 0; k < A->length; k++)
-            mat[(A->data[k].x)][(A->data[k].y)] = A->data[k].value;
-
+        size_t k = 0;
         for (int i = 0; i < A->rows; i++)
         {
             for (int j = 0; j < A->cols; j++)
             {
-                printf("%lf ", mat[i][j]);
+                // with repeated coordinates the last one wins, as it did for the dense copy
+                while (k + 1 < A->length && A->data[k + 1].x == A->data[k].x && A->data[k + 1].y == A->data[k].y)
+                    k++;
+                if (k < A->length && A->data[k].x == i && A->data[k].y == j)
+                    print_text(&out, number, (size_t)snprintf(number, sizeof(number), "%lf ", A->data[k++].value));
+                else
+                    print_text(&out, "0.000000 ", 9);
             }
-            printf("\n");
+            print_text(&out, "\n", 1);
         }
     }
     else
     {
-        printf("Sparse Matrix Representation (row col value):\n");
+        const char *title = "Sparse Matrix Representation (row col value):\n";
+        print_text(&out, title, strlen(title));
         for (int k = 0; k < A->length; k++)
-        {
-            printf("(%d %d %lf)\n", A->data[k].x, A->data[k].y, A->data[k].value);
-        }
+            print_text(&out, number,
+                       (size_t)snprintf(number, sizeof(number), "(%d %d %lf)\n", A->data[k].x, A->data[k].y,
+                                        A->data[k].value));
     }
+    print_flush(&out);
 }
 
 void add_matrix(const Matrix A, const Matrix B, Matrix C)
@@ -193,34 +261,97 @@ void add_matrix(const Matrix A, const Matrix B, Matrix C)
     resize_matrix(C, C_idx);
 }
 
-void transpose_matrix(const Matrix A, Matrix result)
+// C = alpha * A + beta * B, union of sorted lists; entries that come out zero are dropped
+void scale_add_matrix(double alpha, const Matrix A, double beta, const Matrix B, Matrix C)
 {
-    int col_elem_count[A->cols];
-    for (int i = 0; i < A->cols; i++)
-        col_elem_count[i] = 0;
-
-    for (int i = 0; i < A->length; i++)
-        col_elem_count[A->data[i].y]++;
+    if (A->cols != B->cols || A->rows != B->rows)
+    {
+        printf("Matrix dimension mismatch\n");
+        exit(1);
+    }
+    resize_matrix(C, A->length + B->length);
+    size_t A_idx = 0, B_idx = 0, C_idx = 0;
+    while (A_idx < A->length || B_idx < B->length)
+    {
+        int order = A_idx == A->length   ? 1
+                    : B_idx == B->length ? -1
+                                         : compare_triples(&A->data[A_idx], &B->data[B_idx]);
+        Triple t = order <= 0 ? A->data[A_idx] : B->data[B_idx];
+        if (order < 0)
+            t.value = alpha * A->data[A_idx++].value;
+        else if (order > 0)
+            t.value = beta * B->data[B_idx++].value;
+        else
+            t.value = alpha * A->data[A_idx++].value + beta * B->data[B_idx++].value;
+        if (t.value != 0.0)
+            C->data[C_idx++] = t;
+    }
+    C->length = C_idx;
+    C->rows = A->rows;
+    C->cols = A->cols;
+    resize_matrix(C, C_idx);
+}
 
-    int col_start_index[A->cols];
-    col_start_index[0] = 0;
-    for (int i = 1; i < A->cols; i++)
-        col_start_index[i] = col_start_index[i - 1] + col_elem_count[i - 1];
+void subtract_matrix(const Matrix A, const Matrix B, Matrix C)
+{
+    scale_add_matrix(1.0, A, -1.0, B, C);
+}
 
-    resize_matrix(result, A->length);
+// C = A o B (element-wise product): intersection of sorted lists; C may be A or B
+void hadamard_matrix(const Matrix A, const Matrix B, Matrix C)
+{
+    if (A->cols != B->cols || A->rows != B->rows)
+    {
+        printf("Matrix dimension mismatch\n");
+        exit(1);
+    }
+    size_t bound = A->length < B->length ? A->length : B->length;
+    if (C != A && C != B && C->capacity < bound)
+        resize_matrix(C, bound);
+    size_t A_idx = 0, B_idx = 0, C_idx = 0;
+    while (A_idx < A->length && B_idx < B->length)
+    {
+        int order = compare_triples(&A->data[A_idx], &B->data[B_idx]);
+        if (order < 0)
+            A_idx++;
+        else if (order > 0)
+            B_idx++;
+        else
+        {
+            double product = A->data[A_idx].value * B->data[B_idx].value;
+            if (product != 0.0)
+            {
+                C->data[C_idx] = A->data[A_idx];
+                C->data[C_idx++].value = product;
+            }
+            A_idx++;
+            B_idx++;
+        }
+    }
+    C->length = C_idx;
+    C->rows = A->rows;
+    C->cols = A->cols;
+    resize_matrix(C, C_idx);
+}
 
-    for (int i = 0; i < A->length; i++)
+// C = f applied to every stored value of A (zeros stay implicit); C may be A itself
+void apply_matrix(const Matrix A, double (*f)(double), Matrix C)
+{
+    if (C != A && C->capacity < A->length)
+        resize_matrix(C, A->length);
+    size_t C_idx = 0;
+    for (size_t k = 0; k < A->length; k++)
     {
-        Triple elem = A->data[i];
-        int pos = col_start_index[elem.y]++;
-        result->data[pos].x = elem.y;
-        result->data[pos].y = elem.x;
-        result->data[pos].value = elem.value;
+        Triple t = A->data[k];
+        t.value = f(t.value);
+        if (t.value != 0.0)
+            C->data[C_idx++] = t;
     }
-    result->length = A->length;
-    result->rows = A->cols;
-    result->cols = A->rows;
+    C->length = C_idx;
+    C->rows = A->rows;
+    C->cols = A->cols;
 }
+
 /*
 void multiply_matrix(const Matrix A, const Matrix B, Matrix C)
 {
@@ -278,65 +409,137 @@ void multiply_matrix(const Matrix A, const Matrix B, Matrix C)
 }
 */
 
-void multiply_matrix(const Matrix A, const Matrix B, Matrix C)
+// Gustavson: row i of C is the sum of A(i,k) * (row k of B) over the nonzeros of row i of A.
+// A symbolic pass counts the distinct columns of every output row so C is sized exactly,
+// then a numeric pass accumulates into a dense row indexed by column.
+// Time O(flops + nnz(C) log), where flops = sum over A(i,k) of nnz(row k of B)
+
+static int compare_ints(const void *a, const void *b)
 {
-    Matrix B_T = init_matrix(B->length, B->cols, B->rows);
-    transpose_matrix(B, B_T);
-    resize_matrix(C, A->length * B->length);
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static void sort_columns(int *cols, size_t n)
+{
+    if (n > 16)
+    {
+        qsort(cols, n, sizeof(int), compare_ints);
+        return;
+    }
+    for (size_t i = 1; i < n; i++)
+    {
+        int key = cols[i];
+        size_t j = i;
+        for (; j > 0 && cols[j - 1] > key; j--)
+            cols[j] = cols[j - 1];
+        cols[j] = key;
+    }
+}
+
+// mark[j] == row while column j is already part of the current output row
+static int *init_marks(size_t cols)
+{
+    int *mark = (int *)malloc(sizeof(int) * (cols > 0 ? cols : 1));
+    if (mark == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t j = 0; j < cols; j++)
+        mark[j] = -1;
+    return mark;
+}
+
+static void multiply_matrix_serial(const Matrix A, const Matrix B, Matrix C)
+{
+    if (A->cols != B->rows)
+    {
+        printf("Matrix dimension mismatch for multiplication\n");
+        exit(1);
+    }
+    // row starts of B; A is walked row by row in place
+    size_t *B_row_ptr = (size_t *)calloc(B->rows + 1, sizeof(size_t));
+    int *mark = init_marks(B->cols);
+    double *acc = (double *)malloc(sizeof(double) * (B->cols > 0 ? B->cols : 1));
+    if (B_row_ptr == NULL || acc == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t k = 0; k < B->length; k++)
+        B_row_ptr[B->data[k].x + 1]++;
+    for (size_t r = 0; r < B->rows; r++)
+        B_row_ptr[r + 1] += B_row_ptr[r];
+
+    // symbolic pass: number of distinct columns per output row
+    size_t total = 0, widest = 0, row_count = 0;
+    for (size_t A_idx = 0; A_idx < A->length; A_idx++)
+    {
+        int row = A->data[A_idx].x, k = A->data[A_idx].y;
+        if (A_idx > 0 && A->data[A_idx - 1].x != row)
+            row_count = 0;
+        for (size_t t = B_row_ptr[k]; t < B_row_ptr[k + 1]; t++)
+            if (mark[B->data[t].y] != row)
+            {
+                mark[B->data[t].y] = row;
+                total++;
+                if (++row_count > widest)
+                    widest = row_count;
+            }
+    }
+    resize_matrix(C, total);
     C->rows = A->rows;
     C->cols = B->cols;
-    C->length = 0;
+    int *cols = (int *)malloc(sizeof(int) * (widest > 0 ? widest : 1));
+    if (cols == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
 
-    size_t A_idx = 0, B_idx = 0, C_idx = 0;
+    // numeric pass, one row of A at a time
+    for (size_t j = 0; j < B->cols; j++)
+        mark[j] = -1;
+    size_t C_idx = 0, A_idx = 0;
     while (A_idx < A->length)
     {
-        size_t A_row_start = A_idx;
-
-        B_idx = 0;
-        // transverse B_T for someone row in A, calculate the a row values in C
-        while (B_idx < B_T->length)
+        int row = A->data[A_idx].x;
+        size_t n = 0;
+        for (; A_idx < A->length && A->data[A_idx].x == row; A_idx++)
         {
-            int current_B_row = B_T->data[B_idx].x;
-            size_t B_row_start = B_idx;
-            double sum = 0.0;
-            // merge A's current row and B_T's current row
-            while (A_idx < A->length && A->data[A_idx].x == A->data[A_row_start].x &&
-                   B_idx < B_T->length && B_T->data[B_idx].x == current_B_row)
+            int k = A->data[A_idx].y;
+            double a = A->data[A_idx].value;
+            for (size_t t = B_row_ptr[k]; t < B_row_ptr[k + 1]; t++)
             {
-                if (A->data[A_idx].y < B_T->data[B_idx].y)
-                {
-                    A_idx++;
-                }
-                else if (A->data[A_idx].y > B_T->data[B_idx].y)
+                int j = B->data[t].y;
+                if (mark[j] != row)
                 {
-                    B_idx++;
-                }
-                else // equal
-                {
-                    sum += A->data[A_idx].value * B_T->data[B_idx].value;
-                    A_idx++;
-                    B_idx++;
+                    mark[j] = row;
+                    acc[j] = a * B->data[t].value;
+                    cols[n++] = j;
                 }
+                else
+                    acc[j] += a * B->data[t].value;
             }
-            // save non-zero result
-            if (sum != 0.0)
+        }
+        // emit the row in column order, dropping sums that cancelled
+        sort_columns(cols, n);
+        for (size_t t = 0; t < n; t++)
+            if (acc[cols[t]] != 0.0)
             {
-                C->data[C_idx].x = A->data[A_row_start].x;
-                C->data[C_idx].y = current_B_row;
-                C->data[C_idx].value = sum;
-                C->length++;
+                C->data[C_idx].x = row;
+                C->data[C_idx].y = cols[t];
+                C->data[C_idx].value = acc[cols[t]];
                 C_idx++;
             }
-            // skip to next row in B_T
-            while (B_idx < B_T->length && B_T->data[B_idx].x == current_B_row)
-                B_idx++;
-            // reset A_idx to the beginning of current row
-            A_idx = A_row_start;
-        }
-        // move to next row in A
-        while (A_idx < A->length && A->data[A_idx].x == A->data[A_row_start].x)
-            A_idx++;
     }
+    C->length = C_idx;
+    resize_matrix(C, C_idx);
+    free(B_row_ptr);
+    free(mark);
+    free(acc);
+    free(cols);
 }
 
 /*
@@ -429,73 +632,2756 @@ void multiply_matrix(const Matrix A, const Matrix B, Matrix C)
     }
 */
 
-// text funtion
-void text_add_matrix()
+// ===== CSR / CSC storage =====
+// CSR: row i holds col_idx/values[row_ptr[i] .. row_ptr[i + 1]), columns ascending
+// CSC: column j holds row_idx/values[col_ptr[j] .. col_ptr[j + 1]), rows ascending
+// 12 bytes per nonzero instead of 16 for a Triple, and a row (column) is found in O(1)
+typedef struct
 {
-    printf("Add Matrix Test:\n");
-    int rows, cols;
-    int num_elem_A, num_elem_B;
-
-    rows = 3;
-    cols = 3;
-    Matrix A, B, C;
-    A = creat_from_array((double *[]){
-                             (double[]){1, 0, 0},
-                             (double[]){0, 2, 0},
-                             (double[]){0, 0, 3}},
-                         rows, cols);
-
-    B = creat_from_array((double *[]){
-                             (double[]){0, 1, 0},
-                             (double[]){0, 0, 2},
-                             (double[]){3, 0, 0}},
-                         rows, cols);
-
-    C = init_matrix(0, rows, cols);
-
-    add_matrix(A, B, C);
+    size_t *row_ptr; // rows + 1 entries
+    int *col_idx;
+    double *values;
+    size_t length, rows, cols, capacity;
+} *CSRMatrix;
 
-    printf("Resultant Matrix C:\n");
-    print_matrix(C, true);
+typedef struct
+{
+    size_t *col_ptr; // cols + 1 entries
+    int *row_idx;
+    double *values;
+    size_t length, rows, cols, capacity;
+} *CSCMatrix;
 
-    free_matrix(&A);
-    free_matrix(&B);
-    free_matrix(&C);
+CSRMatrix init_csr(int capacity, int rows, int cols)
+{
+    CSRMatrix A = (CSRMatrix)malloc(sizeof(*A));
+    if (A == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    A->capacity = capacity > INITIAL_CAPACITY ? capacity : INITIAL_CAPACITY;
+    A->row_ptr = (size_t *)calloc((size_t)rows + 1, sizeof(size_t));
+    A->col_idx = (int *)malloc(sizeof(int) * A->capacity);
+    A->values = (double *)malloc(sizeof(double) * A->capacity);
+    if (A->row_ptr == NULL || A->col_idx == NULL || A->values == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    A->length = 0;
+    A->rows = rows;
+    A->cols = cols;
+    return A;
 }
 
-void text_transpose_matrix()
+CSCMatrix init_csc(int capacity, int rows, int cols)
 {
-    printf("Transpose Matrix Test:\n");
-    int rows, cols;
-    int num_elem_A, num_elem_B;
-
-    rows = 3;
-    cols = 3;
-    Matrix A, B, C;
-    A = creat_from_array((double *[]){
-                             (double[]){1, 1, 0},
-                             (double[]){0, 2, 0},
-                             (double[]){1, 0, 3}},
-                         rows, cols);
+    CSCMatrix A = (CSCMatrix)malloc(sizeof(*A));
+    if (A == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    A->capacity = capacity > INITIAL_CAPACITY ? capacity : INITIAL_CAPACITY;
+    A->col_ptr = (size_t *)calloc((size_t)cols + 1, sizeof(size_t));
+    A->row_idx = (int *)malloc(sizeof(int) * A->capacity);
+    A->values = (double *)malloc(sizeof(double) * A->capacity);
+    if (A->col_ptr == NULL || A->row_idx == NULL || A->values == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    A->length = 0;
+    A->rows = rows;
+    A->cols = cols;
+    return A;
+}
 
-    C = init_matrix(0, rows, cols);
+void free_csr(CSRMatrix *A)
+{
+    free((*A)->row_ptr);
+    free((*A)->col_idx);
+    free((*A)->values);
+    free(*A);
+    *A = NULL;
+}
 
-    transpose_matrix(A, C);
+void free_csc(CSCMatrix *A)
+{
+    free((*A)->col_ptr);
+    free((*A)->row_idx);
+    free((*A)->values);
+    free(*A);
+    *A = NULL;
+}
 
-    printf("Resultant Matrix C:\n");
-    print_matrix(C, true);
+// reallocate index/value arrays; new_capacity 0 is kept at 1 so realloc never frees
+static void resize_entries(int **idx, double **values, size_t *capacity, size_t new_capacity)
+{
+    if (new_capacity == 0)
+        new_capacity = 1;
+    int *new_idx = (int *)realloc(*idx, sizeof(int) * new_capacity);
+    if (new_idx == NULL)
+    {
+        printf("Memory reallocation failed\n");
+        exit(1);
+    }
+    *idx = new_idx;
+    double *new_values = (double *)realloc(*values, sizeof(double) * new_capacity);
+    if (new_values == NULL)
+    {
+        printf("Memory reallocation failed\n");
+        exit(1);
+    }
+    *values = new_values;
+    *capacity = new_capacity;
+}
 
-    free_matrix(&A);
-    free_matrix(&C);
+void resize_csr(CSRMatrix A, size_t new_capacity)
+{
+    resize_entries(&A->col_idx, &A->values, &A->capacity, new_capacity);
 }
 
-void text_multiply_matrix()
+void resize_csc(CSCMatrix A, size_t new_capacity)
 {
-    printf("Multiply Matrix Test:\n");
-    int rows_A = 2, cols_A = 3;
-    int rows_B = 3, cols_B = 2;
+    resize_entries(&A->row_idx, &A->values, &A->capacity, new_capacity);
+}
 
-    Matrix A, B, C;
+// set the shape and make the pointer array fit (major + 1 entries)
+static size_t *reshape_ptr(size_t *ptr, size_t major)
+{
+    size_t *new_ptr = (size_t *)realloc(ptr, sizeof(size_t) * (major + 1));
+    if (new_ptr == NULL)
+    {
+        printf("Memory reallocation failed\n");
+        exit(1);
+    }
+    return new_ptr;
+}
+
+// triples must be sorted by (row, col), as input_matrix and creat_from_array leave them
+void triples_to_csr(const Matrix A, CSRMatrix result)
+{
+    result->row_ptr = reshape_ptr(result->row_ptr, A->rows);
+    result->rows = A->rows;
+    result->cols = A->cols;
+    if (result->capacity < A->length)
+        resize_csr(result, A->length);
+
+    for (size_t i = 0; i <= A->rows; i++)
+        result->row_ptr[i] = 0;
+    for (size_t k = 0; k < A->length; k++)
+    {
+        result->row_ptr[A->data[k].x + 1]++;
+        result->col_idx[k] = A->data[k].y;
+        result->values[k] = A->data[k].value;
+    }
+    for (size_t i = 0; i < A->rows; i++)
+        result->row_ptr[i + 1] += result->row_ptr[i];
+    result->length = A->length;
+}
+
+void csr_to_triples(const CSRMatrix A, Matrix result)
+{
+    if (result->capacity < A->length)
+        resize_matrix(result, A->length);
+    for (size_t i = 0; i < A->rows; i++)
+        for (size_t k = A->row_ptr[i]; k < A->row_ptr[i + 1]; k++)
+        {
+            result->data[k].x = (int)i;
+            result->data[k].y = A->col_idx[k];
+            result->data[k].value = A->values[k];
+        }
+    result->length = A->length;
+    result->rows = A->rows;
+    result->cols = A->cols;
+}
+
+// counting sort by column; stable, so rows stay ascending inside each column
+void triples_to_csc(const Matrix A, CSCMatrix result)
+{
+    result->col_ptr = reshape_ptr(result->col_ptr, A->cols);
+    result->rows = A->rows;
+    result->cols = A->cols;
+    if (result->capacity < A->length)
+        resize_csc(result, A->length);
+
+    size_t *next = (size_t *)calloc(A->cols + 1, sizeof(size_t));
+    if (next == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t k = 0; k < A->length; k++)
+        next[A->data[k].y + 1]++;
+    for (size_t j = 0; j < A->cols; j++)
+        next[j + 1] += next[j];
+    for (size_t j = 0; j <= A->cols; j++)
+        result->col_ptr[j] = next[j];
+    for (size_t k = 0; k < A->length; k++)
+    {
+        size_t pos = next[A->data[k].y]++;
+        result->row_idx[pos] = A->data[k].x;
+        result->values[pos] = A->data[k].value;
+    }
+    result->length = A->length;
+    free(next);
+}
+
+// counting sort by row gives row-major triples again
+void csc_to_triples(const CSCMatrix A, Matrix result)
+{
+    if (result->capacity < A->length)
+        resize_matrix(result, A->length);
+    size_t *next = (size_t *)calloc(A->rows + 1, sizeof(size_t));
+    if (next == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t k = 0; k < A->length; k++)
+        next[A->row_idx[k] + 1]++;
+    for (size_t i = 0; i < A->rows; i++)
+        next[i + 1] += next[i];
+    for (size_t j = 0; j < A->cols; j++)
+        for (size_t k = A->col_ptr[j]; k < A->col_ptr[j + 1]; k++)
+        {
+            size_t pos = next[A->row_idx[k]]++;
+            result->data[pos].x = A->row_idx[k];
+            result->data[pos].y = (int)j;
+            result->data[pos].value = A->values[k];
+        }
+    result->length = A->length;
+    result->rows = A->rows;
+    result->cols = A->cols;
+    free(next);
+}
+
+// counting sort of a compressed matrix by its minor index: the CSR arrays of A
+// become the CSR arrays of A^T, which are also the CSC arrays of A
+static void transpose_compressed(const size_t *ptr, const int *idx, const double *values, size_t major,
+                                 size_t minor, size_t *out_ptr, int *out_idx, double *out_values)
+{
+    size_t *next = (size_t *)calloc(minor + 1, sizeof(size_t));
+    if (next == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t k = 0; k < ptr[major]; k++)
+        next[idx[k] + 1]++;
+    for (size_t j = 0; j < minor; j++)
+        next[j + 1] += next[j];
+    for (size_t j = 0; j <= minor; j++)
+        out_ptr[j] = next[j];
+    for (size_t i = 0; i < major; i++)
+        for (size_t k = ptr[i]; k < ptr[i + 1]; k++)
+        {
+            size_t pos = next[idx[k]]++;
+            out_idx[pos] = (int)i;
+            out_values[pos] = values[k];
+        }
+    free(next);
+}
+
+void transpose_csr(const CSRMatrix A, CSRMatrix result)
+{
+    result->row_ptr = reshape_ptr(result->row_ptr, A->cols);
+    if (result->capacity < A->length)
+        resize_csr(result, A->length);
+    transpose_compressed(A->row_ptr, A->col_idx, A->values, A->rows, A->cols, result->row_ptr, result->col_idx,
+                         result->values);
+    result->length = A->length;
+    result->rows = A->cols;
+    result->cols = A->rows;
+}
+
+void csr_to_csc(const CSRMatrix A, CSCMatrix result)
+{
+    result->col_ptr = reshape_ptr(result->col_ptr, A->cols);
+    if (result->capacity < A->length)
+        resize_csc(result, A->length);
+    transpose_compressed(A->row_ptr, A->col_idx, A->values, A->rows, A->cols, result->col_ptr, result->row_idx,
+                         result->values);
+    result->length = A->length;
+    result->rows = A->rows;
+    result->cols = A->cols;
+}
+
+void add_csr(const CSRMatrix A, const CSRMatrix B, CSRMatrix C)
+{
+    // row by row union of sorted column lists
+    if (A->cols != B->cols || A->rows != B->rows)
+    {
+        printf("Matrix dimension mismatch\n");
+        exit(1);
+    }
+    C->row_ptr = reshape_ptr(C->row_ptr, A->rows);
+    C->rows = A->rows;
+    C->cols = A->cols;
+    if (C->capacity < A->length + B->length)
+        resize_csr(C, A->length + B->length);
+
+    size_t C_idx = 0;
+    C->row_ptr[0] = 0;
+    for (size_t i = 0; i < A->rows; i++)
+    {
+        size_t a = A->row_ptr[i], a_end = A->row_ptr[i + 1];
+        size_t b = B->row_ptr[i], b_end = B->row_ptr[i + 1];
+        while (a < a_end || b < b_end)
+        {
+            if (b == b_end || (a < a_end && A->col_idx[a] < B->col_idx[b]))
+            {
+                C->col_idx[C_idx] = A->col_idx[a];
+                C->values[C_idx++] = A->values[a++];
+            }
+            else if (a == a_end || B->col_idx[b] < A->col_idx[a])
+            {
+                C->col_idx[C_idx] = B->col_idx[b];
+                C->values[C_idx++] = B->values[b++];
+            }
+            else
+            {
+                double summed_value = A->values[a] + B->values[b];
+                if (summed_value != 0.0)
+                {
+                    C->col_idx[C_idx] = A->col_idx[a];
+                    C->values[C_idx++] = summed_value;
+                }
+                a++;
+                b++;
+            }
+        }
+        C->row_ptr[i + 1] = C_idx;
+    }
+    C->length = C_idx;
+    resize_csr(C, C_idx);
+}
+
+// C = A * B, Gustavson over CSR rows; see multiply_matrix_serial
+static void multiply_csr_serial(const CSRMatrix A, const CSRMatrix B, CSRMatrix C)
+{
+    if (A->cols != B->rows)
+    {
+        printf("Matrix dimension mismatch for multiplication\n");
+        exit(1);
+    }
+    C->row_ptr = reshape_ptr(C->row_ptr, A->rows);
+    C->rows = A->rows;
+    C->cols = B->cols;
+    int *mark = init_marks(B->cols);
+    double *acc = (double *)malloc(sizeof(double) * (B->cols > 0 ? B->cols : 1));
+    if (acc == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+
+    // symbolic pass: exact size of every output row
+    C->row_ptr[0] = 0;
+    for (size_t i = 0; i < A->rows; i++)
+    {
+        size_t n = 0;
+        for (size_t k = A->row_ptr[i]; k < A->row_ptr[i + 1]; k++)
+        {
+            int r = A->col_idx[k];
+            for (size_t t = B->row_ptr[r]; t < B->row_ptr[r + 1]; t++)
+                if (mark[B->col_idx[t]] != (int)i)
+                {
+                    mark[B->col_idx[t]] = (int)i;
+                    n++;
+                }
+        }
+        C->row_ptr[i + 1] = C->row_ptr[i] + n;
+    }
+    resize_csr(C, C->row_ptr[A->rows]);
+
+    // numeric pass; the row's column list is gathered in its own output slots,
+    // and rows are compacted when sums cancel to zero
+    for (size_t j = 0; j < B->cols; j++)
+        mark[j] = -1;
+    size_t C_idx = 0, row_start = 0;
+    for (size_t i = 0; i < A->rows; i++)
+    {
+        size_t row_end = C->row_ptr[i + 1], n = 0;
+        for (size_t k = A->row_ptr[i]; k < A->row_ptr[i + 1]; k++)
+        {
+            int r = A->col_idx[k];
+            double a = A->values[k];
+            for (size_t t = B->row_ptr[r]; t < B->row_ptr[r + 1]; t++)
+            {
+                int j = B->col_idx[t];
+                if (mark[j] != (int)i)
+                {
+                    mark[j] = (int)i;
+                    acc[j] = a * B->values[t];
+                    C->col_idx[row_start + n++] = j;
+                }
+                else
+                    acc[j] += a * B->values[t];
+            }
+        }
+        sort_columns(C->col_idx + row_start, n);
+        for (size_t t = row_start; t < row_end; t++)
+        {
+            int j = C->col_idx[t];
+            if (acc[j] != 0.0)
+            {
+                C->col_idx[C_idx] = j;
+                C->values[C_idx++] = acc[j];
+            }
+        }
+        C->row_ptr[i + 1] = C_idx;
+        row_start = row_end;
+    }
+    C->length = C_idx;
+    resize_csr(C, C_idx);
+    free(mark);
+    free(acc);
+}
+
+// ===== Thread pool =====
+// Persistent workers run parallel_for jobs; the calling thread works too (as thread 0).
+// Work is handed out in chunks from a shared atomic counter, so skewed rows balance
+// themselves: a thread that finishes early simply takes the next chunk.
+#define PARALLEL_MIN_WORK 20000 // below this many nonzeros a job runs on the calling thread
+
+typedef void (*RangeTask)(void *ctx, size_t begin, size_t end, int thread);
+
+typedef struct
+{
+    pthread_t *workers;
+    int threads; // workers + the calling thread
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    unsigned long generation; // bumped for every job
+    int running;              // workers still busy with the current job
+    bool stop;
+    RangeTask task;
+    void *ctx;
+    size_t n, chunk;
+    size_t next; // next unclaimed index (atomic)
+} ThreadPool;
+
+static ThreadPool *pool = NULL;
+static int requested_threads = 0; // 0: one per online CPU
+
+static void run_chunks(ThreadPool *p, int thread)
+{
+    for (;;)
+    {
+        size_t begin = __atomic_fetch_add(&p->next, p->chunk, __ATOMIC_RELAXED);
+        if (begin >= p->n)
+            break;
+        size_t end = begin + p->chunk < p->n ? begin + p->chunk : p->n;
+        p->task(p->ctx, begin, end, thread);
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    ThreadPool *p = pool;
+    int thread = (int)(size_t)arg;
+    unsigned long seen = 0;
+    for (;;)
+    {
+        pthread_mutex_lock(&p->lock);
+        while (p->generation == seen && !p->stop)
+            pthread_cond_wait(&p->start, &p->lock);
+        if (p->stop)
+        {
+            pthread_mutex_unlock(&p->lock);
+            return NULL;
+        }
+        seen = p->generation;
+        pthread_mutex_unlock(&p->lock);
+
+        run_chunks(p, thread);
+
+        pthread_mutex_lock(&p->lock);
+        if (--p->running == 0)
+            pthread_cond_signal(&p->done);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+void free_thread_pool()
+{
+    if (pool == NULL)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int t = 1; t < pool->threads; t++)
+        pthread_join(pool->workers[t], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool);
+    pool = NULL;
+}
+
+static ThreadPool *get_thread_pool()
+{
+    if (pool != NULL)
+        return pool;
+    int threads = requested_threads;
+    if (threads <= 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    pool = (ThreadPool *)calloc(1, sizeof(ThreadPool));
+    if (pool == NULL || (pool->workers = (pthread_t *)calloc(threads, sizeof(pthread_t))) == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    pool->threads = threads;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (int t = 1; t < threads; t++)
+        if (pthread_create(&pool->workers[t], NULL, worker_main, (void *)(size_t)t) != 0)
+        {
+            pool->threads = t; // run with the workers that did start
+            break;
+        }
+    return pool;
+}
+
+// 0 restores the default of one thread per online CPU
+void set_num_threads(int threads)
+{
+    free_thread_pool();
+    requested_threads = threads;
+}
+
+int num_threads()
+{
+    return get_thread_pool()->threads;
+}
+
+// run task over [0, n) in chunks of `chunk` indices on all pool threads
+static void parallel_for(size_t n, size_t chunk, RangeTask task, void *ctx)
+{
+    ThreadPool *p = get_thread_pool();
+    if (chunk == 0)
+        chunk = 1;
+    if (p->threads == 1 || n <= chunk)
+    {
+        if (n > 0)
+            task(ctx, 0, n, 0);
+        return;
+    }
+    pthread_mutex_lock(&p->lock);
+    p->task = task;
+    p->ctx = ctx;
+    p->n = n;
+    p->chunk = chunk;
+    p->next = 0;
+    p->running = p->threads - 1;
+    p->generation++;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+
+    run_chunks(p, 0);
+
+    pthread_mutex_lock(&p->lock);
+    while (p->running > 0)
+        pthread_cond_wait(&p->done, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// about 16 chunks per thread, but at least `least` indices per chunk
+static size_t chunk_size(size_t n, size_t least)
+{
+    size_t chunk = n / ((size_t)num_threads() * 16);
+    return chunk > least ? chunk : least;
+}
+
+// ===== Radix sort of triples =====
+// LSD radix sort on the packed key row << col_bits | col, RADIX_BITS per pass, so only
+// as many passes as the shape needs (a 1M x 1M matrix has 40-bit keys: 4 passes).
+// A pass whose digit is the same for every key is skipped. Large inputs are cut into
+// blocks; each block is counted and scattered on the thread pool, and the offsets go
+// digit-major, block-minor so every pass stays stable
+#define RADIX_BITS 11
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_BLOCKS_PER_THREAD 4
+
+typedef struct
+{
+    uint64_t key;
+    double value;
+} SortItem;
+
+typedef struct
+{
+    Matrix A;
+    SortItem *src, *dst;
+    size_t n, block_size;
+    unsigned col_bits, shift;
+    size_t *count; // RADIX_SIZE counters per block
+} RadixJob;
+
+static unsigned bits_for(size_t n) // bits needed to store 0 .. n - 1
+{
+    unsigned bits = 0;
+    while (bits < 64 && ((size_t)1 << bits) < n)
+        bits++;
+    return bits;
+}
+
+static void radix_pack(void *ctx, size_t begin, size_t end, int thread)
+{
+    (void)thread;
+    RadixJob *job = (RadixJob *)ctx;
+    for (size_t b = begin; b < end; b++)
+    {
+        size_t last = (b + 1) * job->block_size < job->n ? (b + 1) * job->block_size : job->n;
+        for (size_t k = b * job->block_size; k < last; k++)
+        {
+            const Triple *t = &job->A->data[k];
+            job->src[k].key = (uint64_t)t->x << job->col_bits | (uint64_t)t->y;
+            job->src[k].value = t->value;
+        }
+    }
+}
+
+static void radix_count(void *ctx, size_t begin, size_t end, int thread)
+{
+    (void)thread;
+    RadixJob *job = (RadixJob *)ctx;
+    for (size_t b = begin; b < end; b++)
+    {
+        size_t *count = job->count + b * RADIX_SIZE;
+        size_t last = (b + 1) * job->block_size < job->n ? (b + 1) * job->block_size : job->n;
+        memset(count, 0, sizeof(size_t) * RADIX_SIZE);
+        for (size_t k = b * job->block_size; k < last; k++)
+            count[(job->src[k].key >> job->shift) & (RADIX_SIZE - 1)]++;
+    }
+}
+
+static void radix_scatter(void *ctx, size_t begin, size_t end, int thread)
+{
+    (void)thread;
+    RadixJob *job = (RadixJob *)ctx;
+    for (size_t b = begin; b < end; b++)
+    {
+        size_t *offset = job->count + b * RADIX_SIZE;
+        size_t last = (b + 1) * job->block_size < job->n ? (b + 1) * job->block_size : job->n;
+        for (size_t k = b * job->block_size; k < last; k++)
+            job->dst[offset[(job->src[k].key >> job->shift) & (RADIX_SIZE - 1)]++] = job->src[k];
+    }
+}
+
+// Sort A->data by (row, col) and sum triples with the same coordinates, dropping
+// sums of zero, so A ends up in the form every other routine expects
+void sort_triples(Matrix A)
+{
+    size_t n = A->length;
+    if (n == 0)
+        return;
+    // input that is already in order (a file written by write_mtx) only needs zeros removed
+    size_t sorted = 1;
+    while (sorted < n && compare_triples(&A->data[sorted - 1], &A->data[sorted]) < 0)
+        sorted++;
+    if (sorted == n)
+    {
+        size_t length = 0;
+        for (size_t k = 0; k < n; k++)
+            if (A->data[k].value != 0.0)
+                A->data[length++] = A->data[k];
+        A->length = length;
+        return;
+    }
+    RadixJob job = {A, NULL, NULL, n, n, bits_for(A->cols), 0, NULL};
+    size_t blocks = 1;
+    if (n >= PARALLEL_MIN_WORK && num_threads() > 1)
+    {
+        blocks = (size_t)num_threads() * RADIX_BLOCKS_PER_THREAD;
+        job.block_size = (n + blocks - 1) / blocks;
+        blocks = (n + job.block_size - 1) / job.block_size;
+    }
+    job.src = (SortItem *)malloc(sizeof(SortItem) * n);
+    job.dst = (SortItem *)malloc(sizeof(SortItem) * n);
+    job.count = (size_t *)malloc(sizeof(size_t) * RADIX_SIZE * blocks);
+    if (job.src == NULL || job.dst == NULL || job.count == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+
+    parallel_for(blocks, 1, radix_pack, &job);
+    unsigned key_bits = job.col_bits + bits_for(A->rows);
+    for (job.shift = 0; job.shift < key_bits; job.shift += RADIX_BITS)
+    {
+        parallel_for(blocks, 1, radix_count, &job);
+        // turn the counts into scatter offsets
+        size_t offset = 0;
+        bool single_digit = false;
+        for (size_t d = 0; d < RADIX_SIZE && !single_digit; d++)
+            for (size_t b = 0; b < blocks; b++)
+            {
+                size_t c = job.count[b * RADIX_SIZE + d];
+                if (c == n)
+                    single_digit = true;
+                job.count[b * RADIX_SIZE + d] = offset;
+                offset += c;
+            }
+        if (single_digit)
+            continue;
+        parallel_for(blocks, 1, radix_scatter, &job);
+        SortItem *swap = job.src;
+        job.src = job.dst;
+        job.dst = swap;
+    }
+
+    // unpack, summing runs of equal keys
+    uint64_t col_mask = ((uint64_t)1 << job.col_bits) - 1;
+    size_t length = 0;
+    for (size_t k = 0; k < n;)
+    {
+        uint64_t key = job.src[k].key;
+        double sum = 0.0;
+        for (; k < n && job.src[k].key == key; k++)
+            sum += job.src[k].value;
+        if (sum != 0.0)
+        {
+            A->data[length].x = (int)(key >> job.col_bits);
+            A->data[length].y = (int)(key & col_mask);
+            A->data[length].value = sum;
+            length++;
+        }
+    }
+    A->length = length;
+    free(job.src);
+    free(job.dst);
+    free(job.count);
+}
+
+// ===== Parallel transpose =====
+// Counting sort by column straight from A->data into the result: every block of A
+// counts its columns, one prefix sum over (column, block) turns the counts into start
+// positions, and the blocks scatter on the thread pool. Blocks keep their order within
+// a column, so rows stay ascending. The histograms live on the heap, and wide matrices
+// get fewer blocks so that they never need more counters than A has entries
+#define TRANSPOSE_BLOCKS_PER_THREAD 4
+
+typedef struct
+{
+    const Matrix A;
+    Triple *out;
+    size_t *offset; // A->cols counters per block
+    size_t block_size;
+} TransposeJob;
+
+static void transpose_count(void *ctx, size_t begin, size_t end, int thread)
+{
+    (void)thread;
+    TransposeJob *job = (TransposeJob *)ctx;
+    const Matrix A = job->A;
+    for (size_t b = begin; b < end; b++)
+    {
+        size_t *count = job->offset + b * A->cols;
+        size_t last = (b + 1) * job->block_size < A->length ? (b + 1) * job->block_size : A->length;
+        memset(count, 0, sizeof(size_t) * A->cols);
+        for (size_t k = b * job->block_size; k < last; k++)
+            count[A->data[k].y]++;
+    }
+}
+
+static void transpose_scatter(void *ctx, size_t begin, size_t end, int thread)
+{
+    (void)thread;
+    TransposeJob *job = (TransposeJob *)ctx;
+    const Matrix A = job->A;
+    for (size_t b = begin; b < end; b++)
+    {
+        size_t *offset = job->offset + b * A->cols;
+        size_t last = (b + 1) * job->block_size < A->length ? (b + 1) * job->block_size : A->length;
+        for (size_t k = b * job->block_size; k < last; k++)
+        {
+            Triple elem = A->data[k];
+            size_t pos = offset[elem.y]++;
+            job->out[pos].x = elem.y;
+            job->out[pos].y = elem.x;
+            job->out[pos].value = elem.value;
+        }
+    }
+}
+
+// result = A^T; result may be A itself
+void transpose_matrix(const Matrix A, Matrix result)
+{
+    size_t n = A->length, cols = A->cols > 0 ? A->cols : 1, blocks = 1;
+    if (n >= PARALLEL_MIN_WORK && num_threads() > 1)
+    {
+        blocks = (size_t)num_threads() * TRANSPOSE_BLOCKS_PER_THREAD;
+        if (blocks > n / cols)
+            blocks = n / cols > 0 ? n / cols : 1;
+    }
+    TransposeJob job = {A, NULL, NULL, n > 0 ? (n + blocks - 1) / blocks : 1};
+    job.offset = (size_t *)malloc(sizeof(size_t) * cols * blocks);
+    // writing into A while reading it would clobber entries not yet moved
+    job.out = result == A ? (Triple *)malloc(sizeof(Triple) * (n > 0 ? n : 1)) : NULL;
+    if (job.offset == NULL || (result == A && job.out == NULL))
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    if (result != A)
+    {
+        if (result->capacity < n)
+            resize_matrix(result, n);
+        job.out = result->data;
+    }
+
+    parallel_for(blocks, 1, transpose_count, &job);
+    size_t start = 0;
+    for (size_t j = 0; j < A->cols; j++)
+        for (size_t b = 0; b < blocks; b++)
+        {
+            size_t count = job.offset[b * A->cols + j];
+            job.offset[b * A->cols + j] = start;
+            start += count;
+        }
+    parallel_for(blocks, 1, transpose_scatter, &job);
+
+    if (result == A)
+    {
+        free(A->data);
+        A->data = job.out;
+        A->capacity = n > 0 ? n : 1;
+    }
+    size_t rows = A->rows;
+    result->length = n;
+    result->rows = A->cols;
+    result->cols = rows;
+    free(job.offset);
+}
+
+// ===== Parallel multiply and SpMV =====
+
+// per-thread hash accumulator: open addressing on the column, sized per row,
+// so memory follows the longest row rather than B->cols for every thread
+typedef struct
+{
+    int *keys; // -1 empty
+    double *values;
+    size_t capacity;
+    unsigned shift;
+} HashAccumulator;
+
+static void prepare_accumulator(HashAccumulator *h, size_t entries)
+{
+    size_t capacity = 16;
+    unsigned bits = 4;
+    while (capacity < entries * 2)
+    {
+        capacity *= 2;
+        bits++;
+    }
+    if (capacity > h->capacity)
+    {
+        free(h->keys);
+        free(h->values);
+        h->keys = (int *)malloc(sizeof(int) * capacity);
+        h->values = (double *)malloc(sizeof(double) * capacity);
+        if (h->keys == NULL || h->values == NULL)
+        {
+            printf("Memory allocation failed\n");
+            exit(1);
+        }
+        h->capacity = capacity;
+    }
+    h->shift = 32 - bits;
+    for (size_t s = 0; s < capacity; s++)
+        h->keys[s] = -1;
+}
+
+// slot of column j (inserted if absent); *fresh tells which
+static size_t accumulator_slot(HashAccumulator *h, int j, bool *fresh)
+{
+    size_t mask = ((size_t)1 << (32 - h->shift)) - 1;
+    size_t s = ((uint32_t)j * 2654435761u) >> h->shift;
+    while (h->keys[s] != -1 && h->keys[s] != j)
+        s = (s + 1) & mask;
+    *fresh = h->keys[s] == -1;
+    h->keys[s] = j;
+    return s;
+}
+
+typedef struct
+{
+    const CSRMatrix A, B;
+    CSRMatrix C;
+    size_t *row_count;         // symbolic, then numeric nonzeros per row
+    HashAccumulator *scratch;  // one per thread
+} SpgemmJob;
+
+static void spgemm_symbolic_rows(void *ctx, size_t begin, size_t end, int thread)
+{
+    SpgemmJob *job = (SpgemmJob *)ctx;
+    const CSRMatrix A = job->A, B = job->B;
+    HashAccumulator *h = &job->scratch[thread];
+    for (size_t i = begin; i < end; i++)
+    {
+        size_t flops = 0;
+        for (size_t k = A->row_ptr[i]; k < A->row_ptr[i + 1]; k++)
+            flops += B->row_ptr[A->col_idx[k] + 1] - B->row_ptr[A->col_idx[k]];
+        size_t n = 0;
+        if (flops > 0)
+        {
+            prepare_accumulator(h, flops);
+            for (size_t k = A->row_ptr[i]; k < A->row_ptr[i + 1]; k++)
+            {
+                int r = A->col_idx[k];
+                for (size_t t = B->row_ptr[r]; t < B->row_ptr[r + 1]; t++)
+                {
+                    bool fresh;
+                    accumulator_slot(h, B->col_idx[t], &fresh);
+                    n += fresh;
+                }
+            }
+        }
+        job->row_count[i] = n;
+    }
+}
+
+static void spgemm_numeric_rows(void *ctx, size_t begin, size_t end, int thread)
+{
+    SpgemmJob *job = (SpgemmJob *)ctx;
+    const CSRMatrix A = job->A, B = job->B;
+    CSRMatrix C = job->C;
+    HashAccumulator *h = &job->scratch[thread];
+    for (size_t i = begin; i < end; i++)
+    {
+        size_t start = C->row_ptr[i], n = 0;
+        if (C->row_ptr[i + 1] == start)
+        {
+            job->row_count[i] = 0;
+            continue;
+        }
+        prepare_accumulator(h, C->row_ptr[i + 1] - start);
+        for (size_t k = A->row_ptr[i]; k < A->row_ptr[i + 1]; k++)
+        {
+            int r = A->col_idx[k];
+            double a = A->values[k];
+            for (size_t t = B->row_ptr[r]; t < B->row_ptr[r + 1]; t++)
+            {
+                bool fresh;
+                size_t s = accumulator_slot(h, B->col_idx[t], &fresh);
+                if (fresh)
+                {
+                    h->values[s] = a * B->values[t];
+                    C->col_idx[start + n++] = B->col_idx[t];
+                }
+                else
+                    h->values[s] += a * B->values[t];
+            }
+        }
+        sort_columns(C->col_idx + start, n);
+        size_t kept = 0;
+        for (size_t t = 0; t < n; t++)
+        {
+            bool fresh;
+            int j = C->col_idx[start + t];
+            double v = h->values[accumulator_slot(h, j, &fresh)];
+            if (v != 0.0)
+            {
+                C->col_idx[start + kept] = j;
+                C->values[start + kept++] = v;
+            }
+        }
+        job->row_count[i] = kept;
+    }
+}
+
+// C = A * B; rows of A are spread over the thread pool with dynamic scheduling.
+// Rows are sized by a symbolic pass and placed by a prefix sum of their counts
+void multiply_csr(const CSRMatrix A, const CSRMatrix B, CSRMatrix C)
+{
+    if (A->cols != B->rows)
+    {
+        printf("Matrix dimension mismatch for multiplication\n");
+        exit(1);
+    }
+    if (num_threads() == 1 || A->length + B->length < PARALLEL_MIN_WORK)
+    {
+        multiply_csr_serial(A, B, C);
+        return;
+    }
+    C->row_ptr = reshape_ptr(C->row_ptr, A->rows);
+    C->rows = A->rows;
+    C->cols = B->cols;
+    SpgemmJob job = {A, B, C, NULL, NULL};
+    job.row_count = (size_t *)malloc(sizeof(size_t) * (A->rows > 0 ? A->rows : 1));
+    job.scratch = (HashAccumulator *)calloc(num_threads(), sizeof(HashAccumulator));
+    if (job.row_count == NULL || job.scratch == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    size_t chunk = chunk_size(A->rows, 16);
+
+    parallel_for(A->rows, chunk, spgemm_symbolic_rows, &job);
+    C->row_ptr[0] = 0;
+    for (size_t i = 0; i < A->rows; i++)
+        C->row_ptr[i + 1] = C->row_ptr[i] + job.row_count[i];
+    resize_csr(C, C->row_ptr[A->rows]);
+
+    parallel_for(A->rows, chunk, spgemm_numeric_rows, &job);
+    // rows whose sums cancelled to zero came out shorter: close the gaps
+    size_t C_idx = 0;
+    for (size_t i = 0; i < A->rows; i++)
+    {
+        size_t start = C->row_ptr[i];
+        if (start != C_idx)
+        {
+            memmove(C->col_idx + C_idx, C->col_idx + start, sizeof(int) * job.row_count[i]);
+            memmove(C->values + C_idx, C->values + start, sizeof(double) * job.row_count[i]);
+        }
+        C->row_ptr[i] = C_idx;
+        C_idx += job.row_count[i];
+    }
+    C->row_ptr[A->rows] = C_idx;
+    C->length = C_idx;
+    resize_csr(C, C_idx);
+
+    for (int t = 0; t < num_threads(); t++)
+    {
+        free(job.scratch[t].keys);
+        free(job.scratch[t].values);
+    }
+    free(job.scratch);
+    free(job.row_count);
+}
+
+// large triple products go through CSR so they can use the parallel kernel
+void multiply_matrix(const Matrix A, const Matrix B, Matrix C)
+{
+    if (num_threads() == 1 || A->length + B->length < PARALLEL_MIN_WORK)
+    {
+        multiply_matrix_serial(A, B, C);
+        return;
+    }
+    if (A->cols != B->rows)
+    {
+        printf("Matrix dimension mismatch for multiplication\n");
+        exit(1);
+    }
+    CSRMatrix A_csr = init_csr(0, A->rows, A->cols);
+    CSRMatrix B_csr = init_csr(0, B->rows, B->cols);
+    CSRMatrix C_csr = init_csr(0, A->rows, B->cols);
+    triples_to_csr(A, A_csr);
+    triples_to_csr(B, B_csr);
+    multiply_csr(A_csr, B_csr, C_csr);
+    free_csr(&A_csr);
+    free_csr(&B_csr);
+    csr_to_triples(C_csr, C);
+    resize_matrix(C, C->length);
+    free_csr(&C_csr);
+}
+
+// A right-hand matrix prepared once for many products: the row index every multiply
+// would otherwise rebuild from the triples, and its transpose, made on first request.
+// The cache is a snapshot that does not refer back to B: after B changes, free it and
+// cache B again; B itself may be freed while the cache is in use
+typedef struct
+{
+    CSRMatrix csr;
+    Matrix transpose; // NULL until cached_transpose asks for it
+} *CachedMatrix;
+
+CachedMatrix cache_matrix(const Matrix B)
+{
+    CachedMatrix cached = (CachedMatrix)malloc(sizeof(*cached));
+    if (cached == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    cached->csr = init_csr(0, B->rows, B->cols);
+    triples_to_csr(B, cached->csr);
+    cached->transpose = NULL;
+    return cached;
+}
+
+void free_cached(CachedMatrix *B)
+{
+    free_csr(&(*B)->csr);
+    if ((*B)->transpose != NULL)
+        free_matrix(&(*B)->transpose);
+    free(*B);
+    *B = NULL;
+}
+
+// B's transpose, built from the cached row index on first use; it belongs to the
+// cache, so callers must not modify or free it (free_cached does)
+Matrix cached_transpose(CachedMatrix B)
+{
+    if (B->transpose == NULL)
+    {
+        CSRMatrix T = init_csr(0, B->csr->cols, B->csr->rows);
+        transpose_csr(B->csr, T);
+        B->transpose = init_matrix(0, T->rows, T->cols);
+        csr_to_triples(T, B->transpose);
+        free_csr(&T);
+    }
+    return B->transpose;
+}
+
+// C = A * B reusing B's cached row index; same result as multiply_matrix
+void multiply_cached(const Matrix A, CachedMatrix B, Matrix C)
+{
+    if (A->cols != B->csr->rows)
+    {
+        printf("Matrix dimension mismatch for multiplication\n");
+        exit(1);
+    }
+    CSRMatrix A_csr = init_csr(0, A->rows, A->cols);
+    CSRMatrix C_csr = init_csr(0, A->rows, B->csr->cols);
+    triples_to_csr(A, A_csr);
+    multiply_csr(A_csr, B->csr, C_csr);
+    free_csr(&A_csr);
+    csr_to_triples(C_csr, C);
+    resize_matrix(C, C->length);
+    free_csr(&C_csr);
+}
+
+// ===== Masked multiply =====
+// C = (A * B) o M computes only the entries M stores (M's values are ignored): each
+// one is the sorted-merge dot product of row i of A with column j of B, read from CSC.
+// Far cheaper than the full product when M is sparse, as in triangle counting
+
+// dot product of two ascending index lists; a much shorter side is binary-searched in the other
+static double sparse_dot(const int *a_idx, const double *a_val, size_t a_len, const int *b_idx, const double *b_val,
+                         size_t b_len)
+{
+    double sum = 0.0;
+    if (a_len > 8 * b_len || b_len > 8 * a_len)
+    {
+        if (a_len > b_len)
+            return sparse_dot(b_idx, b_val, b_len, a_idx, a_val, a_len);
+        size_t low = 0;
+        for (size_t s = 0; s < a_len; s++)
+        {
+            size_t high = b_len;
+            while (low < high)
+            {
+                size_t mid = low + (high - low) / 2;
+                if (b_idx[mid] < a_idx[s])
+                    low = mid + 1;
+                else
+                    high = mid;
+            }
+            if (low < b_len && b_idx[low] == a_idx[s])
+                sum += a_val[s] * b_val[low];
+        }
+        return sum;
+    }
+    size_t s = 0, t = 0;
+    while (s < a_len && t < b_len)
+    {
+        if (a_idx[s] < b_idx[t])
+            s++;
+        else if (a_idx[s] > b_idx[t])
+            t++;
+        else
+            sum += a_val[s++] * b_val[t++];
+    }
+    return sum;
+}
+
+typedef struct
+{
+    const CSRMatrix A;
+    const CSCMatrix B;
+    const CSRMatrix M;
+    CSRMatrix C;
+    size_t *row_count;
+} MaskedJob;
+
+// row i of C goes into the slots of row i of M, then the row's count is recorded
+static void masked_rows(void *ctx, size_t begin, size_t end, int thread)
+{
+    (void)thread;
+    MaskedJob *job = (MaskedJob *)ctx;
+    const CSRMatrix A = job->A, M = job->M;
+    const CSCMatrix B = job->B;
+    CSRMatrix C = job->C;
+    for (size_t i = begin; i < end; i++)
+    {
+        size_t out = M->row_ptr[i], a = A->row_ptr[i], a_len = A->row_ptr[i + 1] - a;
+        for (size_t t = M->row_ptr[i]; t < M->row_ptr[i + 1] && a_len > 0; t++)
+        {
+            int j = M->col_idx[t];
+            size_t b = B->col_ptr[j];
+            double v = sparse_dot(A->col_idx + a, A->values + a, a_len, B->row_idx + b, B->values + b,
+                                  B->col_ptr[j + 1] - b);
+            if (v != 0.0)
+            {
+                C->col_idx[out] = j;
+                C->values[out++] = v;
+            }
+        }
+        job->row_count[i] = out - M->row_ptr[i];
+    }
+}
+
+void masked_multiply_csr(const CSRMatrix A, const CSCMatrix B, const CSRMatrix M, CSRMatrix C)
+{
+    if (A->cols != B->rows || M->rows != A->rows || M->cols != B->cols)
+    {
+        printf("Matrix dimension mismatch for multiplication\n");
+        exit(1);
+    }
+    C->row_ptr = reshape_ptr(C->row_ptr, A->rows);
+    C->rows = A->rows;
+    C->cols = B->cols;
+    resize_csr(C, M->length);
+    MaskedJob job = {A, B, M, C, (size_t *)malloc(sizeof(size_t) * (A->rows > 0 ? A->rows : 1))};
+    if (job.row_count == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    if (A->length + M->length < PARALLEL_MIN_WORK)
+        masked_rows(&job, 0, A->rows, 0);
+    else
+        parallel_for(A->rows, chunk_size(A->rows, 16), masked_rows, &job);
+
+    // close the gaps left by mask entries that came out zero
+    size_t C_idx = 0;
+    for (size_t i = 0; i < A->rows; i++)
+    {
+        size_t start = M->row_ptr[i];
+        if (start != C_idx)
+        {
+            memmove(C->col_idx + C_idx, C->col_idx + start, sizeof(int) * job.row_count[i]);
+            memmove(C->values + C_idx, C->values + start, sizeof(double) * job.row_count[i]);
+        }
+        C->row_ptr[i] = C_idx;
+        C_idx += job.row_count[i];
+    }
+    C->row_ptr[A->rows] = C_idx;
+    C->length = C_idx;
+    resize_csr(C, C_idx);
+    free(job.row_count);
+}
+
+// triple form of masked_multiply_csr
+void masked_multiply_matrix(const Matrix A, const Matrix B, const Matrix M, Matrix C)
+{
+    CSRMatrix A_csr = init_csr(0, A->rows, A->cols), M_csr = init_csr(0, M->rows, M->cols);
+    CSRMatrix C_csr = init_csr(0, A->rows, B->cols);
+    CSCMatrix B_csc = init_csc(0, B->rows, B->cols);
+    triples_to_csr(A, A_csr);
+    triples_to_csc(B, B_csc);
+    triples_to_csr(M, M_csr);
+    masked_multiply_csr(A_csr, B_csc, M_csr, C_csr);
+    csr_to_triples(C_csr, C);
+    resize_matrix(C, C->length);
+    free_csr(&A_csr);
+    free_csr(&M_csr);
+    free_csr(&C_csr);
+    free_csc(&B_csc);
+}
+
+typedef struct
+{
+    const CSRMatrix A;
+    const double *x;
+    double *y;
+} SpmvJob;
+
+static void spmv_rows(void *ctx, size_t begin, size_t end, int thread)
+{
+    (void)thread;
+    SpmvJob *job = (SpmvJob *)ctx;
+    const size_t *row_ptr = job->A->row_ptr;
+    const int *col_idx = job->A->col_idx;
+    const double *values = job->A->values, *x = job->x;
+    for (size_t i = begin; i < end; i++)
+    {
+        double sum = 0.0;
+        for (size_t k = row_ptr[i]; k < row_ptr[i + 1]; k++)
+            sum += values[k] * x[col_idx[k]];
+        job->y[i] = sum;
+    }
+}
+
+// y = A * x; x has A->cols entries, y has A->rows entries and must not overlap x
+void spmv(const CSRMatrix A, const double *x, double *y)
+{
+    SpmvJob job = {A, x, y};
+    if (A->length < PARALLEL_MIN_WORK)
+        spmv_rows(&job, 0, A->rows, 0);
+    else
+        parallel_for(A->rows, chunk_size(A->rows, 64), spmv_rows, &job);
+}
+
+// ===== SELL-C-sigma storage =====
+// Rows are cut into slices of SELL_CHUNK rows and each slice is stored column-major,
+// padded to its longest row: entry k of lane l sits at slice_ptr[s] + k * SELL_CHUNK + l.
+// One SIMD register then covers a whole slice, one gather per step. To keep the padding
+// small, rows are sorted by length (longest first) inside windows of sigma rows; perm
+// maps a sorted row back to the row of A. sigma = 1 keeps the original order
+#define SELL_CHUNK 8 // rows per slice: one AVX-512 register, two AVX2 registers
+
+typedef struct
+{
+    size_t *slice_ptr; // slices + 1 entries
+    int *col_idx;      // padding points at column 0 with value 0
+    double *values;
+    int *perm;         // sorted row -> row of A
+    size_t length, rows, cols, slices, sigma;
+} *SELLMatrix;
+
+SELLMatrix init_sell(int rows, int cols)
+{
+    SELLMatrix A = (SELLMatrix)calloc(1, sizeof(*A));
+    if (A == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    A->rows = rows;
+    A->cols = cols;
+    A->sigma = 1;
+    return A;
+}
+
+void free_sell(SELLMatrix *A)
+{
+    free((*A)->slice_ptr);
+    free((*A)->col_idx);
+    free((*A)->values);
+    free((*A)->perm);
+    free(*A);
+    *A = NULL;
+}
+
+typedef struct
+{
+    size_t length;
+    int row;
+} RowLength;
+
+// longest first, ties in row order so the sort is deterministic
+static int compare_row_lengths(const void *a, const void *b)
+{
+    const RowLength *r1 = (const RowLength *)a, *r2 = (const RowLength *)b;
+    if (r1->length != r2->length)
+        return (r1->length < r2->length) - (r1->length > r2->length);
+    return (r1->row > r2->row) - (r1->row < r2->row);
+}
+
+// row order after sorting inside sigma windows; returns the padded entry count
+static size_t sell_order(const size_t *row_ptr, size_t rows, size_t sigma, RowLength *order)
+{
+    for (size_t i = 0; i < rows; i++)
+    {
+        order[i].length = row_ptr[i + 1] - row_ptr[i];
+        order[i].row = (int)i;
+    }
+    if (sigma > 1)
+        for (size_t w = 0; w < rows; w += sigma)
+            qsort(order + w, (rows - w < sigma ? rows - w : sigma), sizeof(RowLength), compare_row_lengths);
+    size_t padded = 0;
+    for (size_t s = 0; s * SELL_CHUNK < rows; s++)
+    {
+        size_t width = 0;
+        for (size_t l = 0; l < SELL_CHUNK && s * SELL_CHUNK + l < rows; l++)
+            if (order[s * SELL_CHUNK + l].length > width)
+                width = order[s * SELL_CHUNK + l].length;
+        padded += width * SELL_CHUNK;
+    }
+    return padded;
+}
+
+static RowLength *init_row_order(size_t rows)
+{
+    RowLength *order = (RowLength *)malloc(sizeof(RowLength) * (rows > 0 ? rows : 1));
+    if (order == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    return order;
+}
+
+void csr_to_sell(const CSRMatrix A, SELLMatrix result, size_t sigma)
+{
+    if (sigma == 0)
+        sigma = 1;
+    RowLength *order = init_row_order(A->rows);
+    size_t padded = sell_order(A->row_ptr, A->rows, sigma, order);
+    size_t slices = (A->rows + SELL_CHUNK - 1) / SELL_CHUNK;
+
+    free(result->slice_ptr);
+    free(result->col_idx);
+    free(result->values);
+    free(result->perm);
+    result->slice_ptr = (size_t *)malloc(sizeof(size_t) * (slices + 1));
+    result->col_idx = (int *)malloc(sizeof(int) * (padded > 0 ? padded : 1));
+    result->values = (double *)malloc(sizeof(double) * (padded > 0 ? padded : 1));
+    result->perm = (int *)malloc(sizeof(int) * (slices * SELL_CHUNK > 0 ? slices * SELL_CHUNK : 1));
+    if (result->slice_ptr == NULL || result->col_idx == NULL || result->values == NULL || result->perm == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    result->rows = A->rows;
+    result->cols = A->cols;
+    result->length = A->length;
+    result->slices = slices;
+    result->sigma = sigma;
+
+    result->slice_ptr[0] = 0;
+    for (size_t s = 0; s < slices; s++)
+    {
+        size_t base = result->slice_ptr[s], width = 0;
+        for (size_t l = 0; l < SELL_CHUNK; l++)
+        {
+            size_t r = s * SELL_CHUNK + l;
+            // lanes past the last row get -1 and stay all padding
+            result->perm[r] = r < A->rows ? order[r].row : -1;
+            if (r < A->rows && order[r].length > width)
+                width = order[r].length;
+        }
+        for (size_t l = 0; l < SELL_CHUNK; l++)
+        {
+            int row = result->perm[s * SELL_CHUNK + l];
+            size_t begin = row >= 0 ? A->row_ptr[row] : 0, n = row >= 0 ? A->row_ptr[row + 1] - begin : 0;
+            for (size_t k = 0; k < width; k++)
+            {
+                size_t slot = base + k * SELL_CHUNK + l;
+                result->col_idx[slot] = k < n ? A->col_idx[begin + k] : 0;
+                result->values[slot] = k < n ? A->values[begin + k] : 0.0;
+            }
+        }
+        result->slice_ptr[s + 1] = base + width * SELL_CHUNK;
+    }
+    free(order);
+}
+
+typedef struct
+{
+    const SELLMatrix A;
+    const double *x;
+    double *y;
+} SellJob;
+
+static void sell_slices(void *ctx, size_t begin, size_t end, int thread)
+{
+    (void)thread;
+    SellJob *job = (SellJob *)ctx;
+    const SELLMatrix A = job->A;
+    const double *x = job->x;
+    for (size_t s = begin; s < end; s++)
+    {
+        const int *col = A->col_idx + A->slice_ptr[s];
+        const double *val = A->values + A->slice_ptr[s];
+        size_t width = (A->slice_ptr[s + 1] - A->slice_ptr[s]) / SELL_CHUNK;
+        double sum[SELL_CHUNK];
+#if defined(__AVX512F__)
+        __m512d acc = _mm512_setzero_pd();
+        for (size_t k = 0; k < width; k++, col += SELL_CHUNK, val += SELL_CHUNK)
+        {
+            __m256i idx = _mm256_loadu_si256((const __m256i *)col);
+            acc = _mm512_fmadd_pd(_mm512_loadu_pd(val), _mm512_i32gather_pd(idx, x, 8), acc);
+        }
+        _mm512_storeu_pd(sum, acc);
+#elif defined(__AVX2__)
+        __m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+        for (size_t k = 0; k < width; k++, col += SELL_CHUNK, val += SELL_CHUNK)
+        {
+            __m256d x_lo = _mm256_i32gather_pd(x, _mm_loadu_si128((const __m128i *)col), 8);
+            __m256d x_hi = _mm256_i32gather_pd(x, _mm_loadu_si128((const __m128i *)(col + 4)), 8);
+#ifdef __FMA__
+            lo = _mm256_fmadd_pd(_mm256_loadu_pd(val), x_lo, lo);
+            hi = _mm256_fmadd_pd(_mm256_loadu_pd(val + 4), x_hi, hi);
+#else
+            lo = _mm256_add_pd(lo, _mm256_mul_pd(_mm256_loadu_pd(val), x_lo));
+            hi = _mm256_add_pd(hi, _mm256_mul_pd(_mm256_loadu_pd(val + 4), x_hi));
+#endif
+        }
+        _mm256_storeu_pd(sum, lo);
+        _mm256_storeu_pd(sum + 4, hi);
+#else
+        // the lane loop has no dependences between lanes, so compilers vectorize it
+        for (size_t l = 0; l < SELL_CHUNK; l++)
+            sum[l] = 0.0;
+        for (size_t k = 0; k < width; k++, col += SELL_CHUNK, val += SELL_CHUNK)
+            for (size_t l = 0; l < SELL_CHUNK; l++)
+                sum[l] += val[l] * x[col[l]];
+#endif
+        for (size_t l = 0; l < SELL_CHUNK; l++)
+        {
+            int row = A->perm[s * SELL_CHUNK + l];
+            if (row >= 0)
+                job->y[row] = sum[l];
+        }
+    }
+}
+
+// y = A * x on SELL-C-sigma; same contract as spmv
+void spmv_sell(const SELLMatrix A, const double *x, double *y)
+{
+    SellJob job = {A, x, y};
+    if (A->length < PARALLEL_MIN_WORK)
+        sell_slices(&job, 0, A->slices, 0);
+    else
+        parallel_for(A->slices, chunk_size(A->slices, 8), sell_slices, &job);
+}
+
+// y = A * x straight from the triples, for comparison
+void spmv_matrix(const Matrix A, const double *x, double *y)
+{
+    for (size_t i = 0; i < A->rows; i++)
+        y[i] = 0.0;
+    for (size_t k = 0; k < A->length; k++)
+        y[A->data[k].x] += A->data[k].value * x[A->data[k].y];
+}
+
+typedef enum
+{
+    SPMV_CSR,
+    SPMV_SELL
+} SpmvFormat;
+
+// Pick the storage for repeated y = A * x from the row-length distribution.
+// SELL pays off when slices pad little: try growing sort windows and keep the
+// smallest one (the least reordering of y) that fills at least 85% of the slots.
+// Very short rows leave gathers mostly idle, and heavy skew pads even when sorted,
+// so those stay on CSR. *sigma receives the window to pass to csr_to_sell
+SpmvFormat choose_spmv_format(const CSRMatrix A, size_t *sigma)
+{
+    *sigma = 1;
+    if (A->rows < SELL_CHUNK || A->length < 2 * A->rows)
+        return SPMV_CSR;
+    RowLength *order = init_row_order(A->rows);
+    SpmvFormat format = SPMV_CSR;
+    size_t windows[] = {1, 4 * SELL_CHUNK, 32 * SELL_CHUNK, 256 * SELL_CHUNK, A->rows};
+    for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++)
+    {
+        size_t padded = sell_order(A->row_ptr, A->rows, windows[w], order);
+        if (A->length * 100 >= padded * 85)
+        {
+            format = SPMV_SELL;
+            *sigma = windows[w];
+            break;
+        }
+    }
+    free(order);
+    return format;
+}
+
+// ===== Matrix Market files =====
+// Coordinate format only: real, integer or pattern values; general, symmetric or
+// skew-symmetric storage. The file is mapped read-only and the entry lines are cut
+// into chunks at newlines; every chunk is parsed on the thread pool straight into
+// its own slice of A->data, then the gaps are closed and sort_triples orders the result
+#define MTX_CHUNK_BYTES (4 << 20) // at least this much text per parse task
+
+typedef enum
+{
+    MTX_GENERAL,
+    MTX_SYMMETRIC,
+    MTX_SKEW
+} MtxSymmetry;
+
+typedef struct
+{
+    const char *text, *end; // entry section of the file
+    const char **cut;       // chunk c is [cut[c], cut[c + 1])
+    size_t *first;          // first slot of chunk c in A->data
+    size_t *count;          // entries chunk c produced
+    const char **error;     // first bad line of chunk c, or NULL
+    Matrix A;
+    bool pattern;
+    MtxSymmetry symmetry;
+} MtxJob;
+
+static const char *skip_blanks(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+    return p;
+}
+
+static const char *parse_index(const char *p, const char *end, long long *value)
+{
+    p = skip_blanks(p, end);
+    const char *start = p;
+    long long v = 0;
+    while (p < end && *p >= '0' && *p <= '9' && v < (1LL << 40))
+        v = v * 10 + (*p++ - '0');
+    *value = v;
+    return p > start && (p == end || *p < '0' || *p > '9') ? p : NULL;
+}
+
+// decimal to double: exact when the digits fit in 2^53 and the power of ten is
+// exact too (|exponent| <= 22); anything else goes through strtod
+static const char *parse_value(const char *p, const char *end, double *value)
+{
+    static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    p = skip_blanks(p, end);
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    uint64_t digits = 0;
+    int significant = 0, exponent = 0;
+    bool any = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, any = true)
+        if (significant < 19)
+        {
+            digits = digits * 10 + (uint64_t)(*p - '0');
+            significant += digits != 0;
+        }
+        else
+            exponent++;
+    if (p < end && *p == '.')
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true)
+            if (significant < 19)
+            {
+                digits = digits * 10 + (uint64_t)(*p - '0');
+                significant += digits != 0;
+                exponent--;
+            }
+    if (!any)
+        return NULL;
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *q = p + 1;
+        bool negative_exp = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            negative_exp = *q++ == '-';
+        int e = 0;
+        if (q < end && *q >= '0' && *q <= '9')
+        {
+            for (; q < end && *q >= '0' && *q <= '9'; q++)
+                if (e < 100000)
+                    e = e * 10 + (*q - '0');
+            exponent += negative_exp ? -e : e;
+            p = q;
+        }
+    }
+    if (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+        return NULL;
+    if (digits < ((uint64_t)1 << 53) && exponent >= -22 && exponent <= 22)
+    {
+        double v = (double)digits;
+        v = exponent < 0 ? v / pow10[-exponent] : v * pow10[exponent];
+        *value = negative ? -v : v;
+        return p;
+    }
+    char buf[128]; // the mapping is not NUL-terminated
+    size_t len = (size_t)(p - start);
+    if (len >= sizeof(buf))
+        return NULL;
+    memcpy(buf, start, len);
+    buf[len] = '\0';
+    *value = strtod(buf, NULL);
+    return p;
+}
+
+static void mtx_parse_chunks(void *ctx, size_t begin, size_t end, int thread)
+{
+    (void)thread;
+    MtxJob *job = (MtxJob *)ctx;
+    Matrix A = job->A;
+    for (size_t c = begin; c < end; c++)
+    {
+        Triple *out = A->data + job->first[c];
+        size_t n = 0;
+        const char *p = job->cut[c], *stop = job->cut[c + 1];
+        job->error[c] = NULL;
+        while (p < stop)
+        {
+            const char *line = p;
+            const char *eol = (const char *)memchr(p, '\n', (size_t)(stop - p));
+            if (eol == NULL)
+                eol = stop;
+            p = skip_blanks(p, eol);
+            if (p == eol || *p == '%')
+            {
+                p = eol + 1;
+                continue;
+            }
+            long long r, col;
+            double v = 1.0;
+            p = parse_index(p, eol, &r);
+            if (p != NULL)
+                p = parse_index(p, eol, &col);
+            if (p != NULL && !job->pattern)
+                p = parse_value(p, eol, &v);
+            if (p == NULL || skip_blanks(p, eol) != eol || r < 1 || r > (long long)A->rows || col < 1 ||
+                col > (long long)A->cols)
+            {
+                job->error[c] = line;
+                break;
+            }
+            out[n].x = (int)(r - 1);
+            out[n].y = (int)(col - 1);
+            out[n].value = v;
+            n++;
+            if (job->symmetry != MTX_GENERAL && r != col) // only one triangle is stored
+            {
+                out[n].x = (int)(col - 1);
+                out[n].y = (int)(r - 1);
+                out[n].value = job->symmetry == MTX_SKEW ? -v : v;
+                n++;
+            }
+            p = eol + 1;
+        }
+        job->count[c] = n;
+    }
+}
+
+static void mtx_count_lines(void *ctx, size_t begin, size_t end, int thread)
+{
+    (void)thread;
+    MtxJob *job = (MtxJob *)ctx;
+    for (size_t c = begin; c < end; c++)
+    {
+        size_t lines = 0;
+        for (const char *p = job->cut[c]; p < job->cut[c + 1]; p++)
+        {
+            p = (const char *)memchr(p, '\n', (size_t)(job->cut[c + 1] - p));
+            lines++;
+            if (p == NULL)
+                break;
+        }
+        job->count[c] = lines;
+    }
+}
+
+// header line and size line; returns the start of the entries or NULL
+static const char *parse_mtx_header(const char *p, const char *end, Matrix *A, bool *pattern,
+                                    MtxSymmetry *symmetry)
+{
+    const char *eol = (const char *)memchr(p, '\n', (size_t)(end - p));
+    char header[256], object[32], format[32], field[32], symm[32];
+    size_t len = eol ? (size_t)(eol - p) : (size_t)(end - p);
+    if (len >= sizeof(header))
+        return NULL;
+    memcpy(header, p, len);
+    header[len] = '\0';
+    for (size_t i = 0; i < len; i++) // the keywords are case-insensitive
+        header[i] = (char)tolower((unsigned char)header[i]);
+    if (sscanf(header, "%%%%matrixmarket %31s %31s %31s %31s", object, format, field, symm) != 4 ||
+        strcmp(object, "matrix") != 0 || strcmp(format, "coordinate") != 0)
+        return NULL;
+    if (strcmp(field, "real") != 0 && strcmp(field, "integer") != 0 && strcmp(field, "pattern") != 0)
+        return NULL;
+    *pattern = strcmp(field, "pattern") == 0;
+    if (strcmp(symm, "general") == 0)
+        *symmetry = MTX_GENERAL;
+    else if (strcmp(symm, "symmetric") == 0)
+        *symmetry = MTX_SYMMETRIC;
+    else if (strcmp(symm, "skew-symmetric") == 0)
+        *symmetry = MTX_SKEW;
+    else
+        return NULL;
+
+    // comments, then "rows cols entries"
+    while (eol != NULL)
+    {
+        p = skip_blanks(eol + 1, end);
+        eol = p < end ? (const char *)memchr(p, '\n', (size_t)(end - p)) : NULL;
+        if (p < end && *p != '%' && *p != '\n')
+            break;
+    }
+    long long rows, cols, entries;
+    const char *q = parse_index(p, eol ? eol : end, &rows);
+    if (q != NULL)
+        q = parse_index(q, eol ? eol : end, &cols);
+    if (q != NULL)
+        q = parse_index(q, eol ? eol : end, &entries);
+    if (q == NULL || rows > INT_MAX || cols > INT_MAX)
+        return NULL;
+    *A = init_matrix(0, (int)rows, (int)cols);
+    return eol ? eol + 1 : end;
+}
+
+// Load a Matrix Market file; returns NULL (with a message) when it cannot be read
+Matrix read_mtx(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        printf("Cannot open %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *text = size > 0 ? (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (text == MAP_FAILED || text == NULL)
+    {
+        printf("Cannot map %s\n", path);
+        return NULL;
+    }
+    madvise((void *)text, size, MADV_SEQUENTIAL);
+
+    MtxJob job;
+    memset(&job, 0, sizeof(job));
+    job.end = text + size;
+    job.text = parse_mtx_header(text, job.end, &job.A, &job.pattern, &job.symmetry);
+    if (job.text == NULL)
+    {
+        printf("%s is not a coordinate Matrix Market file\n", path);
+        munmap((void *)text, size);
+        return NULL;
+    }
+
+    // chunk boundaries, moved forward to the next line start
+    size_t bytes = (size_t)(job.end - job.text);
+    size_t chunks = bytes / MTX_CHUNK_BYTES + 1;
+    if (chunks > (size_t)num_threads() * 4)
+        chunks = (size_t)num_threads() * 4;
+    job.cut = (const char **)malloc(sizeof(char *) * (chunks + 1));
+    job.first = (size_t *)malloc(sizeof(size_t) * chunks);
+    job.count = (size_t *)malloc(sizeof(size_t) * chunks);
+    job.error = (const char **)malloc(sizeof(char *) * chunks);
+    if (job.cut == NULL || job.first == NULL || job.count == NULL || job.error == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    job.cut[0] = job.text;
+    for (size_t c = 1; c < chunks; c++)
+    {
+        const char *p = job.text + bytes / chunks * c;
+        if (p < job.cut[c - 1])
+            p = job.cut[c - 1];
+        const char *eol = (const char *)memchr(p, '\n', (size_t)(job.end - p));
+        job.cut[c] = eol ? eol + 1 : job.end;
+    }
+    job.cut[chunks] = job.end;
+
+    // a line gives at most one entry, two when the other triangle is implied
+    parallel_for(chunks, 1, mtx_count_lines, &job);
+    size_t slots = 0;
+    for (size_t c = 0; c < chunks; c++)
+    {
+        job.first[c] = slots;
+        slots += job.count[c] * (job.symmetry == MTX_GENERAL ? 1 : 2);
+    }
+    resize_matrix(job.A, slots);
+    parallel_for(chunks, 1, mtx_parse_chunks, &job);
+
+    Matrix A = job.A;
+    size_t length = 0;
+    for (size_t c = 0; c < chunks && A != NULL; c++)
+    {
+        if (job.error[c] != NULL)
+        {
+            size_t line = 1;
+            for (const char *p = text; p < job.error[c]; p++)
+                line += *p == '\n';
+            printf("%s:%zu: bad entry\n", path, line);
+            free_matrix(&A);
+            break;
+        }
+        if (length != job.first[c])
+            memmove(A->data + length, A->data + job.first[c], sizeof(Triple) * job.count[c]);
+        length += job.count[c];
+    }
+    munmap((void *)text, size);
+    free(job.cut);
+    free(job.first);
+    free(job.count);
+    free(job.error);
+    if (A == NULL)
+        return NULL;
+    A->length = length;
+    sort_triples(A);
+    resize_matrix(A, A->length);
+    return A;
+}
+
+// non-negative integer to text, returns the length
+static size_t format_index(char *out, unsigned long long v)
+{
+    char digits[24];
+    size_t n = 0;
+    do
+    {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    for (size_t i = 0; i < n; i++)
+        out[i] = digits[n - 1 - i];
+    return n;
+}
+
+// Write A as "coordinate real general"; values print with enough digits to read back exactly
+bool write_mtx(const Matrix A, const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        printf("Cannot open %s\n", path);
+        return false;
+    }
+    fprintf(fp, "%%%%MatrixMarket matrix coordinate real general\n%zu %zu %zu\n", A->rows, A->cols, A->length);
+    size_t capacity = 1 << 20, used = 0;
+    char *buf = (char *)malloc(capacity);
+    if (buf == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t k = 0; k < A->length; k++)
+    {
+        if (capacity - used < 128)
+        {
+            fwrite(buf, 1, used, fp);
+            used = 0;
+        }
+        const Triple *t = &A->data[k];
+        used += format_index(buf + used, (unsigned long long)t->x + 1);
+        buf[used++] = ' ';
+        used += format_index(buf + used, (unsigned long long)t->y + 1);
+        buf[used++] = ' ';
+        double v = t->value;
+        if (fabs(v) < 1e15 && v == (double)(long long)v) // integral: no need for printf
+        {
+            if (v < 0)
+                buf[used++] = '-';
+            used += format_index(buf + used, (unsigned long long)fabs(v));
+        }
+        else // %g drops trailing zeros, so binary fractions like 0.125 stay short
+            used += (size_t)snprintf(buf + used, capacity - used, "%.17g", v);
+        buf[used++] = '\n';
+    }
+    fwrite(buf, 1, used, fp);
+    free(buf);
+    bool ok = !ferror(fp);
+    if (fclose(fp) != 0)
+        ok = false;
+    if (!ok)
+        printf("Writing %s failed\n", path);
+    return ok;
+}
+
+// ===== Binary sparse files =====
+// A header, a panel table and the arrays of one storage format, each array starting on
+// a 64-byte boundary, in native byte order. map_matrix_file maps the file read-only and
+// hands out Matrix / CSRMatrix views whose arrays point into the mapping, so loading
+// costs no parsing and only the pages that are touched get read.
+// Panels are runs of panel_rows rows; the table gives the first entry of each, so a
+// consumer can work through a matrix larger than memory one panel at a time
+#define SPARSE_FILE_MAGIC "SPMXBIN"
+#define SPARSE_FILE_VERSION 1
+#define SPARSE_FILE_ALIGN 64
+
+typedef enum
+{
+    SPARSE_FILE_TRIPLES = 1, // Triple array, as in Matrix
+    SPARSE_FILE_CSR = 2      // row_ptr (64-bit), col_idx (32-bit), values
+} SparseFileFormat;
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version, format;
+    uint64_t rows, cols, nnz;
+    uint64_t panel_rows, panels;
+    uint64_t panel_offset;  // panels + 1 entries of SparsePanel
+    uint64_t ptr_offset;    // CSR row_ptr
+    uint64_t index_offset;  // CSR col_idx, or the Triple array
+    uint64_t values_offset; // CSR values
+} SparseFileHeader;
+
+typedef struct
+{
+    uint64_t first_row, first_entry;
+} SparsePanel;
+
+typedef struct
+{
+    const SparseFileHeader *header;
+    const SparsePanel *panels; // panels + 1 entries; the last one closes the matrix
+    Matrix triples;            // read-only view for SPARSE_FILE_TRIPLES, else NULL
+    CSRMatrix csr;             // read-only view for SPARSE_FILE_CSR, else NULL
+    void *base;
+    size_t size;
+} *MappedMatrix;
+
+static uint64_t align_offset(uint64_t offset)
+{
+    return (offset + SPARSE_FILE_ALIGN - 1) / SPARSE_FILE_ALIGN * SPARSE_FILE_ALIGN;
+}
+
+// write count elements of size bytes at offset, zero-filling the gap before it
+static bool write_at(FILE *fp, uint64_t *position, uint64_t offset, const void *data, size_t size, size_t count)
+{
+    static const char zeros[SPARSE_FILE_ALIGN] = {0};
+    if (offset - *position > 0 && fwrite(zeros, 1, offset - *position, fp) != offset - *position)
+        return false;
+    *position = offset + (uint64_t)size * count;
+    return fwrite(data, size, count, fp) == count;
+}
+
+// Save A (sorted triples) as a binary file; panel_rows 0 puts every row in one panel
+bool write_matrix_file(const Matrix A, const char *path, SparseFileFormat format, size_t panel_rows)
+{
+    if (panel_rows == 0 || panel_rows > A->rows)
+        panel_rows = A->rows > 0 ? A->rows : 1;
+    size_t panels = (A->rows + panel_rows - 1) / panel_rows;
+    uint64_t *row_ptr = (uint64_t *)calloc(A->rows + 1, sizeof(uint64_t));
+    SparsePanel *table = (SparsePanel *)malloc(sizeof(SparsePanel) * (panels + 1));
+    if (row_ptr == NULL || table == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t k = 0; k < A->length; k++)
+        row_ptr[A->data[k].x + 1]++;
+    for (size_t i = 0; i < A->rows; i++)
+        row_ptr[i + 1] += row_ptr[i];
+    for (size_t p = 0; p <= panels; p++)
+    {
+        table[p].first_row = p * panel_rows < A->rows ? p * panel_rows : A->rows;
+        table[p].first_entry = row_ptr[table[p].first_row];
+    }
+
+    SparseFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SPARSE_FILE_MAGIC, sizeof(SPARSE_FILE_MAGIC));
+    header.version = SPARSE_FILE_VERSION;
+    header.format = format;
+    header.rows = A->rows;
+    header.cols = A->cols;
+    header.nnz = A->length;
+    header.panel_rows = panel_rows;
+    header.panels = panels;
+    header.panel_offset = align_offset(sizeof(header));
+    uint64_t end = header.panel_offset + sizeof(SparsePanel) * (panels + 1);
+    if (format == SPARSE_FILE_CSR)
+    {
+        header.ptr_offset = align_offset(end);
+        header.index_offset = align_offset(header.ptr_offset + sizeof(uint64_t) * (A->rows + 1));
+        header.values_offset = align_offset(header.index_offset + sizeof(int) * A->length);
+    }
+    else
+        header.index_offset = align_offset(end);
+
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        printf("Cannot open %s\n", path);
+        free(row_ptr);
+        free(table);
+        return false;
+    }
+    uint64_t position = 0;
+    bool ok = write_at(fp, &position, 0, &header, sizeof(header), 1) &&
+              write_at(fp, &position, header.panel_offset, table, sizeof(SparsePanel), panels + 1);
+    if (ok && format == SPARSE_FILE_CSR)
+    {
+        ok = write_at(fp, &position, header.ptr_offset, row_ptr, sizeof(uint64_t), A->rows + 1);
+        // split the triples into columns and values a block at a time
+        size_t block = 1 << 16;
+        int *cols = (int *)malloc(sizeof(int) * block);
+        double *values = (double *)malloc(sizeof(double) * block);
+        if (cols == NULL || values == NULL)
+        {
+            printf("Memory allocation failed\n");
+            exit(1);
+        }
+        for (size_t k = 0; ok && (k == 0 || k < A->length); k += block) // k == 0: pad even when empty
+        {
+            size_t n = A->length - k < block ? A->length - k : block;
+            for (size_t t = 0; t < n; t++)
+                cols[t] = A->data[k + t].y;
+            ok = write_at(fp, &position, k == 0 ? header.index_offset : position, cols, sizeof(int), n);
+        }
+        for (size_t k = 0; ok && (k == 0 || k < A->length); k += block) // k == 0: pad even when empty
+        {
+            size_t n = A->length - k < block ? A->length - k : block;
+            for (size_t t = 0; t < n; t++)
+                values[t] = A->data[k + t].value;
+            ok = write_at(fp, &position, k == 0 ? header.values_offset : position, values, sizeof(double), n);
+        }
+        free(cols);
+        free(values);
+    }
+    else if (ok)
+        ok = write_at(fp, &position, header.index_offset, A->data, sizeof(Triple), A->length);
+    if (fclose(fp) != 0)
+        ok = false;
+    if (!ok)
+        printf("Writing %s failed\n", path);
+    free(row_ptr);
+    free(table);
+    return ok;
+}
+
+static bool array_fits(uint64_t offset, uint64_t size, uint64_t count, size_t file_size)
+{
+    return offset % SPARSE_FILE_ALIGN == 0 && offset <= file_size && count <= (file_size - offset) / size;
+}
+
+// The panel table must climb from (0, 0) to (rows, nnz) and, for CSR, agree with
+// row_ptr, which must itself climb from 0 to nnz. That costs O(rows + panels) reads;
+// the entry arrays are not scanned, so column indices and triple coordinates are trusted
+static bool panels_valid(const SparseFileHeader *h, const SparsePanel *panels, const uint64_t *row_ptr)
+{
+    if (panels[0].first_row != 0 || panels[0].first_entry != 0 || panels[h->panels].first_row != h->rows ||
+        panels[h->panels].first_entry != h->nnz)
+        return false;
+    for (uint64_t p = 0; p < h->panels; p++)
+        if (panels[p + 1].first_row < panels[p].first_row || panels[p + 1].first_entry < panels[p].first_entry ||
+            (row_ptr != NULL && row_ptr[panels[p].first_row] != panels[p].first_entry))
+            return false;
+    if (row_ptr == NULL)
+        return true;
+    if (row_ptr[0] != 0)
+        return false;
+    for (uint64_t i = 0; i < h->rows; i++)
+        if (row_ptr[i + 1] < row_ptr[i])
+            return false;
+    return true;
+}
+
+// Map a binary file written by write_matrix_file; returns NULL (with a message) when
+// the file is missing or its header, panel table or row_ptr is inconsistent. The
+// entries themselves are not checked, so only map files from a trusted writer. The
+// views must not be modified or freed: release everything with unmap_matrix_file
+MappedMatrix map_matrix_file(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        printf("Cannot open %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    void *base = size >= sizeof(SparseFileHeader) ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        printf("%s is not a sparse matrix file\n", path);
+        return NULL;
+    }
+
+    const SparseFileHeader *h = (const SparseFileHeader *)base;
+    bool ok = memcmp(h->magic, SPARSE_FILE_MAGIC, sizeof(SPARSE_FILE_MAGIC)) == 0 &&
+              h->version == SPARSE_FILE_VERSION && h->rows <= INT_MAX && h->cols <= INT_MAX &&
+              h->panel_rows > 0 && h->panels == (h->rows + h->panel_rows - 1) / h->panel_rows &&
+              array_fits(h->panel_offset, sizeof(SparsePanel), h->panels + 1, size);
+    if (ok && h->format == SPARSE_FILE_CSR)
+        ok = array_fits(h->ptr_offset, sizeof(uint64_t), h->rows + 1, size) &&
+             array_fits(h->index_offset, sizeof(int), h->nnz, size) &&
+             array_fits(h->values_offset, sizeof(double), h->nnz, size) &&
+             ((const uint64_t *)((const char *)base + h->ptr_offset))[h->rows] == h->nnz;
+    else if (ok)
+        ok = h->format == SPARSE_FILE_TRIPLES && array_fits(h->index_offset, sizeof(Triple), h->nnz, size);
+    if (ok)
+        ok = panels_valid(h, (const SparsePanel *)((const char *)base + h->panel_offset),
+                          h->format == SPARSE_FILE_CSR ? (const uint64_t *)((const char *)base + h->ptr_offset)
+                                                       : NULL);
+    if (!ok)
+    {
+        printf("%s is not a sparse matrix file\n", path);
+        munmap(base, size);
+        return NULL;
+    }
+
+    MappedMatrix M = (MappedMatrix)calloc(1, sizeof(*M));
+    if (M == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    char *bytes = (char *)base;
+    M->base = base;
+    M->size = size;
+    M->header = h;
+    M->panels = (const SparsePanel *)(bytes + h->panel_offset);
+    if (h->format == SPARSE_FILE_CSR)
+    {
+        M->csr = (CSRMatrix)malloc(sizeof(*M->csr));
+        if (M->csr == NULL)
+        {
+            printf("Memory allocation failed\n");
+            exit(1);
+        }
+        M->csr->row_ptr = (size_t *)(bytes + h->ptr_offset);
+        M->csr->col_idx = (int *)(bytes + h->index_offset);
+        M->csr->values = (double *)(bytes + h->values_offset);
+        M->csr->length = M->csr->capacity = h->nnz;
+        M->csr->rows = h->rows;
+        M->csr->cols = h->cols;
+    }
+    else
+    {
+        M->triples = (Matrix)malloc(sizeof(*M->triples));
+        if (M->triples == NULL)
+        {
+            printf("Memory allocation failed\n");
+            exit(1);
+        }
+        M->triples->data = (Triple *)(bytes + h->index_offset);
+        M->triples->length = M->triples->capacity = h->nnz;
+        M->triples->rows = h->rows;
+        M->triples->cols = h->cols;
+    }
+    return M;
+}
+
+void unmap_matrix_file(MappedMatrix *M)
+{
+    munmap((*M)->base, (*M)->size);
+    free((*M)->csr);
+    free((*M)->triples);
+    free(*M);
+    *M = NULL;
+}
+
+// madvise on whole pages inside [offset, offset + len) of the mapping
+static void advise_range(const MappedMatrix M, uint64_t offset, uint64_t len, int advice)
+{
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t begin = (offset + page - 1) / page * page, end = (offset + len) / page * page;
+    if (advice == MADV_WILLNEED) // reading ahead may cover partial pages
+    {
+        begin = offset / page * page;
+        end = offset + len < M->size ? offset + len : M->size;
+    }
+    if (end > begin)
+        madvise((char *)M->base + begin, end - begin, advice);
+}
+
+static void advise_panel(const MappedMatrix M, size_t p, int advice)
+{
+    const SparseFileHeader *h = M->header;
+    uint64_t row = M->panels[p].first_row, rows = M->panels[p + 1].first_row - row;
+    uint64_t entry = M->panels[p].first_entry, entries = M->panels[p + 1].first_entry - entry;
+    if (h->format == SPARSE_FILE_CSR)
+    {
+        advise_range(M, h->ptr_offset + sizeof(uint64_t) * row, sizeof(uint64_t) * (rows + 1), advice);
+        advise_range(M, h->index_offset + sizeof(int) * entry, sizeof(int) * entries, advice);
+        advise_range(M, h->values_offset + sizeof(double) * entry, sizeof(double) * entries, advice);
+    }
+    else
+        advise_range(M, h->index_offset + sizeof(Triple) * entry, sizeof(Triple) * entries, advice);
+}
+
+typedef struct
+{
+    SpmvJob spmv;
+    size_t first_row;
+} PanelSpmvJob;
+
+static void panel_spmv_rows(void *ctx, size_t begin, size_t end, int thread)
+{
+    PanelSpmvJob *job = (PanelSpmvJob *)ctx;
+    spmv_rows(&job->spmv, job->first_row + begin, job->first_row + end, thread);
+}
+
+// y = M * x one panel at a time: the next panel is read ahead while this one is
+// multiplied, and finished panels are dropped, so resident memory stays around two panels
+void spmv_mapped(const MappedMatrix M, const double *x, double *y)
+{
+    const SparseFileHeader *h = M->header;
+    if (h->panels > 0)
+        advise_panel(M, 0, MADV_WILLNEED);
+    for (size_t p = 0; p < h->panels; p++)
+    {
+        if (p + 1 < h->panels)
+            advise_panel(M, p + 1, MADV_WILLNEED);
+        size_t first = M->panels[p].first_row, rows = M->panels[p + 1].first_row - first;
+        if (h->format == SPARSE_FILE_CSR)
+        {
+            PanelSpmvJob job = {{M->csr, x, y}, first};
+            if (M->panels[p + 1].first_entry - M->panels[p].first_entry < PARALLEL_MIN_WORK)
+                panel_spmv_rows(&job, 0, rows, 0);
+            else
+                parallel_for(rows, chunk_size(rows, 64), panel_spmv_rows, &job);
+        }
+        else
+        {
+            const Triple *data = M->triples->data;
+            for (size_t i = first; i < first + rows; i++)
+                y[i] = 0.0;
+            for (size_t k = M->panels[p].first_entry; k < M->panels[p + 1].first_entry; k++)
+                y[data[k].x] += data[k].value * x[data[k].y];
+        }
+        advise_panel(M, p, MADV_DONTNEED);
+    }
+}
+
+// ===== Out-of-core multiply =====
+// C = A * B for binary CSR files that need not fit in memory. B is cut into column
+// panels small enough to hold in memory; for each one, A is streamed panel by panel
+// from its mapping and the partial rows of C (only the columns of that panel) are
+// buffered and spilled to a scratch file in chunks. A final pass stitches every row
+// of C together from the chunks of all column panels, which come out already in
+// column order, and writes C as a binary CSR file.
+// Heap use stays within memory_limit apart from B's row pointers, which every column
+// panel needs in full; A, B and the spill file are only touched through the page cache.
+// A and B are each read once per column panel
+
+typedef struct
+{
+    int fd;
+    uint64_t offset; // file offset of buf[0]
+    char *buf;
+    size_t used, capacity;
+} SpillWriter;
+
+static void init_spill_writer(SpillWriter *w, int fd, uint64_t offset, size_t capacity)
+{
+    w->fd = fd;
+    w->offset = offset;
+    w->used = 0;
+    w->capacity = capacity;
+    w->buf = (char *)malloc(capacity);
+    if (w->buf == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+}
+
+static bool spill_flush(SpillWriter *w)
+{
+    size_t done = 0;
+    while (done < w->used)
+    {
+        ssize_t n = pwrite(w->fd, w->buf + done, w->used - done, (off_t)(w->offset + done));
+        if (n <= 0)
+            return false;
+        done += (size_t)n;
+    }
+    w->offset += w->used;
+    w->used = 0;
+    return true;
+}
+
+static bool spill_put(SpillWriter *w, const void *data, size_t bytes)
+{
+    const char *p = (const char *)data;
+    while (bytes > 0)
+    {
+        if (w->used == w->capacity && !spill_flush(w))
+            return false;
+        size_t n = w->capacity - w->used < bytes ? w->capacity - w->used : bytes;
+        memcpy(w->buf + w->used, p, n);
+        w->used += n;
+        p += n;
+        bytes -= n;
+    }
+    return true;
+}
+
+// rows [first_row, first_row + rows) of C restricted to one column panel:
+// row_ptr (rows + 1, relative), col_idx, padding to 8 bytes, values
+typedef struct
+{
+    uint64_t first_row, rows, offset, nnz;
+} SpillChunk;
+
+typedef struct
+{
+    SpillChunk *chunks;
+    size_t count, capacity;
+} SpillChunkList;
+
+typedef struct
+{
+    uint64_t *row_ptr;
+    int *col_idx;
+    double *values;
+    size_t rows, nnz, max_rows, max_nnz;
+    uint64_t first_row;
+} ChunkBuffer;
+
+static bool spill_chunk(ChunkBuffer *b, SpillWriter *w, SpillChunkList *list)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->chunks = (SpillChunk *)realloc(list->chunks, sizeof(SpillChunk) * list->capacity);
+        if (list->chunks == NULL)
+        {
+            printf("Memory reallocation failed\n");
+            exit(1);
+        }
+    }
+    SpillChunk *c = &list->chunks[list->count++];
+    c->first_row = b->first_row;
+    c->rows = b->rows;
+    c->offset = w->offset + w->used;
+    c->nnz = b->nnz;
+    static const char zeros[8] = {0};
+    bool ok = spill_put(w, b->row_ptr, sizeof(uint64_t) * (b->rows + 1)) &&
+              spill_put(w, b->col_idx, sizeof(int) * b->nnz) && spill_put(w, zeros, (b->nnz % 2) * sizeof(int)) &&
+              spill_put(w, b->values, sizeof(double) * b->nnz);
+    b->first_row += b->rows;
+    b->rows = b->nnz = 0;
+    return ok;
+}
+
+// columns [first, last) of the mapped B, held in memory as CSR with local column numbers
+static void load_column_panel(const CSRMatrix B, int first, int last, CSRMatrix panel)
+{
+    panel->row_ptr = reshape_ptr(panel->row_ptr, B->rows);
+    panel->rows = B->rows;
+    panel->cols = (size_t)(last - first);
+    size_t n = 0;
+    panel->row_ptr[0] = 0;
+    for (size_t r = 0; r < B->rows; r++)
+    {
+        for (size_t t = B->row_ptr[r]; t < B->row_ptr[r + 1]; t++)
+            if (B->col_idx[t] >= first && B->col_idx[t] < last)
+            {
+                if (n == panel->capacity)
+                    resize_csr(panel, panel->capacity * 2);
+                panel->col_idx[n] = B->col_idx[t] - first;
+                panel->values[n++] = B->values[t];
+            }
+        panel->row_ptr[r + 1] = n;
+    }
+    panel->length = n;
+}
+
+// Multiply the binary CSR files A and B into C_path, keeping the heap near memory_limit bytes
+bool multiply_matrix_file(const char *A_path, const char *B_path, const char *C_path, size_t memory_limit)
+{
+    MappedMatrix MA = map_matrix_file(A_path), MB = map_matrix_file(B_path);
+    if (MA == NULL || MB == NULL || MA->csr == NULL || MB->csr == NULL || MA->csr->cols != MB->csr->rows)
+    {
+        printf("Out-of-core multiply needs two CSR files with matching dimensions\n");
+        if (MA != NULL)
+            unmap_matrix_file(&MA);
+        if (MB != NULL)
+            unmap_matrix_file(&MB);
+        return false;
+    }
+    const CSRMatrix A = MA->csr, B = MB->csr;
+    size_t fixed = sizeof(size_t) * (B->rows + 1);
+    if (memory_limit < fixed + (1 << 16))
+    {
+        printf("Memory limit too small: B alone needs %zu bytes of row pointers\n", fixed);
+        unmap_matrix_file(&MA);
+        unmap_matrix_file(&MB);
+        return false;
+    }
+    // half for the B panel, a quarter each for the accumulator and the chunk buffer
+    size_t quarter = (memory_limit - fixed) / 4;
+    size_t panel_entries = 2 * quarter / (sizeof(int) + sizeof(double));
+    size_t chunk_entries = quarter / (sizeof(int) + sizeof(double) + sizeof(uint64_t));
+    size_t max_width = chunk_entries; // a row piece always fits in one chunk
+
+    // column panel boundaries from the column counts of B
+    int *bounds = (int *)malloc(sizeof(int) * (B->cols + 2));
+    size_t *col_count = (size_t *)calloc(B->cols + 1, sizeof(size_t));
+    if (bounds == NULL || col_count == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t t = 0; t < B->length; t++)
+        col_count[B->col_idx[t]]++;
+    size_t panels = 0, entries = 0;
+    bounds[0] = 0;
+    for (size_t j = 0; j < B->cols; j++)
+    {
+        if (j > (size_t)bounds[panels] &&
+            (entries + col_count[j] > panel_entries || j - (size_t)bounds[panels] >= max_width))
+        {
+            bounds[++panels] = (int)j;
+            entries = 0;
+        }
+        entries += col_count[j];
+    }
+    bounds[++panels] = (int)B->cols;
+    free(col_count);
+
+    char *spill_path = (char *)malloc(strlen(C_path) + 7);
+    if (spill_path == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    sprintf(spill_path, "%s.spill", C_path);
+    int spill_fd = open(spill_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (spill_fd >= 0)
+        unlink(spill_path); // the scratch file goes away with the descriptor
+    free(spill_path);
+    if (spill_fd < 0)
+    {
+        printf("Cannot create the spill file for %s\n", C_path);
+        unmap_matrix_file(&MA);
+        unmap_matrix_file(&MB);
+        free(bounds);
+        return false;
+    }
+
+    SpillChunkList *lists = (SpillChunkList *)calloc(panels, sizeof(SpillChunkList));
+    CSRMatrix panel = init_csr(1024, B->rows, 1);
+    ChunkBuffer buffer = {NULL, NULL, NULL, 0, 0, chunk_entries, chunk_entries, 0};
+    buffer.row_ptr = (uint64_t *)malloc(sizeof(uint64_t) * (chunk_entries + 1));
+    buffer.col_idx = (int *)malloc(sizeof(int) * chunk_entries);
+    buffer.values = (double *)malloc(sizeof(double) * chunk_entries);
+    int *mark = (int *)malloc(sizeof(int) * max_width);
+    double *acc = (double *)malloc(sizeof(double) * max_width);
+    if (lists == NULL || buffer.row_ptr == NULL || buffer.col_idx == NULL || buffer.values == NULL || mark == NULL ||
+        acc == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    SpillWriter spill;
+    init_spill_writer(&spill, spill_fd, 0, 1 << 20);
+    bool ok = true;
+    uint64_t total = 0;
+
+    // phase 1: every column panel of B against all of A
+    for (size_t q = 0; ok && q < panels; q++)
+    {
+        load_column_panel(B, bounds[q], bounds[q + 1], panel);
+        for (int j = 0; j < bounds[q + 1] - bounds[q]; j++)
+            mark[j] = -1;
+        buffer.first_row = 0;
+        buffer.rows = buffer.nnz = 0;
+        buffer.row_ptr[0] = 0;
+        for (size_t p = 0; ok && p < MA->header->panels; p++)
+        {
+            if (p + 1 < MA->header->panels)
+                advise_panel(MA, p + 1, MADV_WILLNEED);
+            for (size_t i = MA->panels[p].first_row; ok && i < MA->panels[p + 1].first_row; i++)
+            {
+                // a row piece is at most one panel wide, which always fits an empty buffer
+                if (buffer.rows == buffer.max_rows || buffer.nnz + panel->cols > buffer.max_nnz)
+                    ok = spill_chunk(&buffer, &spill, &lists[q]);
+                size_t start = buffer.nnz, n = 0;
+                for (size_t k = A->row_ptr[i]; k < A->row_ptr[i + 1]; k++)
+                {
+                    int r = A->col_idx[k];
+                    double a = A->values[k];
+                    for (size_t t = panel->row_ptr[r]; t < panel->row_ptr[r + 1]; t++)
+                    {
+                        int j = panel->col_idx[t];
+                        if (mark[j] != (int)i)
+                        {
+                            mark[j] = (int)i;
+                            acc[j] = a * panel->values[t];
+                            buffer.col_idx[start + n++] = j;
+                        }
+                        else
+                            acc[j] += a * panel->values[t];
+                    }
+                }
+                sort_columns(buffer.col_idx + start, n);
+                for (size_t t = start; t < start + n; t++)
+                {
+                    int j = buffer.col_idx[t];
+                    if (acc[j] != 0.0)
+                    {
+                        buffer.col_idx[buffer.nnz] = j + bounds[q];
+                        buffer.values[buffer.nnz++] = acc[j];
+                    }
+                }
+                buffer.row_ptr[++buffer.rows] = buffer.nnz;
+            }
+            advise_panel(MA, p, MADV_DONTNEED);
+        }
+        if (ok && (buffer.rows > 0 || lists[q].count == 0))
+            ok = spill_chunk(&buffer, &spill, &lists[q]);
+        for (size_t c = 0; c < lists[q].count; c++)
+            total += lists[q].chunks[c].nnz;
+    }
+    ok = ok && spill_flush(&spill);
+    free(spill.buf);
+    free(buffer.row_ptr);
+    free(buffer.col_idx);
+    free(buffer.values);
+    free(mark);
+    free(acc);
+    free_csr(&panel);
+    unmap_matrix_file(&MB);
+
+    // phase 2: stitch the rows of C together from the chunks of every column panel
+    size_t rows = A->rows, panel_rows = MA->header->panel_rows;
+    size_t out_panels = (size_t)MA->header->panels;
+    SparseFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SPARSE_FILE_MAGIC, sizeof(SPARSE_FILE_MAGIC));
+    header.version = SPARSE_FILE_VERSION;
+    header.format = SPARSE_FILE_CSR;
+    header.rows = rows;
+    header.cols = (uint64_t)bounds[panels];
+    header.nnz = total;
+    header.panel_rows = panel_rows;
+    header.panels = out_panels;
+    header.panel_offset = align_offset(sizeof(header));
+    header.ptr_offset = align_offset(header.panel_offset + sizeof(SparsePanel) * (out_panels + 1));
+    header.index_offset = align_offset(header.ptr_offset + sizeof(uint64_t) * (rows + 1));
+    header.values_offset = align_offset(header.index_offset + sizeof(int) * total);
+    free(bounds);
+
+    off_t spill_size = lseek(spill_fd, 0, SEEK_END);
+    const char *spilled = NULL;
+    if (ok && spill_size > 0)
+    {
+        spilled = (const char *)mmap(NULL, (size_t)spill_size, PROT_READ, MAP_SHARED, spill_fd, 0);
+        if (spilled == MAP_FAILED)
+            ok = false;
+        else
+            madvise((void *)spilled, (size_t)spill_size, MADV_SEQUENTIAL);
+    }
+    int out_fd = ok ? open(C_path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    ok = ok && out_fd >= 0;
+    SparsePanel *table = (SparsePanel *)malloc(sizeof(SparsePanel) * (out_panels + 1));
+    size_t *cursor = (size_t *)calloc(panels, sizeof(size_t));
+    if (table == NULL || cursor == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    SpillWriter ptr_out, idx_out, val_out;
+    init_spill_writer(&ptr_out, out_fd, header.ptr_offset, 1 << 18);
+    init_spill_writer(&idx_out, out_fd, header.index_offset, 1 << 18);
+    init_spill_writer(&val_out, out_fd, header.values_offset, 1 << 18);
+    uint64_t written = 0;
+    ok = ok && spill_put(&ptr_out, &written, sizeof(uint64_t));
+    for (size_t i = 0; ok && i < rows; i++)
+    {
+        if (i % panel_rows == 0)
+        {
+            table[i / panel_rows].first_row = i;
+            table[i / panel_rows].first_entry = written;
+        }
+        for (size_t q = 0; ok && q < panels; q++)
+        {
+            const SpillChunk *c = &lists[q].chunks[cursor[q]];
+            if (i >= c->first_row + c->rows)
+                c = &lists[q].chunks[++cursor[q]];
+            const uint64_t *row_ptr = (const uint64_t *)(spilled + c->offset);
+            const int *col_idx = (const int *)(row_ptr + c->rows + 1);
+            const double *values = (const double *)(col_idx + c->nnz + c->nnz % 2);
+            size_t local = i - c->first_row, n = row_ptr[local + 1] - row_ptr[local];
+            ok = spill_put(&idx_out, col_idx + row_ptr[local], sizeof(int) * n) &&
+                 spill_put(&val_out, values + row_ptr[local], sizeof(double) * n);
+            written += n;
+        }
+        ok = ok && spill_put(&ptr_out, &written, sizeof(uint64_t));
+    }
+    table[out_panels].first_row = rows;
+    table[out_panels].first_entry = written;
+    ok = ok && spill_flush(&ptr_out) && spill_flush(&idx_out) && spill_flush(&val_out);
+    // pad to the end of the values so the file has the size the header promises
+    ok = ok && ftruncate(out_fd, (off_t)(header.values_offset + sizeof(double) * total)) == 0;
+    ok = ok && pwrite(out_fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+         pwrite(out_fd, table, sizeof(SparsePanel) * (out_panels + 1), (off_t)header.panel_offset) ==
+             (ssize_t)(sizeof(SparsePanel) * (out_panels + 1));
+
+    if (spilled != NULL && spilled != MAP_FAILED)
+        munmap((void *)spilled, (size_t)spill_size);
+    close(spill_fd);
+    if (out_fd >= 0 && close(out_fd) != 0)
+        ok = false;
+    free(ptr_out.buf);
+    free(idx_out.buf);
+    free(val_out.buf);
+    free(table);
+    free(cursor);
+    for (size_t q = 0; q < panels; q++)
+        free(lists[q].chunks);
+    free(lists);
+    unmap_matrix_file(&MA);
+    if (!ok)
+        printf("Out-of-core multiply into %s failed\n", C_path);
+    return ok;
+}
+
+// text funtion
+void text_add_matrix()
+{
+    printf("Add Matrix Test:\n");
+    int rows, cols;
+    int num_elem_A, num_elem_B;
+
+    rows = 3;
+    cols = 3;
+    Matrix A, B, C;
+    A = creat_from_array((double *[]){
+                             (double[]){1, 0, 0},
+                             (double[]){0, 2, 0},
+                             (double[]){0, 0, 3}},
+                         rows, cols);
+
+    B = creat_from_array((double *[]){
+                             (double[]){0, 1, 0},
+                             (double[]){0, 0, 2},
+                             (double[]){3, 0, 0}},
+                         rows, cols);
+
+    C = init_matrix(0, rows, cols);
+
+    add_matrix(A, B, C);
+
+    printf("Resultant Matrix C:\n");
+    print_matrix(C, true);
+
+    free_matrix(&A);
+    free_matrix(&B);
+    free_matrix(&C);
+}
+
+void text_transpose_matrix()
+{
+    printf("Transpose Matrix Test:\n");
+    int rows, cols;
+    int num_elem_A, num_elem_B;
+
+    rows = 3;
+    cols = 3;
+    Matrix A, B, C;
+    A = creat_from_array((double *[]){
+                             (double[]){1, 1, 0},
+                             (double[]){0, 2, 0},
+                             (double[]){1, 0, 3}},
+                         rows, cols);
+
+    C = init_matrix(0, rows, cols);
+
+    transpose_matrix(A, C);
+
+    printf("Resultant Matrix C:\n");
+    print_matrix(C, true);
+
+    free_matrix(&A);
+    free_matrix(&C);
+}
+
+void text_multiply_matrix()
+{
+    printf("Multiply Matrix Test:\n");
+    int rows_A = 2, cols_A = 3;
+    int rows_B = 3, cols_B = 2;
+
+    Matrix A, B, C;
     A = creat_from_array((double *[]){
                              (double[]){1, 0, 2},
                              (double[]){0, 3, 0}},
@@ -519,6 +3405,376 @@ void text_multiply_matrix()
     free_matrix(&C);
 }
 
+void text_csr_matrix()
+{
+    printf("CSR/CSC Matrix Test:\n");
+    Matrix A, B, C;
+    A = creat_from_array((double *[]){
+                             (double[]){1, 0, 2},
+                             (double[]){0, 3, 0}},
+                         2, 3);
+    B = creat_from_array((double *[]){
+                             (double[]){2, 4},
+                             (double[]){5, 0},
+                             (double[]){0, 6}},
+                         3, 2);
+
+    CSRMatrix A_csr = init_csr(0, 2, 3), B_csr = init_csr(0, 3, 2);
+    CSRMatrix S = init_csr(0, 2, 3), T = init_csr(0, 3, 2), P = init_csr(0, 2, 2);
+    CSCMatrix B_csc = init_csc(0, 3, 2);
+    triples_to_csr(A, A_csr);
+    triples_to_csr(B, B_csr);
+    triples_to_csc(B, B_csc);
+
+    C = init_matrix(0, 2, 3);
+    transpose_csr(B_csr, T);
+    add_csr(A_csr, T, S);
+    csr_to_triples(S, C);
+    printf("A + B^T:\n");
+    print_matrix(C, true);
+
+    multiply_csr(A_csr, B_csr, P);
+    csr_to_triples(P, C);
+    printf("A * B:\n");
+    print_matrix(C, true);
+
+    csr_to_csc(A_csr, B_csc);
+    csc_to_triples(B_csc, C);
+    printf("A through CSC:\n");
+    print_matrix(C, true);
+
+    free_matrix(&A);
+    free_matrix(&B);
+    free_matrix(&C);
+    free_csr(&A_csr);
+    free_csr(&B_csr);
+    free_csr(&S);
+    free_csr(&T);
+    free_csr(&P);
+    free_csc(&B_csc);
+}
+
+void text_parallel_matrix()
+{
+    // tridiagonal band, large enough to go through the thread pool
+    int n = 20000;
+    Matrix A = init_matrix(3 * n, n, n);
+    A->length = 0;
+    for (int i = 0; i < n; i++)
+        for (int j = i - 1; j <= i + 1; j++)
+            if (j >= 0 && j < n)
+            {
+                A->data[A->length].x = i;
+                A->data[A->length].y = j;
+                A->data[A->length].value = i == j ? 2.0 : -1.0;
+                A->length++;
+            }
+
+    printf("threads: %d\n", num_threads());
+    Matrix C = init_matrix(0, n, n);
+    multiply_matrix(A, A, C);
+    printf("A * A has %zu nonzeros\n", C->length);
+
+    CSRMatrix A_csr = init_csr(0, n, n);
+    triples_to_csr(A, A_csr);
+    double *x = (double *)malloc(sizeof(double) * n);
+    double *y = (double *)malloc(sizeof(double) * n);
+    if (x == NULL || y == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    for (int i = 0; i < n; i++)
+        x[i] = 1.0;
+    spmv(A_csr, x, y);
+    // interior rows sum to 0, the two end rows to 1
+    printf("y[0] = %g, y[1] = %g, y[n-1] = %g\n", y[0], y[1], y[n - 1]);
+
+    free(x);
+    free(y);
+    free_csr(&A_csr);
+    free_matrix(&A);
+    free_matrix(&C);
+}
+
+static double seconds_now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// SpMV throughput of the triple, CSR and SELL layouts on one matrix
+static void bench_spmv(const char *name, const Matrix A, int repeat)
+{
+    CSRMatrix A_csr = init_csr(0, A->rows, A->cols);
+    SELLMatrix A_sell = init_sell(A->rows, A->cols);
+    triples_to_csr(A, A_csr);
+    size_t sigma;
+    SpmvFormat format = choose_spmv_format(A_csr, &sigma);
+    csr_to_sell(A_csr, A_sell, format == SPMV_SELL ? sigma : A->rows);
+    double *x = (double *)malloc(sizeof(double) * A->cols);
+    double *y = (double *)malloc(sizeof(double) * A->rows);
+    double *y_ref = (double *)malloc(sizeof(double) * A->rows);
+    if (x == NULL || y == NULL || y_ref == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t j = 0; j < A->cols; j++)
+        x[j] = 1.0 / (1.0 + j % 7);
+    spmv_matrix(A, x, y_ref);
+
+    printf("%s: %zu x %zu, %zu nonzeros, heuristic picks %s (sigma %zu), SELL fill %.0f%%\n", name, A->rows,
+           A->cols, A->length, format == SPMV_SELL ? "SELL" : "CSR", sigma,
+           100.0 * A_sell->length / (A_sell->slice_ptr[A_sell->slices] > 0 ? A_sell->slice_ptr[A_sell->slices] : 1));
+    for (int f = 0; f < 3; f++)
+    {
+        double start = seconds_now();
+        for (int r = 0; r < repeat; r++)
+        {
+            if (f == 0)
+                spmv_matrix(A, x, y);
+            else if (f == 1)
+                spmv(A_csr, x, y);
+            else
+                spmv_sell(A_sell, x, y);
+        }
+        double elapsed = seconds_now() - start, error = 0.0;
+        for (size_t i = 0; i < A->rows; i++)
+            if (fabs(y[i] - y_ref[i]) > error)
+                error = fabs(y[i] - y_ref[i]);
+        printf("  %-7s %8.2f ms/op %7.2f GFLOP/s  max error %g\n", f == 0 ? "triples" : f == 1 ? "CSR" : "SELL",
+               elapsed * 1e3 / repeat, 2.0 * A->length * repeat / elapsed * 1e-9, error);
+    }
+    free(x);
+    free(y);
+    free(y_ref);
+    free_csr(&A_csr);
+    free_sell(&A_sell);
+}
+
+// random columns; row i gets row_length(i) nonzeros
+static Matrix random_rows(int rows, int cols, int (*row_length)(int))
+{
+    Matrix A = init_matrix(0, rows, cols);
+    A->length = 0;
+    for (int i = 0; i < rows; i++)
+    {
+        int n = row_length(i);
+        if (A->length + n > A->capacity)
+            resize_matrix(A, (A->length + n) * 2);
+        int col = rand() % (cols / (n + 1) + 1);
+        for (int k = 0; k < n && col < cols; k++)
+        {
+            A->data[A->length].x = i;
+            A->data[A->length].y = col;
+            A->data[A->length].value = 1.0 + rand() % 9;
+            A->length++;
+            col += 1 + rand() % (cols / (n + 1) + 1);
+        }
+    }
+    return A;
+}
+
+static int uniform_length(int i)
+{
+    (void)i;
+    return 12 + rand() % 5;
+}
+
+// a few long rows among short ones, like a power-law graph
+static int skewed_length(int i)
+{
+    return i % 97 == 0 ? 400 + rand() % 400 : 1 + rand() % 6;
+}
+
+void text_spmv_formats()
+{
+    int rows = 200000;
+    Matrix A = random_rows(rows, rows, uniform_length);
+    bench_spmv("uniform rows", A, 20);
+    free_matrix(&A);
+    A = random_rows(rows, rows, skewed_length);
+    bench_spmv("skewed rows", A, 20);
+    free_matrix(&A);
+}
+
+void text_sort_triples()
+{
+    // unsorted COO stream with some repeated coordinates
+    int rows = 1000000, cols = 1000000;
+    size_t n = 5000000;
+    Matrix A = init_matrix(n, rows, cols), B = init_matrix(n, rows, cols);
+    for (size_t k = 0; k < n; k++)
+    {
+        bool repeat = k % 10 == 0 && k > 0;
+        A->data[k].x = repeat ? A->data[k / 2].x : rand() % rows;
+        A->data[k].y = repeat ? A->data[k / 2].y : rand() % cols;
+        A->data[k].value = 1.0 + rand() % 9;
+    }
+    memcpy(B->data, A->data, sizeof(Triple) * n);
+
+    double start = seconds_now();
+    qsort(B->data, n, sizeof(Triple), compare_triples);
+    printf("qsort:      %8.1f ms\n", (seconds_now() - start) * 1e3);
+    start = seconds_now();
+    sort_triples(A);
+    printf("radix sort: %8.1f ms (%d threads), %zu entries after summing duplicates\n",
+           (seconds_now() - start) * 1e3, num_threads(), A->length);
+
+    free_matrix(&A);
+    free_matrix(&B);
+}
+
+void text_matrix_file()
+{
+    int rows = 200000;
+    Matrix A = random_rows(rows, rows, uniform_length);
+    double start = seconds_now();
+    write_mtx(A, "text_matrix.mtx");
+    write_matrix_file(A, "text_matrix.bin", SPARSE_FILE_CSR, 16384);
+    printf("written in %.1f ms\n", (seconds_now() - start) * 1e3);
+
+    start = seconds_now();
+    Matrix B = read_mtx("text_matrix.mtx");
+    printf("read_mtx:        %8.2f ms\n", (seconds_now() - start) * 1e3);
+    start = seconds_now();
+    MappedMatrix M = map_matrix_file("text_matrix.bin");
+    printf("map_matrix_file: %8.2f ms\n", (seconds_now() - start) * 1e3);
+    if (B == NULL || M == NULL)
+        exit(1);
+
+    double *x = (double *)malloc(sizeof(double) * rows);
+    double *y = (double *)malloc(sizeof(double) * rows);
+    double *y_ref = (double *)malloc(sizeof(double) * rows);
+    if (x == NULL || y == NULL || y_ref == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    for (int j = 0; j < rows; j++)
+        x[j] = 1.0 / (1.0 + j % 5);
+    spmv_matrix(B, x, y_ref);
+    spmv_mapped(M, x, y);
+    double error = 0.0;
+    for (int i = 0; i < rows; i++)
+        if (fabs(y[i] - y_ref[i]) > error)
+            error = fabs(y[i] - y_ref[i]);
+    printf("%zu panels, panel SpMV max error %g\n", (size_t)M->header->panels, error);
+
+    free(x);
+    free(y);
+    free(y_ref);
+    unmap_matrix_file(&M);
+    free_matrix(&A);
+    free_matrix(&B);
+    remove("text_matrix.mtx");
+    remove("text_matrix.bin");
+}
+
+void text_out_of_core()
+{
+    // a small memory limit forces many column panels and spill chunks
+    int rows = 20000;
+    Matrix A = random_rows(rows, rows, uniform_length), B = random_rows(rows, rows, skewed_length);
+    write_matrix_file(A, "text_A.bin", SPARSE_FILE_CSR, 4096);
+    write_matrix_file(B, "text_B.bin", SPARSE_FILE_CSR, 4096);
+
+    double start = seconds_now();
+    if (!multiply_matrix_file("text_A.bin", "text_B.bin", "text_C.bin", 1 << 20))
+        exit(1);
+    printf("out-of-core A * B with a 1 MB limit: %.1f ms\n", (seconds_now() - start) * 1e3);
+
+    Matrix C = init_matrix(0, rows, rows), D = init_matrix(0, rows, rows);
+    multiply_matrix(A, B, C);
+    MappedMatrix M = map_matrix_file("text_C.bin");
+    if (M == NULL)
+        exit(1);
+    csr_to_triples(M->csr, D);
+    bool same = C->length == D->length;
+    for (size_t k = 0; same && k < C->length; k++)
+        same = C->data[k].x == D->data[k].x && C->data[k].y == D->data[k].y &&
+               fabs(C->data[k].value - D->data[k].value) <= 1e-12 * fabs(C->data[k].value);
+    printf("%zu nonzeros, %s the in-memory product\n", D->length, same ? "matches" : "DIFFERS from");
+
+    unmap_matrix_file(&M);
+    free_matrix(&A);
+    free_matrix(&B);
+    free_matrix(&C);
+    free_matrix(&D);
+    remove("text_A.bin");
+    remove("text_B.bin");
+    remove("text_C.bin");
+}
+
+static double one(double value)
+{
+    (void)value;
+    return 1.0;
+}
+
+// strictly lower triangle of a random undirected graph, n vertices and about degree * n / 2 edges
+static Matrix random_graph(int n, int degree)
+{
+    Matrix L = init_matrix(0, n, n);
+    L->length = 0;
+    for (long e = 0; e < (long)n * degree / 2; e++)
+    {
+        int u = rand() % n, v = rand() % n;
+        if (u != v)
+            push_triple(L, u > v ? u : v, u > v ? v : u, 1.0);
+    }
+    sort_triples(L);
+    apply_matrix(L, one, L); // repeated edges were summed
+    return L;
+}
+
+static double sum_values(const Matrix A)
+{
+    double sum = 0.0;
+    for (size_t k = 0; k < A->length; k++)
+        sum += A->data[k].value;
+    return sum;
+}
+
+// every triangle k < j < i is counted once, at (i, j) of (L * L) o L
+void text_triangle_count()
+{
+    Matrix L = random_graph(300, 20), C = init_matrix(0, 0, 0), D = init_matrix(0, 0, 0);
+    masked_multiply_matrix(L, L, L, C);
+    char *edge = (char *)calloc((size_t)300 * 300, 1);
+    if (edge == NULL)
+    {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t k = 0; k < L->length; k++)
+        edge[L->data[k].x * 300 + L->data[k].y] = 1;
+    long brute = 0;
+    for (int i = 0; i < 300; i++)
+        for (int j = 0; j < i; j++)
+            for (int k = 0; k < j && edge[i * 300 + j]; k++)
+                brute += edge[i * 300 + k] && edge[j * 300 + k];
+    printf("300 vertices: %.0f triangles, brute force counts %ld\n", sum_values(C), brute);
+    free(edge);
+    free_matrix(&L);
+
+    L = random_graph(200000, 16);
+    double start = seconds_now();
+    masked_multiply_matrix(L, L, L, C);
+    double masked = seconds_now() - start;
+    start = seconds_now();
+    multiply_matrix(L, L, D);
+    hadamard_matrix(D, L, D);
+    double full = seconds_now() - start;
+    printf("200000 vertices, %zu edges: masked %.0f triangles in %.1f ms, full product then mask %.0f in %.1f ms\n",
+           L->length, sum_values(C), masked * 1e3, sum_values(D), full * 1e3);
+    free_matrix(&L);
+    free_matrix(&C);
+    free_matrix(&D);
+}
+
 void menu()
 {
     int choice;
@@ -534,6 +3790,8 @@ void menu()
         printf("5. Add A + B\n");
         printf("6. Transpose A\n");
         printf("7. Multiply A * B\n");
+        printf("8. Load Matrix A from a .mtx file\n");
+        printf("9. Save Matrix A to a .mtx file\n");
         printf("0. Exit\n");
         printf("================================\n");
         printf("Enter your choice: ");
@@ -622,12 +3880,42 @@ void menu()
             }
             if (C != NULL)
                 free_matrix(&C);
-            C = init_matrix(A->rows * B->cols, A->rows, B->cols);
+            C = init_matrix(0, A->rows, B->cols);
             multiply_matrix(A, B, C);
             printf("Result of A * B:\n");
             print_matrix(C, true);
             break;
 
+        case 8:
+        {
+            char path[512];
+            printf("Enter file name: ");
+            if (scanf("%511s", path) != 1)
+                break;
+            Matrix loaded = read_mtx(path);
+            if (loaded == NULL)
+                break;
+            if (A != NULL)
+                free_matrix(&A);
+            A = loaded;
+            printf("Loaded %zu x %zu matrix with %zu nonzeros\n", A->rows, A->cols, A->length);
+            break;
+        }
+
+        case 9:
+        {
+            char path[512];
+            if (A == NULL)
+            {
+                printf("Matrix A not created!\n");
+                break;
+            }
+            printf("Enter file name: ");
+            if (scanf("%511s", path) == 1 && write_mtx(A, path))
+                printf("Saved %zu nonzeros\n", A->length);
+            break;
+        }
+
         default:
             printf("Invalid choice! Please select again.\n");
             break;
@@ -650,6 +3938,14 @@ int main()
     // text_add_matrix();
     // text_transpose_matrix();
     // text_multiply_matrix();
+    // text_csr_matrix();
+    // text_parallel_matrix();
+    // text_spmv_formats();
+    // text_sort_triples();
+    // text_matrix_file();
+    // text_out_of_core();
+    // text_triangle_count();
     menu();
+    free_thread_pool();
     return 0;
 }